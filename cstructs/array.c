@@ -14,19 +14,49 @@
 #include <string.h>
 
 
+void *allocator__alloc(Allocator allocator, size_t size) {
+  if (allocator == NULL) return malloc(size);
+  return allocator->alloc(size, allocator->context);
+}
+
+void *allocator__resize(Allocator allocator, void *ptr,
+                        size_t old_size, size_t new_size) {
+  if (allocator == NULL) return realloc(ptr, new_size);
+  return allocator->resize(ptr, old_size, new_size, allocator->context);
+}
+
+void allocator__dealloc(Allocator allocator, void *ptr) {
+  if (allocator == NULL) {
+    free(ptr);
+  } else {
+    allocator->dealloc(ptr, allocator->context);
+  }
+}
+
 Array array__new(int capacity, size_t item_size) {
-  Array array = malloc(sizeof(ArrayStruct));
-  return array__init(array, capacity, item_size);
+  return array__new_with_allocator(capacity, item_size, NULL);
 }
 
 Array array__init(Array array, int capacity, size_t item_size) {
+  return array__init_with_allocator(array, capacity, item_size, NULL);
+}
+
+Array array__new_with_allocator(int capacity, size_t item_size,
+                                Allocator allocator) {
+  Array array = allocator__alloc(allocator, sizeof(ArrayStruct));
+  return array__init_with_allocator(array, capacity, item_size, allocator);
+}
+
+Array array__init_with_allocator(Array array, int capacity, size_t item_size,
+                                 Allocator allocator) {
   if (capacity < 1) capacity = 1;
   array->count = 0;
   array->capacity = capacity;
   array->item_size = item_size;
   array->releaser = NULL;
+  array->allocator = allocator;
   if (capacity) {
-    array->items = malloc((int)item_size * capacity);
+    array->items = allocator__alloc(allocator, (int)item_size * capacity);
   } else {
     array->items = NULL;
   }
@@ -45,13 +75,13 @@ void array__clear_with_context(Array array, void *context) {
 void array__release_with_context(void *array, void *context) {
   Array a = (Array)array;
   array__clear_with_context(a, context);
-  free(a->items);
+  allocator__dealloc(a->allocator, a->items);
   a->capacity = 0;
 }
 
 void array__delete_with_context(Array array, void *context) {
   array__release_with_context(array, context);
-  free(array);
+  allocator__dealloc(array->allocator, array);
 }
 
 void array__clear(Array array) {
@@ -76,10 +106,11 @@ void array__add_item_ptr(Array array, void *item) {
 
 void *array__new_ptr(Array array) {
   if (array->count == array->capacity) {
+    size_t old_size = array->capacity * array->item_size;
     array->capacity *= 2;
     if (array->capacity == 0) array->capacity = 1;
-    array->items = realloc(array->items,
-                           array->capacity * (int)array->item_size);
+    array->items = allocator__resize(array->allocator, array->items, old_size,
+                                     array->capacity * (int)array->item_size);
   }
   array->count++;
   return array__item_ptr(array, array->count - 1);
@@ -130,6 +161,7 @@ void array__remove_item(Array array, void *item) {
 
 void array__add_zeroed_items(Array array, int num_items) {
   int new_count = array->count + num_items;
+  size_t old_size = array->capacity * array->item_size;
   int resize_needed = 0;
   while (array->capacity < new_count) {
     array->capacity *= 2;
@@ -137,8 +169,8 @@ void array__add_zeroed_items(Array array, int num_items) {
     resize_needed = 1;
   }
   if (resize_needed) {
-    array->items = realloc(array->items,
-                           array->capacity * (int)array->item_size);
+    array->items = allocator__resize(array->allocator, array->items, old_size,
+                                     array->capacity * (int)array->item_size);
   }
   void *bytes_to_zero = array__item_ptr(array, array->count);
   memset(bytes_to_zero, 0, num_items * array->item_size);
@@ -14,12 +14,30 @@
 
 typedef void (*Releaser)(void *item, void *context);
 
+// A custom source of memory for arrays, lists, and maps, such as an arena.
+// A NULL Allocator means malloc, realloc, and free. The resize function is
+// told the old size so that allocators needn't track sizes themselves.
 typedef struct {
-  int      count;
-  int      capacity;
-  size_t   item_size;
-  Releaser releaser;
-  char *   items;
+  void *(*alloc)  (size_t size, void *context);
+  void *(*resize) (void *ptr, size_t old_size, size_t new_size, void *context);
+  void  (*dealloc)(void *ptr, void *context);
+  void *context;
+} AllocatorStruct;
+
+typedef AllocatorStruct *Allocator;
+
+void *allocator__alloc   (Allocator allocator, size_t size);
+void *allocator__resize  (Allocator allocator, void *ptr,
+                          size_t old_size, size_t new_size);
+void  allocator__dealloc (Allocator allocator, void *ptr);
+
+typedef struct {
+  int       count;
+  int       capacity;
+  size_t    item_size;
+  Releaser  releaser;
+  char *    items;
+  Allocator allocator;  // Default=NULL, meaning malloc.
 } ArrayStruct;
 
 typedef ArrayStruct *Array;
@@ -33,6 +51,13 @@ Array array__new  (int capacity, size_t item_size);
 // For use on an allocated but uninitialized array struct.
 Array array__init (Array array, int capacity, size_t item_size);
 
+// These do the same job as the above ones with all memory, including the
+// struct from array__new_with_allocator, coming from allocator.
+Array array__new_with_allocator  (int capacity, size_t item_size,
+                                  Allocator allocator);
+Array array__init_with_allocator (Array array, int capacity, size_t item_size,
+                                  Allocator allocator);
+
 
 // The next three methods are O(1) if there's no releaser; O(n) if there is.
 void  array__clear   (Array array);  // Releases all items and sets count to 0.
@@ -10,16 +10,24 @@
 #endif
 
 void list__insert(List *list, void *item) {
+  list__insert_with_allocator(list, item, NULL);
+}
+
+void *list__remove_first(List *list) {
+  return list__remove_first_with_allocator(list, NULL);
+}
+
+void list__insert_with_allocator(List *list, void *item, Allocator allocator) {
   List next_list = *list;
-  *list = malloc(sizeof(ListStruct));
+  *list = allocator__alloc(allocator, sizeof(ListStruct));
   (*list)->item = item;
   (*list)->next = next_list;
 }
 
-void *list__remove_first(List *list) {
+void *list__remove_first_with_allocator(List *list, Allocator allocator) {
   if (*list == NULL) { return NULL; }  // See note [1] below.
   ListStruct removed_item = **list;
-  free(*list);
+  allocator__dealloc(allocator, *list);
   *list = removed_item.next;
   return removed_item.item;
 }
@@ -43,10 +51,16 @@ void list__delete(List *list) {
 }
 
 void list__delete_and_release(List *list, Releaser releaser, void *context) {
+  list__delete_and_release_with_allocator(list, releaser, context, NULL);
+}
+
+void list__delete_and_release_with_allocator(List *list, Releaser releaser,
+                                             void *context,
+                                             Allocator allocator) {
   while (*list) {
     List next = (*list)->next;
     if (releaser) releaser((*list)->item, context);
-    free(*list);
+    allocator__dealloc(allocator, *list);
     *list = next;
   }
   // This leaves *list == NULL, as we want.
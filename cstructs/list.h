@@ -23,6 +23,15 @@ void  list__insert       (List *list, void *item);
 // Returns the removed item; NULL on empty lists.
 void *list__remove_first (List *list);
 
+// These do the same job as list__insert, list__remove_first, and
+// list__delete_and_release with list nodes coming from allocator.
+void  list__insert_with_allocator       (List *list, void *item,
+                                         Allocator allocator);
+void *list__remove_first_with_allocator (List *list, Allocator allocator);
+void  list__delete_and_release_with_allocator(List *list, Releaser releaser,
+                                              void *context,
+                                              Allocator allocator);
+
 // Returns the moved item; NULL on empty lists.
 void *list__move_first   (List *from, List *to);
 
@@ -42,10 +42,17 @@ void release_key_value_pair(void *pair, void *map);
 // =================
 
 Map map__new(map__Hash hash, map__Eq eq) {
-  Map map = malloc(sizeof(MapStruct));
+  Map map = map__new_with_allocator(hash, eq, NULL);
+  map->pair_alloc = malloc;
+  return map;
+}
+
+Map map__new_with_allocator(map__Hash hash, map__Eq eq, Allocator allocator) {
+  Map map = allocator__alloc(allocator, sizeof(MapStruct));
   map->count = 0;
 
-  map->buckets = array__new(MIN_BUCKETS, sizeof(void *));
+  map->buckets = array__new_with_allocator(MIN_BUCKETS, sizeof(void *),
+                                           allocator);
   map->buckets->releaser = release_bucket;
   array__add_zeroed_items(map->buckets, MIN_BUCKETS);
 
@@ -53,13 +60,14 @@ Map map__new(map__Hash hash, map__Eq eq) {
   map->eq = eq;
   map->key_releaser = NULL;
   map->value_releaser = NULL;
-  map->pair_alloc = malloc;
+  map->pair_alloc = NULL;
+  map->allocator = allocator;
   return map;
 }
 
 void map__delete(Map map) {
   array__delete_with_context(map->buckets, map);
-  free(map);
+  allocator__dealloc(map->allocator, map);
 }
 
 map__key_value *map__set(Map map, void *key, void *value) {
@@ -79,7 +87,11 @@ map__key_value *map__set(Map map, void *key, void *value) {
     return pair;
   } else {
     // New pair.
-    pair = map->pair_alloc(sizeof(map__key_value));
+    if (map->pair_alloc) {
+      pair = map->pair_alloc(sizeof(map__key_value));
+    } else {
+      pair = allocator__alloc(map->allocator, sizeof(map__key_value));
+    }
     pair->key = key;
     pair->value = value;
 
@@ -89,7 +101,7 @@ map__key_value *map__set(Map map, void *key, void *value) {
     int n = map->buckets->count;
     int index = ((unsigned int)h) % n;
     List *bucket = (List *)array__item_ptr(map->buckets, index);
-    list__insert(bucket, pair);
+    list__insert_with_allocator(bucket, pair, map->allocator);
     map->count++;
   }
   return pair;
@@ -100,7 +112,7 @@ void map__unset(Map map, void *key) {
   List *entry = find_with_hash(map, key, h);
   if (entry == NULL) return;
   release_and_free_pair(map, (*entry)->item);
-  list__remove_first(entry);
+  list__remove_first_with_allocator(entry, map->allocator);
   map->count--;
 }
 
@@ -112,7 +124,8 @@ map__key_value *map__get(Map map, void *needle) {
 void map__clear(Map map) {
   array__for(void **, elt_ptr, map->buckets, index) {
     List *list_ptr = (List *)elt_ptr;
-    list__delete_and_release(list_ptr, release_key_value_pair, map);
+    list__delete_and_release_with_allocator(list_ptr, release_key_value_pair,
+                                            map, map->allocator);
   }
   map->count = 0;
 }
@@ -175,9 +188,8 @@ void double_size(Map map) {
         entry = &((*entry)->next);
         continue;
       }
-      list__remove_first(entry);
       List *new_bucket = (List *)array__item_ptr(map->buckets, bucket_index);
-      list__insert(new_bucket, pair);
+      list__move_first(entry, new_bucket);
     }
     // The last half of the list is all new; no need to look at it.
     if (index >= n / 2) break;
@@ -187,7 +199,7 @@ void double_size(Map map) {
 void release_and_free_pair(Map map, map__key_value *pair) {
   if (map->key_releaser)   map->key_releaser  (pair->key,   NULL);
   if (map->value_releaser) map->value_releaser(pair->value, NULL);
-  free(pair);
+  allocator__dealloc(map->allocator, pair);
 }
 
 void release_key_value_pair(void *pair, void *map) {
@@ -195,5 +207,7 @@ void release_key_value_pair(void *pair, void *map) {
 }
 
 void release_bucket(void *bucket, void *map) {
-  list__delete_and_release((List *)bucket, release_key_value_pair, map);
+  list__delete_and_release_with_allocator((List *)bucket,
+                                          release_key_value_pair, map,
+                                          ((Map)map)->allocator);
 }
@@ -24,6 +24,7 @@ typedef struct {
   Releaser   key_releaser;
   Releaser   value_releaser;
   map__Alloc pair_alloc;  // Default=malloc; customize to add fields per item.
+  Allocator  allocator;   // Default=NULL, meaning malloc.
 } MapStruct;
 
 typedef MapStruct *Map;
@@ -37,6 +38,11 @@ typedef struct {
 Map              map__new    (map__Hash hash, map__Eq eq);
 void             map__delete (Map map);
 
+// All of this map's memory comes from allocator. The pair_alloc of the new
+// map is NULL, which means key-value pairs come from allocator too; pairs are
+// always freed through allocator.
+Map map__new_with_allocator(map__Hash hash, map__Eq eq, Allocator allocator);
+
 map__key_value * map__set    (Map map, void *key, void *value);
 void             map__unset  (Map map, void *key);
 map__key_value * map__get    (Map map, void *needle);
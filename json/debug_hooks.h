@@ -16,16 +16,29 @@
 int cjson_net_obj_allocs = 0;
 int cjson_net_arr_allocs = 0;
 
+// The counts are kept atomically since batch parses allocate from several
+// threads at once.
+#define count_up(n)   __sync_fetch_and_add(&(n), 1)
+#define count_down(n) __sync_fetch_and_sub(&(n), 1)
+
 // Set up the array hooks.
 
 Array array__new_dbg(int x, size_t y) {
-  cjson_net_arr_allocs++;
+  count_up(cjson_net_arr_allocs);
   return array__new(x, y);
 }
 #define array__new array__new_dbg
 
+// Arrays in a document's arena aren't individually freed, so only those
+// without an allocator are counted.
+Array array__new_with_allocator_dbg(int x, size_t y, Allocator a) {
+  if (a == NULL) count_up(cjson_net_arr_allocs);
+  return array__new_with_allocator(x, y, a);
+}
+#define array__new_with_allocator array__new_with_allocator_dbg
+
 void array__delete_dbg(Array x) {
-  cjson_net_arr_allocs--;
+  if (x->allocator == NULL) count_down(cjson_net_arr_allocs);
   array__delete(x);
 }
 #define array__delete array__delete_dbg
@@ -35,20 +48,26 @@ void array__delete_dbg(Array x) {
 #endif
 
 void array__free_but_leave_elements(Array array) {
-  cjson_net_arr_allocs--;
+  count_down(cjson_net_arr_allocs);
   free(array);
 }
 
 // Set up the map (object) hooks.
 
 Map map__new_dbg(map__Hash x, map__Eq y) {
-  cjson_net_obj_allocs++;
+  count_up(cjson_net_obj_allocs);
   return map__new(x, y);
 }
 #define map__new map__new_dbg
 
+Map map__new_with_allocator_dbg(map__Hash x, map__Eq y, Allocator a) {
+  if (a == NULL) count_up(cjson_net_obj_allocs);
+  return map__new_with_allocator(x, y, a);
+}
+#define map__new_with_allocator map__new_with_allocator_dbg
+
 void map__delete_dbg(Map x) {
-  cjson_net_obj_allocs--;
+  if (x->allocator == NULL) count_down(cjson_net_obj_allocs);
   map__delete(x);
 }
 #define map__delete map__delete_dbg
@@ -5,11 +5,15 @@
 
 #include "json.h"
 
-#include <ctype.h>
-#include <math.h>
-#include <stdarg.h>
+#include "jsonnum.h"
+#include "jsonoutput.h"
+#include "jsonparse.h"
+#include "jsonscan.h"
+
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #define array__free_but_leave_elements free
 
@@ -45,12 +49,13 @@ static char *decoded_chars = "\b\f\n\r\t\"\\";
 // These are from:
 // https://gist.github.com/tylerneylon/9773800
 
-static int decode_code_point(char **s) {
+// Nothing at or after end is read.
+static int decode_code_point(const char **s, const char *end) {
   int k = clo(**s);               // Count # of leading 1 bits (0 if **s == 0).
   int mask = (1 << (8 - k)) - 1;  // All 1's with k leading 0's.
   int value = **s & mask;
   // Note that k = #total bytes, or 0.
-  for (++(*s), --k; k > 0 && **s; --k, ++(*s)) {
+  for (++(*s), --k; k > 0 && *s < end && **s; --k, ++(*s)) {
     value <<= 6;
     value += (**s & 0x3F);
   }
@@ -78,31 +83,159 @@ static void encode_code_point(char **s, char *end, int code) {
 // Returns 0 if no split was needed.
 static int split_into_surrogates(int code, int *surr1, int *surr2) {
   if (code <= 0xFFFF) return 0;
-  *surr2 = 0xDC00 | (code & 0x3FF);        // Save the low 10 bits.
-  code >>= 10;                             // Drop the low 10 bits.
-  *surr1 = 0xD800 | (code & 0x03F);        // Save the next 6 bits.
-  *surr1 |= ((code & 0x7C0) - 0x40) << 6;  // Insert the last 5 bits less 1.
+  code -= 0x10000;                   // This leaves 20 bits.
+  *surr1 = 0xD800 | (code >> 10);    // Save the high 10 bits.
+  *surr2 = 0xDC00 | (code & 0x3FF);  // Save the low 10 bits.
   return 1;
 }
 
+#define is_high_surrogate(code) (((code) & ~0x3FF) == 0xD800)
+#define is_low_surrogate(code)  (((code) & ~0x3FF) == 0xDC00)
+
 // Expects to be used in a loop and see all code points in *code. Start *old at
 // 0; this function updates *old for you - don't change it. Returns 0 when *code
 // is the 1st of a surrogate pair; otherwise use *code as the final code point.
+// When *old is set, *code must be a low surrogate; a low surrogate on its own
+// becomes U+FFFD.
 static int join_from_surrogates(int *old, int *code) {
-  if (*old) *code = (((*old & 0x3FF) + 0x40) << 10) + (*code & 0x3FF);
-  *old = ((*code & 0xD800) == 0xD800 ? *code : 0);
-  return !(*old);
+  if (*old) {
+    *code = (((*old & 0x3FF) + 0x40) << 10) + (*code & 0x3FF);
+    *old = 0;
+    return 1;
+  }
+  if (is_high_surrogate(*code)) {
+    *old = *code;
+    return 0;
+  }
+  if (is_low_surrogate(*code)) *code = 0xFFFD;
+  return 1;
 }
 
 
-// Internal functions.
+// Internal types and functions.
+
+typedef struct {
+  const char *start;  // The beginning of the input.
+  const char *end;    // Just past the end of the input; this is never read.
+  uint32_t *  index;  // Offsets of structural chars; NULL when not indexing.
+  uint32_t *  next;   // The first index entry that may be ahead of the input.
+  int         in_situ;  // If true, strings are decoded within the input.
+  Allocator   allocator;  // Non-NULL when parsing into a document's arena.
+  Array       stack;      // The open arrays and objects, as json_Item *'s.
+  int         max_depth;  // The most containers that may be open at once.
+  json_Item   error;      // Holds errors found between items.
+  long        base;       // Added to error indexes; the offset of start.
+  const char **key_cache;  // Non-NULL when interning keys.
+} Parser;
+
+// Arena allocation for documents.
+//
+// An arena hands out memory from a list of big chunks and frees them all at
+// once. The most recent allocation can be grown or given back in place, which
+// suits strings built up a char at a time.
+
+typedef struct Chunk {
+  struct Chunk *prev;
+  char *        end;
+} Chunk;
+
+typedef struct {
+  Chunk *         chunk;       // The newest chunk; it links to older ones.
+  char *          next;        // The next free byte in chunk.
+  char *          last;        // The most recent allocation.
+  size_t          chunk_size;  // The size of the next chunk to add.
+  AllocatorStruct allocator;   // Allocates from this arena.
+} Arena;
+
+#define arena_align(n) (((n) + 15) & ~(size_t)15)
+#define max_chunk_size ((size_t)16 << 20)
+
+static void *arena_alloc(size_t size, void *context) {
+  Arena *arena = (Arena *)context;
+  size = arena_align(size);
+  if (arena->chunk == NULL ||
+      (size_t)(arena->chunk->end - arena->next) < size) {
+    size_t header_size = arena_align(sizeof(Chunk));
+    size_t chunk_size = arena->chunk_size;
+    if (chunk_size < header_size + size) chunk_size = header_size + size;
+    Chunk *chunk = malloc(chunk_size);
+    chunk->prev = arena->chunk;
+    chunk->end = (char *)chunk + chunk_size;
+    arena->chunk = chunk;
+    arena->next = (char *)chunk + header_size;
+    if (arena->chunk_size < max_chunk_size) arena->chunk_size *= 2;
+  }
+  arena->last = arena->next;
+  arena->next += size;
+  return arena->last;
+}
+
+static void *arena_resize(void *ptr, size_t old_size, size_t new_size,
+                          void *context) {
+  Arena *arena = (Arena *)context;
+  if (ptr && ptr == arena->last &&
+      (size_t)(arena->chunk->end - arena->last) >= arena_align(new_size)) {
+    arena->next = arena->last + arena_align(new_size);
+    return ptr;
+  }
+  void *new_ptr = arena_alloc(new_size, context);
+  if (ptr) memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  return new_ptr;
+}
+
+static void arena_dealloc(void *ptr, void *context) {
+  Arena *arena = (Arena *)context;
+  if (ptr && ptr == arena->last) {
+    arena->next = arena->last;
+    arena->last = NULL;
+  }
+}
+
+// The first chunk is sized from the input length, since parsed items take up
+// a few times as much memory as their json text.
+static Arena *arena_new(size_t input_len) {
+  Arena *arena = malloc(sizeof(Arena));
+  arena->chunk = NULL;
+  arena->next = arena->last = NULL;
+  arena->chunk_size = arena_align(input_len < 4096 ? 4096 : input_len);
+  arena->allocator = (AllocatorStruct){ .alloc   = arena_alloc,
+                                        .resize  = arena_resize,
+                                        .dealloc = arena_dealloc,
+                                        .context = arena };
+  return arena;
+}
+
+static void arena_delete(Arena *arena) {
+  for (Chunk *chunk = arena->chunk, *prev; chunk; chunk = prev) {
+    prev = chunk->prev;
+    free(chunk);
+  }
+  free(arena);
+}
 
 // Using macros is a hacky-but-not-insane (in my opinion)
 // way to ensure these 'functions' are inlined.
 
+#define is_space(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+// The macros below expect a Parser *p to be in scope.
+
+// The index of input, for error messages.
+#define index_of(input) ((long)((input) - p->start) + p->base)
+
+// The char at input, or '\0' at the end of the input.
+#define peek(input) ((input) < p->end ? *(input) : '\0')
+
+// With a structural index, a run of whitespace is skipped by jumping to the
+// next indexed offset.
 #define next_token(input) \
   input++; \
-  input += strspn(input, " \t\r\n");
+  if (p->index == NULL) { \
+    while (input < p->end && is_space(*input)) input++; \
+  } else if (input < p->end && is_space(*input)) { \
+    while (p->start + *p->next < input) p->next++; \
+    input = p->start + *p->next; \
+  }
 
 #define rngmap(base, low, hi, too_low, too_hi) \
   (c < low ? too_low : (c <= hi ? c - low + base : too_hi))
@@ -113,95 +246,120 @@ static int join_from_surrogates(int *old, int *code) {
   rngmap(10, 'A', 'F', rngmap( 0, '0', '9', -1, -1), \
                        rngmap(10, 'a', 'f', -1, -1))
 
+// A high surrogate that isn't followed by a low one is written as U+FFFD, so
+// decoded strings are always valid UTF-8.
+#define put_replacement(put, out) put(out, "\xEF\xBF\xBD", 3)
+
 // Both parse_hex_code_pt and parse_string_unit follow these rules:
 // At start: *input is the first hex char to read.
 // At end: c is the last-read char, *input is the first char not yet read.
+// Decoded chars are written with put(out, chars, len).
 
+// A short escape ends at the first char that isn't a hex digit; that char is
+// only peeked at, so a closing quote still closes the string.
 #define parse_hex_code_pt(char_array, input, val) \
   for (int i = 0; c && i < 4; ++i) { \
-    c = *input++; \
+    c = peek(input); \
     int vohc = value_of_hex_char; \
     if (vohc < 0) break; \
+    input++; \
     val <<= 4; \
     val += vohc; \
   }
 
-#define parse_string_unit(char_array, input)                     \
-  c = *input++;                                                  \
+#define parse_string_unit(put, out, input)                       \
+  c = peek(input);                                               \
+  input++;                                                       \
   if (c != '\\') {                                               \
-    array__new_val(char_array, char) = c;                        \
+    put(out, &c, 1);                                             \
+  } else if (input == p->end) {                                  \
+    c = '\0';  /* The input ends after the backslash. */         \
   } else {                                                       \
-    c = *input++;                                                \
+    c = peek(input);                                             \
+    input++;                                                     \
     if (c == 'u') {                                              \
       int val = 0;                                               \
-      parse_hex_code_pt(char_array, input, val);                 \
+      parse_hex_code_pt(out, input, val);                        \
+      if (old_val && !is_low_surrogate(val)) {                   \
+        put_replacement(put, out);                               \
+        old_val = 0;                                             \
+      }                                                          \
       if (join_from_surrogates(&old_val, &val)) {                \
         char *s, buf[4];                                         \
         s = buf;                                                 \
         encode_code_point(&s, s + 4, val);                       \
-        ArrayStruct buf_holder = { .count     = (int)(s - buf),  \
-                                   .item_size = 1,               \
-                                   .items     = buf };           \
-        array__append_array(char_array, &buf_holder);            \
+        put(out, buf, s - buf);                                  \
       }                                                          \
     } else {                                                     \
       char *esc_ptr = strchr(encoded_chars, c);                  \
       if (esc_ptr) c = decoded_chars[esc_ptr - encoded_chars];   \
-      array__new_val(char_array, char) = c;                      \
+      put(out, &c, 1);                                           \
     }                                                            \
   }
 
-// A consolidated function for error cleanup in
-// parse_{value,frac_part,exponent}.
-static char *err(json_Item *item, json_Item *subitem,
-                 char *msg, long index, Array arr, Map obj) {
-  if (subitem) *item = *subitem;
-  if (msg) {
-    item->type = item_error;
-    asprintf(&item->value.string, "Error: %s at index %ld", msg, index);
+// Clean runs are found with json_scan_string_utf8, which stops early at a byte
+// that isn't valid UTF-8. Those bytes are never ASCII.
+#define is_bad_utf8(input) ((unsigned char)peek(input) >= 0x80)
+
+// Decodes the rest of a string, starting with a clean run of chars from input
+// to run_end. At the end, input points to the closing quote; otherwise c is
+// '\0', input points to the problem, and is_utf8 is false if the problem is
+// invalid UTF-8 rather than a string that isn't closed. A high surrogate
+// escape waits in old_val for a low one, which can only come next as a \u
+// escape.
+#define parse_string_rest(put, out, input, run_end)             \
+  for (;;) {                                                    \
+    if (old_val && (run_end > input || peek(input) != '\\' ||   \
+                    peek(input + 1) != 'u')) {                  \
+      put_replacement(put, out);                                \
+      old_val = 0;                                              \
+    }                                                           \
+    put(out, input, run_end - input);                           \
+    input = run_end;                                            \
+    if (c == '\0' || peek(input) == '"') break;                 \
+    if (input == p->end) {                                      \
+      c = '\0';                                                 \
+      break;                                                    \
+    }                                                           \
+    if (is_bad_utf8(input)) {                                   \
+      c = '\0';                                                 \
+      is_utf8 = false;                                          \
+      break;                                                    \
+    }                                                           \
+    parse_string_unit(put, out, input);                         \
+    run_end = c ? json_scan_string_utf8(input, p->end) : input; \
   }
-  if (subitem) subitem->type = item_null;
-  if (arr) array__delete(arr);
-  if (obj) map__delete(obj);
-  return NULL;
-}
 
-static char *parse_exponent(json_Item *item, char *input, char *start) {
-  if (*input == 'e' || *input == 'E') {
-    input++;
-    if (*input == '\0') {
-      return err(item, 0, "expected exponent", input - start, 0, 0);
+// The error message after parse_string_rest, or NULL if there's none.
+#define string_error() \
+  (c != '\0' ? NULL : is_utf8 ? "string not closed" : "invalid UTF-8")
+
+// An in-situ put; a decoded string is never longer than its source, so dest
+// never passes the input.
+#define put_in_place(dest, chars, len) \
+  (memmove(dest, chars, len), dest += (len))
+
+// Appends len chars to char_array with a single copy.
+static void append_chars(Array char_array, const char *chars, size_t len) {
+  if ((size_t)char_array->count + len > (size_t)char_array->capacity) {
+    size_t old_capacity = char_array->capacity;
+    while ((size_t)char_array->count + len > (size_t)char_array->capacity) {
+      char_array->capacity *= 2;
     }
-    double exp = 0.0;
-    double sign = (*input == '-' ? -1.0 : 1.0);
-    if (*input == '-' || *input == '+') input++;
-    if (!isdigit(*input)) {
-      return err(item, 0, "expected digit", input - start, 0, 0);
-    }
-    do {
-      exp *= 10.0;
-      exp += (*input - '0');
-      input++;
-    } while (isdigit(*input));
-    item->value.number = item->value.number * pow(10.0, exp * sign);
+    char_array->items = allocator__resize(char_array->allocator,
+                                          char_array->items, old_capacity,
+                                          char_array->capacity);
   }
-  return input - 1;  // Leave the number pointing at its last character.
+  memcpy(char_array->items + char_array->count, chars, len);
+  char_array->count += (int)len;
 }
 
-static char *parse_frac_part(json_Item *item, char *input, char *start) {
-  if (*input == '.') {
-    input++;
-    double w = 0.1;
-    if (!isdigit(*input)) {
-      return err(item, 0, "expected digit after .", input - start, 0, 0);
-    }
-    do {
-      item->value.number += w * (*input - '0');
-      w *= 0.1;
-      input++;
-    } while (isdigit(*input));
-  }
-  return parse_exponent(item, input, start);
+// Makes item an error with the given message; returns NULL.
+static char *err(json_Item *item, char *msg, long index) {
+  item->type = item_error;
+  item->is_borrowed = false;
+  asprintf(&item->value.string, "Error: %s at index %ld", msg, index);
+  return NULL;
 }
 
 static void freer(void *vp, void *context) {
@@ -216,315 +374,813 @@ static void json_item_freer(void *vp, void *context) {
   json_free_item(vp);
 }
 
-// Assumes there's no leading whitespace.
-// At the end, the input points to the last
-// character of the parsed value.
-static char *parse_value(json_Item *item, char *input, char *start) {
-
-  // Parse a number.
-  int sign = 1;
-  if (*input == '-') {
-    sign = -1;
-    input++;
-  }
-
-  if (isdigit(*input)) {
-    item->type = item_number;
-    item->value.number = 0.0;
+// Appends the decoded chars of a string to char_array, starting with a clean
+// run of chars from *input to run_end. At the end, *input points to the
+// closing quote, or to the problem when an error message is returned.
+static char *append_string(Parser *p, Array char_array, const char **input,
+                           const char *run_end) {
+  char c = 1;
+  int old_val = 0, is_utf8 = true;
+  const char *s = *input;
+  parse_string_rest(append_chars, char_array, s, run_end);
+  *input = s;
+  return string_error();
+}
 
-    if (*input != '0') {
-      do {
-        item->value.number *= 10.0;
-        item->value.number += (*input - '0');
-        input++;
-      } while (isdigit(*input));
-    } else {
-      input++;
-    }
-    input = parse_frac_part(item, input, start);
-    if (input) item->value.number *= sign;
-    return input;
+// Parses a number, string, or literal. Assumes there's no leading whitespace.
+// At the end, the input points to the last character of the parsed value.
+static const char *parse_scalar(Parser *p, json_Item *item,
+                                const char *input) {
+  item->is_borrowed = false;
 
-  } else if (sign == -1) {
-    // This is a - without a number after it.
-    return err(item, 0, "expected digit", input - start, 0, 0);
+  // Parse a number.
+  if (peek(input) == '-' || ('0' <= peek(input) && peek(input) <= '9')) {
+    const char *end;
+    char *msg = json_parse_number(input, p->end, item, &end);
+    if (msg) return err(item, msg, index_of(end));
+    return end - 1;  // Leave the input pointing at its last character.
   }
 
   // Parse a string.
-  if (*input == '"') {
+  if (peek(input) == '"') {
     input++;
     item->type = item_string;
-    Array char_array = array__new(16, sizeof(char));
+
+    // In-situ strings are decoded in place and null-terminated over the
+    // closing quote.
+    const char *run_end = json_scan_string_utf8(input, p->end);
+    if (is_bad_utf8(run_end)) {
+      return err(item, "invalid UTF-8", index_of(run_end));
+    }
     char c = 1;
-    int old_val = 0;
-    while (c && *input != '"') {
-      parse_string_unit(char_array, input);
+    int old_val = 0, is_utf8 = true;
+    if (p->in_situ) {
+      char *dest = (char *)run_end;
+      item->value.string = (char *)input;
+      input = run_end;
+      parse_string_rest(put_in_place, dest, input, run_end);
+      if (c == '\0') return err(item, string_error(), index_of(input));
+      *dest = '\0';
+      item->is_borrowed = true;
+      return input;
     }
-    // Check for he end of the string before we see a closing quote.
-    if (c == '\0') {
-      return err(item, 0, "string not closed", input - start, char_array, 0);
+
+    // Fast path: the string has no escapes or control characters.
+    if (run_end < p->end && *run_end == '"') {
+      size_t len = run_end - input;
+      item->value.string = allocator__alloc(p->allocator, len + 1);
+      item->is_borrowed = (p->allocator != NULL);
+      memcpy(item->value.string, input, len);
+      item->value.string[len] = '\0';
+      return run_end;
+    }
+
+    // Slow path: copy clean runs in bulk and decode the rest one at a time.
+    Array char_array = array__new_with_allocator((int)(run_end - input) + 16,
+                                                 sizeof(char), p->allocator);
+    char *msg = append_string(p, char_array, &input, run_end);
+    if (msg) {
+      array__delete(char_array);
+      return err(item, msg, index_of(input));
     }
     array__new_val(char_array, char) = '\0';  // Terminating null.
 
     item->value.string = char_array->items;
-    array__free_but_leave_elements(char_array);
+    if (p->allocator) {
+      item->is_borrowed = true;
+      allocator__dealloc(p->allocator, char_array);
+    } else {
+      array__free_but_leave_elements(char_array);
+    }
 
     return input;
   }
 
-  // Parse an array.
-  if (*input == '[') {
-    next_token(input);
+  // Parse a literal: true, false, or null.
+  char *msg;
+  const char *last = json_parse_literal(input, p->end, &item->type, &msg);
+  if (last == NULL) return err(item, msg, index_of(input));
+  item->value.boolean = (item->type == item_true);  // False for null, too.
+  return last;
+}
 
-    Array array = array__new(8, sizeof(json_Item));
-    array->releaser = json_item_releaser;
+// Makes item an empty array or object for the bracket '[' or '{'.
+static void new_container(Parser *p, json_Item *item, char bracket) {
+  if (bracket == '[') {
+    Array array = array__new_with_allocator(8, sizeof(json_Item),
+                                            p->allocator);
+    if (p->allocator == NULL) array->releaser = json_item_releaser;
     item->type = item_array;
     item->value.array = array;
+  } else {
+    Map obj;
+    if (p->key_cache) {
+      obj = map__new_with_allocator(json_interned_hash, json_interned_eq,
+                                    p->allocator);
+    } else {
+      obj = map__new_with_allocator(json_str_hash, json_str_eq, p->allocator);
+    }
+    if (p->allocator == NULL) {
+      // In-situ and interned keys are borrowed.
+      obj->key_releaser = (p->in_situ || p->key_cache) ? NULL : freer;
+      obj->value_releaser = json_item_freer;
+    }
+    item->type = item_object;
+    item->value.object = obj;
+  }
+  item->is_borrowed = false;
+}
 
-    while (*input != ']') {
-      if (array->count) {
-        if (*input != ',') {
-          return err(item, 0, "expected ']' or ','", input - start, array, 0);
-        }
-        next_token(input);
-      }
-      json_Item *subitem = (json_Item *)array__new_ptr(array);
-      input = parse_value(subitem, input, start);
-      if (input == NULL) return err(item, subitem, 0, 0, array, 0);
-      next_token(input);
+// Adds a placeholder null item to container and returns it. Objects take
+// ownership of key.
+static json_Item *add_subitem(Parser *p, json_Item *container, char *key) {
+  json_Item *subitem;
+  if (container->type == item_array) {
+    subitem = (json_Item *)array__new_ptr(container->value.array);
+  } else {
+    subitem = allocator__alloc(p->allocator, sizeof(json_Item));
+    map__set(container->value.object, key, subitem);
+  }
+  subitem->type = item_null;
+  return subitem;
+}
+
+// Replaces the partially parsed item at root with an error item. The message
+// is taken from the error item at failed, which may be within root.
+static const char *fail(Parser *p, json_Item *root, json_Item *failed) {
+  json_Item error = *failed;
+  if (failed != root) {
+    failed->type = item_null;
+    if (p->allocator == NULL) json_release_item(root);
+  }
+  *root = error;
+  return NULL;
+}
+
+// Parses a key into *key as a string from the intern pool. Keys without escapes
+// are interned straight from the input. At the end, input points to the
+// closing quote.
+static const char *intern_key(Parser *p, json_Item *key, const char *input) {
+  input++;
+  const char *run_end = json_scan_string_utf8(input, p->end);
+  if (run_end < p->end && *run_end == '"') {
+    key->value.string = (char *)json_intern_cached(input, run_end - input,
+                                                   p->key_cache);
+  } else {
+    Array char_array = array__new((int)(run_end - input) + 16, sizeof(char));
+    char *msg = append_string(p, char_array, &input, run_end);
+    if (msg) {
+      array__delete(char_array);
+      return err(key, msg, index_of(input));
     }
+    array__new_val(char_array, char) = '\0';
+    key->value.string = (char *)json_intern_cached(
+        char_array->items, strlen(char_array->items), p->key_cache);
+    array__delete(char_array);
+    run_end = input;
+  }
+  key->type = item_string;
+  key->is_borrowed = true;
+  return run_end;
+}
 
-    return input;
+// Reads an object key and its colon into a new null item in obj, which
+// becomes *value. At the start, input points to the key's opening quote; at
+// the end, it points to the value.
+static const char *parse_key(Parser *p, json_Item *obj_item,
+                             json_Item **value, const char *input) {
+  if (peek(input) != '"') {
+    return err(&p->error, "expected '\"'", index_of(input));
+  }
+  json_Item key;
+  input = (p->key_cache ? intern_key(p, &key, input) :
+                          parse_scalar(p, &key, input));
+  if (input == NULL) {
+    p->error = key;
+    return NULL;
   }
 
-  // Parse an object.
-  if (*input == '{') {
-    next_token(input);
-    Map obj = map__new(json_str_hash, json_str_eq);
-    obj->key_releaser = freer;
-    obj->value_releaser = json_item_freer;
-    item->type = item_object;
-    item->value.object = obj;
-    while (*input != '}') {
-      if (obj->count) {
-        if (*input != ',') {
-          return err(item, 0, "expected '}' or ','", input - start, 0, obj);
-        }
-        next_token(input);
-      }
+  *value = add_subitem(p, obj_item, key.value.string);
+
+  // Parse the separating colon.
+  next_token(input);
+  if (peek(input) != ':') {
+    return err(&p->error, "expected ':'", index_of(input));
+  }
+  next_token(input);
+  return input;
+}
 
-      // Parse the key, which should be a string.
-      if (*input != '"') {
-        return err(item, 0, "expected '\"'", input - start, 0, obj);
+// Parses a value, which may be an array or object nested up to
+// p->max_depth containers deep. Nesting is tracked with an explicit stack of
+// the open containers rather than with recursion.
+// Assumes there's no leading whitespace.
+// At the end, the input points to the last
+// character of the parsed value.
+static const char *parse_value(Parser *p, json_Item *root,
+                               const char *input) {
+  json_Item *item = root;  // The item to be parsed next.
+  for (;;) {
+    if (peek(input) == '[' || peek(input) == '{') {
+      if (p->stack->count == p->max_depth) {
+        err(&p->error, "nesting too deep", index_of(input));
+        return fail(p, root, &p->error);
       }
-      json_Item key;
-      input = parse_value(&key, input, start);
-      if (input == NULL) {
-        *item = key;
-        map__delete(obj);
-        return NULL;
+      new_container(p, item, *input);
+      next_token(input);
+
+      // Open the container unless it's empty.
+      char close = (item->type == item_array ? ']' : '}');
+      if (peek(input) != close) {
+        array__new_val(p->stack, json_Item *) = item;
+        if (item->type == item_array) {
+          item = add_subitem(p, item, NULL);
+        } else {
+          input = parse_key(p, item, &item, input);
+          if (input == NULL) return fail(p, root, &p->error);
+        }
+        continue;
       }
+    } else {
+      input = parse_scalar(p, item, input);
+      if (input == NULL) return fail(p, root, item);
+    }
 
-      // Set up placeholder objects in the map.
-      json_Item *subitem = (json_Item *)malloc(sizeof(json_Item));
+    // The item is complete and input points to its last character. Move on
+    // to the next item in the innermost open container, closing any that
+    // are done.
+    for (;;) {
+      if (p->stack->count == 0) return input;
+      json_Item *container = array__item_val(p->stack, p->stack->count - 1,
+                                             json_Item *);
+      next_token(input);
+      if (container->type == item_array) {
+        if (peek(input) == ',') {
+          next_token(input);
+          item = add_subitem(p, container, NULL);
+          break;
+        }
+        if (peek(input) != ']') {
+          err(&p->error, "expected ']' or ','", index_of(input));
+          return fail(p, root, &p->error);
+        }
+      } else {
+        if (peek(input) == ',') {
+          next_token(input);
+          input = parse_key(p, container, &item, input);
+          if (input == NULL) return fail(p, root, &p->error);
+          break;
+        }
+        if (peek(input) != '}') {
+          err(&p->error, "expected '}' or ','", index_of(input));
+          return fail(p, root, &p->error);
+        }
+      }
+      p->stack->count--;  // The container is closed.
+    }
+  }
+}
 
-      // obj takes ownership of both pointers passed in.
-      map__set(obj, key.value.string, subitem);
+static void push_item(Array *stack, json_Item *item) {
+  if (*stack == NULL) *stack = array__new(16, sizeof(json_Item));
+  array__add_item_ptr(*stack, item);
+}
 
-      // Parse the separating colon.
-      next_token(input);
-      if (*input != ':') {
-        return err(item, subitem, "expected ':'", input - start, 0, obj);
+// Releases item without recursing into nested containers, which are added to
+// *stack instead. This handles the releasers set up by the parser; containers
+// with other releasers are deleted as they are.
+static void release_item_shallowly(json_Item item, Array *stack) {
+  if (item.type == item_string || item.type == item_error) {
+    if (item.value.string != NULL && !item.is_borrowed) {
+      free(item.value.string);
+    }
+    return;
+  }
+  if (item.type != item_array && item.type != item_object) return;
+
+  if (item.type == item_array) {
+    Array array = item.value.array;
+    if (array->releaser == json_item_releaser) {
+      array__for(json_Item *, subitem, array, i) {
+        if (subitem->type == item_array || subitem->type == item_object) {
+          push_item(stack, subitem);
+        } else {
+          release_item_shallowly(*subitem, stack);
+        }
       }
+      array->releaser = NULL;
+    }
+    array__delete(array);
+    return;
+  }
 
-      // Parse the value of this key.
-      next_token(input);
-      input = parse_value(subitem, input, start);
-      if (input == NULL) return err(item, subitem, 0, 0, 0, obj);
-      next_token(input);
+  Map obj = item.value.object;
+  if (obj->value_releaser == json_item_freer) {
+    map__for(pair, obj) {
+      json_Item *value = (json_Item *)pair->value;
+      if (value->type == item_array || value->type == item_object) {
+        push_item(stack, value);
+      } else {
+        release_item_shallowly(*value, stack);
+      }
+      free(value);
     }
-    return input;
+    obj->value_releaser = NULL;
   }
+  map__delete(obj);
+}
 
-  // Parse a literal: true, false, or null.
-  char *literals[3] = {"false", "true", "null"};
-  size_t lit_len[3] = {5, 4, 4};
-  json_ItemType types[3] = {item_false, item_true, item_null};
+// Parses the whole input, including leading and trailing whitespace, and
+// returns the tail.
+static const char *parse(Parser *p, json_Item *item,
+                         json_ParseOptions options) {
+  if (options.use_index) {
+    p->index = p->next = json_structural_index(p->start, p->end - p->start);
+  }
+  p->stack = array__new(16, sizeof(json_Item *));
+  p->max_depth = options.max_depth ? options.max_depth : json_max_depth;
+  const char *key_cache[json_intern_cache_size];
+  if (options.intern_keys) {
+    memset(key_cache, 0, sizeof(key_cache));
+    p->key_cache = key_cache;
+  }
+
+  // Skip leading whitespace.
+  const char *input = p->start;
+  while (input < p->end && is_space(*input)) input++;
+  input = parse_value(p, item, input);
+  if (input) {
+    next_token(input);  // Skip last parsed char and trailing whitespace.
+  }
+  array__delete(p->stack);
+  free(p->index);
+  return input;
+}
+
+// Library-internal functions shared with the other parsers.
+
+const char *json_parse_scalar(const char *token, size_t len, long offset,
+                              json_Item *item) {
+  Parser parser = { .start = token, .end = token + len, .base = offset };
+  return parse_scalar(&parser, item, token);
+}
 
+const char *json_parse_literal(const char *input, const char *end,
+                               json_ItemType *type, char **msg) {
+  static char *literals[3] = {"false", "true", "null"};
+  static char *messages[3] = {"expected 'false'", "expected 'true'",
+                              "expected 'null'"};
+  static const size_t lit_len[3] = {5, 4, 4};
+  static const json_ItemType types[3] = {item_false, item_true, item_null};
+
+  char c = (input < end ? *input : '\0');
   for (int i = 0; i < 3; ++i) {
-    if (*input != literals[i][0]) continue;
-    if (strncmp(input, literals[i], lit_len[i]) != 0) {
-      char msg[32];
-      snprintf(msg, 32, "expected '%s'", literals[i]);
-      return err(item, 0, msg, input - start, 0, 0);
+    if (c != literals[i][0]) continue;
+    if ((size_t)(end - input) < lit_len[i] ||
+        memcmp(input, literals[i], lit_len[i]) != 0) {
+      *msg = messages[i];
+      return NULL;
     }
-    item->type = types[i];
-
-    // The 0 literal is for the null case.
-    item->value.boolean = (i < 2) ? i : 0;
+    *type = types[i];
     return input + (lit_len[i] - 1);
   }
+  *msg = "unexpected character";
+  return NULL;
+}
 
-  // If we get here, the string is not well-formed.
-  return err(item, 0, "unexpected character", input - start, 0, 0);
+void json_new_container(json_Item *item, char bracket) {
+  Parser parser = { 0 };
+  new_container(&parser, item, bracket);
 }
 
-// Expects the input array to have items of type char *.
-static int array_printf(Array array, const char *fmt, ...) {
-  va_list args;
-  va_start(args, fmt);
-  int return_value = vasprintf((char **)array__new_ptr(array), fmt, args);
-  va_end(args);
-  return return_value;
+json_Item *json_add_subitem(json_Item *container, char *key) {
+  Parser parser = { 0 };
+  return add_subitem(&parser, container, key);
 }
 
-// Expects the array to have items of type char *.
-// Caller owns the newly-allocated return val.
-static char *array_join(Array array) {
-  int total_len = 0;
-  array__for(char **, str_ptr, array, idx) total_len += strlen(*str_ptr);
-  char *str = malloc(total_len + 1);  // +1 for the final null.
-  char *tail = str;
-  array__for(char **, str_ptr, array, idx) tail = stpcpy(tail, *str_ptr);
-  return str;
+void json_set_error(json_Item *item, char *msg, long index) {
+  err(item, msg, index);
 }
 
-#define new_elt(arr) array__new_val(arr, char)
+const char *json_decode_string(const char *input, const char *end,
+                               long offset, Array chars, json_Item *error) {
+  Parser parser = { .start = input, .end = end, .base = offset };
+  Parser *p = &parser;
+  input++;
+  char *msg = append_string(p, chars, &input,
+                            json_scan_string_utf8(input, end));
+  if (msg) return err(error, msg, index_of(input));
+  return input;
+}
 
-#define add_u_escaped_pt(arr, pt) \
-  new_elt(arr) = '\\'; \
-  new_elt(arr) = 'u'; \
-  for (int i = 0; i < 4; ++i, pt >>= 4) hex_digits[3 - i] = hex[pt % 16]; \
-  for (int i = 0; i < 4; ++i) new_elt(arr) = hex_digits[i];
+const char *json_decode_string_to(const char *input, const char *end,
+                                  char *dest, size_t *len) {
+  Parser parser = { .start = input, .end = end };
+  Parser *p = &parser;
+  char *dest_start = dest;
+  input++;
+  const char *run_end = json_scan_string_utf8(input, end);
+  char c = 1;
+  int old_val = 0, is_utf8 = true;
+  parse_string_rest(put_in_place, dest, input, run_end);
+  if (string_error()) return NULL;
+  *len = dest - dest_start;
+  return input;
+}
 
-// Caller must free the returned string.
-static char *escaped_str(char *s) {
-  Array array = array__new(4, sizeof(char));
+void json_tokenizer_init(json_Tokenizer *t, const char *buf, size_t len,
+                         int max_depth) {
+  *t = (json_Tokenizer){ .start = buf, .end = buf + len, .input = buf,
+                         .last = json_token_none, .depth = 0,
+                         .max_depth = max_depth ? max_depth : json_max_depth };
+  while (t->input < t->end && is_space(*t->input)) t->input++;
+  t->is_object = t->bits;
+  if (t->max_depth > json_max_depth) {
+    t->is_object = malloc((t->max_depth / 64 + 1) * sizeof(uint64_t));
+  }
+}
 
-  // These are used in add_u_escaped_pt to encode non-ascii unicode characters.
-  static char *hex = "0123456789ABCDEF";
-  char hex_digits[4];
+void json_tokenizer_end(json_Tokenizer *t) {
+  if (t->is_object != t->bits) free(t->is_object);
+}
 
-  while (*s) {
-    int code_pt = decode_code_point(&s);
-    char *esc_ptr = strchr(decoded_chars, code_pt);
-    if (esc_ptr) {
-      new_elt(array) = '\\';
-      new_elt(array) = encoded_chars[esc_ptr - decoded_chars];
-    } else if (code_pt < 0x80) {
-      new_elt(array) = code_pt;
-    } else {
-      int surr1, surr2;
-      if (split_into_surrogates(code_pt, &surr1, &surr2)) {
-        add_u_escaped_pt(array, surr1);
-        add_u_escaped_pt(array, surr2);
-      } else {
-        add_u_escaped_pt(array, code_pt);
-      }
-    }
-  }
-  new_elt(array) = '\0';
-  char *escaped_s = array->items;
-  array__free_but_leave_elements(array);
-  return escaped_s;
-}
-
-static void print_item(Array array, json_Item item,
-                       char *indent, int be_terse) {
-  char *outer_indent = indent;
-  // Nest indents, except when terse.
-  if (!be_terse) { asprintf(&indent, "%s  ", indent); }
-  char *sep = be_terse ? "," : ",\n";
-  char *spc = be_terse ? "" : " ";
-  char *lit[] = { [item_true]  = "true" ,
-                  [item_false] = "false",
-                  [item_null]  = "null" };
-  char *esc_s;  // Used to hold escaped strings.
-  int i = 0;    // Used to index obj/arr items in loops within the switch.
+void json_fail(json_Item *root, json_Item *failed) {
+  Parser parser = { 0 };
+  fail(&parser, root, failed);
+}
+
+const char *json_parse_at(const char *buf, size_t len, long offset,
+                          json_Item *item, json_ParseOptions options) {
+  Parser parser = { .start = buf, .end = buf + len,
+                    .in_situ = options.in_situ, .base = offset };
+  return parse(&parser, item, options);
+}
+
+// json_Output.
+
+// Writes n chars to out's sink unless an earlier write failed.
+static void out_to_sink(json_Output *out, const char *chars, size_t n) {
+  if (n == 0 || out->sink_failed) return;
+  if (!out->sink->write(out->sink->context, chars, n)) out->sink_failed = true;
+}
+
+// The escapes with a letter of their own, indexed by the char they stand for.
+static const char short_escapes[128] = {
+  ['\b'] = 'b', ['\f'] = 'f', ['\n'] = 'n', ['\r'] = 'r', ['\t'] = 't',
+  ['"']  = '"', ['\\'] = '\\'
+};
+
+// Prints a scalar, or the opening of an array or object.
+static void print_scalar_or_opening(json_Output *out, json_Item item,
+                                    int be_terse) {
   switch (item.type) {
     case item_string:
     case item_error:
-      esc_s = escaped_str(item.value.string);
-      array_printf(array, "\"%s\"", esc_s);
-      free(esc_s);
+      json_out_string(out, item.value.string, strlen(item.value.string));
       break;
     case item_true:
+      json_out_literal(out, "true");
+      break;
     case item_false:
+      json_out_literal(out, "false");
+      break;
     case item_null:
-      array_printf(array, "%s", lit[item.type]);
+      json_out_literal(out, "null");
       break;
     case item_number:
-      array_printf(array, "%g", item.value.number);
+      json_out_number(out, item.value.number);
+      break;
+    case item_integer:
+      json_out_integer(out, item.value.integer);
       break;
     case item_array:
-      array_printf(array, item.value.array->count && !be_terse ? "[\n" : "[");
-      array__for(json_Item *, subitem, item.value.array, idx) {
-        array_printf(array, "%s%s", (i++ ? sep : ""), indent);
-        print_item(array, *subitem, indent, be_terse);
-      }
-      if (item.value.array->count && !be_terse) {
-        array_printf(array, "\n%s", outer_indent);
-      }
-      array_printf(array, "]");
+      json_out_char(out, '[');
+      if (item.value.array->count && !be_terse) json_out_char(out, '\n');
       break;
     case item_object:
-      array_printf(array, item.value.object->count && !be_terse ? "{\n" : "{");
-      map__for(pair, item.value.object) {
-        array_printf(array, "%s%s\"%s\":%s", (i++ ? sep : ""),
-                     indent, (char *)pair->key, spc);
-        print_item(array, *(json_Item *)pair->value, indent, be_terse);
+      json_out_char(out, '{');
+      if (item.value.object->count && !be_terse) json_out_char(out, '\n');
+      break;
+  }
+}
+
+// An array or object being printed by print_item.
+typedef struct {
+  json_Item item;
+  int       count;   // The number of subitems printed so far.
+  int       bucket;  // For objects, the iteration state used by map__next.
+  void *    entry;
+} PrintFrame;
+
+// Returns the next subitem of frame->item to print, or NULL when there are no
+// more. For objects, *key is set to the subitem's key.
+static json_Item *next_subitem(PrintFrame *frame, char **key) {
+  if (frame->item.type == item_array) {
+    Array array = frame->item.value.array;
+    if (frame->count == array->count) return NULL;
+    return (json_Item *)array__item_ptr(array, frame->count);
+  }
+  map__key_value *pair = map__next(frame->item.value.object, &frame->bucket,
+                                   &frame->entry);
+  if (pair == NULL) return NULL;
+  *key = (char *)pair->key;
+  return (json_Item *)pair->value;
+}
+
+// Prints what goes before a subitem: a separator unless it's the first, the
+// indent, and for an object's subitem, its key, escaped as strings are.
+static void print_subitem_start(json_Output *out, const char *key,
+                                int is_first, int indent) {
+  int be_terse = !(out->flags & json_pretty);
+  if (!is_first) {
+    json_out_char(out, ',');
+    if (!be_terse) json_out_char(out, '\n');
+  }
+  json_out_indent(out, indent);
+  if (key) {
+    json_out_string(out, key, strlen(key));
+    json_out_char(out, ':');
+    if (!be_terse) json_out_char(out, ' ');
+  }
+}
+
+// Nested arrays and objects are printed with an explicit stack of frames
+// rather than with recursion.
+static void print_item(json_Output *out, json_Item item, int depth) {
+  int be_terse = !(out->flags & json_pretty);
+  Array stack = array__new(8, sizeof(PrintFrame));
+  int indent = be_terse ? 0 : 2 * depth;  // Always 0 when be_terse is true.
+  for (;;) {
+    print_scalar_or_opening(out, item, be_terse);
+    if ((item.type == item_array && item.value.array->count) ||
+        (item.type == item_object && item.value.object->count)) {
+      PrintFrame frame = { .item = item, .count = 0, .bucket = -1 };
+      array__add_item_ptr(stack, &frame);
+      if (!be_terse) indent += 2;
+    } else if (item.type == item_array) {
+      json_out_char(out, ']');
+    } else if (item.type == item_object) {
+      json_out_char(out, '}');
+    }
+
+    // Find the next item to print, closing any finished containers.
+    json_Item *next = NULL;
+    while (stack->count && next == NULL) {
+      PrintFrame *frame = array__item_ptr(stack, stack->count - 1);
+      char *key = NULL;
+      next = next_subitem(frame, &key);
+      if (next) {
+        print_subitem_start(out, frame->item.type == item_object ? key : NULL,
+                            frame->count++ == 0, indent);
+      } else {
+        if (!be_terse) {
+          indent -= 2;
+          json_out_char(out, '\n');
+          json_out_indent(out, indent);
+        }
+        json_out_char(out, frame->item.type == item_array ? ']' : '}');
+        stack->count--;
       }
-      if (item.value.object->count && !be_terse) {
-        array_printf(array, "\n%s", outer_indent);
+    }
+    if (next == NULL) break;
+    item = *next;
+  }
+  array__delete(stack);
+}
+
+char *json_stringify_internal(json_Item item, int flags) {
+  json_Output out = { .buf = malloc(256), .len = 0, .cap = 256,
+                      .can_grow = true, .flags = flags };
+  print_item(&out, item, 0);
+  json_out_char(&out, '\0');
+  return out.buf;
+}
+
+
+// Library-internal output functions.
+
+void json_out_item(json_Output *out, json_Item item, int depth) {
+  print_item(out, item, depth);
+}
+
+void json_out_subitem_start(json_Output *out, const char *key, int is_first,
+                            int depth) {
+  print_subitem_start(out, key, is_first,
+                      (out->flags & json_pretty) ? 2 * depth : 0);
+}
+
+void json_out_overflow(json_Output *out, const char *chars, size_t n) {
+  if (out->can_grow) {
+    while (out->len + n > out->cap) out->cap *= 2;
+    out->buf = realloc(out->buf, out->cap);
+    memcpy(out->buf + out->len, chars, n);
+  } else if (out->sink) {
+    json_out_flush(out);
+    // Chars that would fill the buffer anyway go straight to the sink.
+    if (n >= out->cap) {
+      out_to_sink(out, chars, n);
+      return;
+    }
+    memcpy(out->buf, chars, n);
+  } else if (out->len < out->cap) {
+    memcpy(out->buf + out->len, chars, out->cap - out->len);
+  }
+  out->len += n;
+}
+
+void json_out_indent(json_Output *out, int n) {
+  static const char spaces[] = "                                ";
+  for (; n > 32; n -= 32) json_out_write(out, spaces, 32);
+  json_out_write(out, spaces, n);
+}
+
+// Runs that need no escapes are found 32 or 16 bytes at a time and copied as
+// they are. These runs are plain ASCII, or, with the json_raw_utf8 flag, valid
+// UTF-8 other than quotes, backslashes, and control characters. Other
+// characters are escaped.
+void json_out_string(json_Output *out, const char *s, size_t len) {
+  static const char *hex = "0123456789ABCDEF";
+  const char *(*scan_run)(const char *, const char *) =
+      (out->flags & json_raw_utf8) ? json_scan_string_utf8 : json_scan_ascii;
+  const char *end = s + len;
+  json_out_char(out, '"');
+  while (s < end) {
+    const char *run_end = scan_run(s, end);
+    json_out_write(out, s, run_end - s);
+    s = run_end;
+    if (s == end) break;
+
+    // The raw scan stops at non-ASCII bytes only when they aren't valid UTF-8;
+    // each is replaced.
+    if ((out->flags & json_raw_utf8) && (unsigned char)*s >= 0x80) {
+      json_out_literal(out, "\\uFFFD");
+      s++;
+      continue;
+    }
+
+    int code_pt = decode_code_point(&s, end);
+    if (code_pt < 0x80 && short_escapes[code_pt]) {
+      json_out_char(out, '\\');
+      json_out_char(out, short_escapes[code_pt]);
+    } else if (0x20 <= code_pt && code_pt < 0x80) {
+      json_out_char(out, code_pt);
+    } else {
+      int pts[2] = { code_pt };
+      int num_pts = 1 + split_into_surrogates(code_pt, &pts[0], &pts[1]);
+      for (int i = 0; i < num_pts; ++i) {
+        char esc[6] = { '\\', 'u', hex[pts[i] >> 12], hex[(pts[i] >> 8) & 15],
+                        hex[(pts[i] >> 4) & 15], hex[pts[i] & 15] };
+        json_out_write(out, esc, 6);
       }
-      array_printf(array, "}");
-      break;
+    }
   }
-  if (!be_terse) free(indent);
+  json_out_char(out, '"');
+}
+
+void json_out_number(json_Output *out, double d) {
+  char buf[32];
+  json_out_write(out, buf, json_format_number(buf, d));
 }
 
-static void free_at(void *ptr, void *context) {
-  free(*(void **)ptr);
+void json_out_integer(json_Output *out, int64_t n) {
+  char buf[32];
+  json_out_write(out, buf, json_format_integer(buf, n));
 }
 
-char *json_stringify_internal(json_Item item, int be_terse) {
-  Array str_array = array__new(8, sizeof(char *));
-  str_array->releaser = free_at;
-  print_item(str_array, item, "", be_terse);  // "" = indent
-  char *json_str = array_join(str_array);
-  array__delete(str_array);
-  return json_str;
+void json_out_flush(json_Output *out) {
+  out_to_sink(out, out->buf, out->len);
+  out->len = 0;
 }
 
 
 // Public functions.
 
 char *json_parse(char *json_str, json_Item *item) {
-  // Skip leading whitespace.
-  char *input = json_str + strspn(json_str, " \t\r\n" );
-  input = parse_value(item, input, json_str);
-  if (input) {
-    next_token(input);  // Skip last parsed char and trailing whitespace.
+  json_ParseOptions options = { 0 };
+  return json_parse_with_options(json_str, item, options);
+}
+
+char *json_parse_with_options(char *json_str, json_Item *item,
+                              json_ParseOptions options) {
+  return (char *)json_parse_n_with_options(json_str, strlen(json_str), item,
+                                           options);
+}
+
+const char *json_parse_n(const char *buf, size_t len, json_Item *item) {
+  json_ParseOptions options = { 0 };
+  return json_parse_n_with_options(buf, len, item, options);
+}
+
+const char *json_parse_n_with_options(const char *buf, size_t len,
+                                      json_Item *item,
+                                      json_ParseOptions options) {
+  Parser parser = { .start = buf, .end = buf + len,
+                    .in_situ = options.in_situ };
+  return parse(&parser, item, options);
+}
+
+const char *json_parse_document(const char *buf, size_t len,
+                                json_Document *doc,
+                                json_ParseOptions options) {
+  Arena *arena = arena_new(len);
+  *doc = arena_alloc(sizeof(json_DocumentStruct), arena);
+  (*doc)->arena = arena;
+  Parser parser = { .start = buf, .end = buf + len,
+                    .in_situ = options.in_situ,
+                    .allocator = &arena->allocator };
+  json_Item *root = &(*doc)->root;
+  const char *tail = parse(&parser, root, options);
+
+  // Move any error message into the arena so the document owns everything.
+  if (root->type == item_error) {
+    size_t size = strlen(root->value.string) + 1;
+    char *msg = arena_alloc(size, arena);
+    memcpy(msg, root->value.string, size);
+    free(root->value.string);
+    root->value.string = msg;
+    root->is_borrowed = true;
   }
-  return input;
+  return tail;
+}
+
+void json_document_delete(json_Document doc) {
+  arena_delete((Arena *)doc->arena);
 }
 
 char *json_stringify(json_Item item) {
-  return json_stringify_internal(item, true);   // be_terse = true
+  return json_stringify_internal(item, 0);
 }
 
 char *json_pretty_stringify(json_Item item) {
-  return json_stringify_internal(item, false);  // be_terse = false
+  return json_stringify_internal(item, json_pretty);
+}
+
+char *json_stringify_with_flags(json_Item item, int flags) {
+  return json_stringify_internal(item, flags);
+}
+
+int json_stringify_into(json_Item item, char *buf, size_t cap, size_t *len,
+                        int flags) {
+  json_Output out = { .buf = buf, .len = 0, .cap = cap, .can_grow = false,
+                      .flags = flags };
+  print_item(&out, item, 0);
+  *len = out.len;
+  if (out.len >= cap) return false;
+  buf[out.len] = '\0';
+  return true;
+}
+
+size_t json_stringified_length(json_Item item, int flags) {
+  // A fixed buffer with no room only counts.
+  char none[1];
+  json_Output out = { .buf = none, .len = 0, .cap = 0, .can_grow = false,
+                      .flags = flags };
+  print_item(&out, item, 0);
+  return out.len;
+}
+
+int json_stringify_to(json_Item item, json_Sink sink, int flags) {
+  char buf[json_sink_buffer_size];
+  json_Output out = { .buf = buf, .len = 0, .cap = json_sink_buffer_size,
+                      .can_grow = false, .sink = &sink, .flags = flags };
+  print_item(&out, item, 0);
+  json_out_flush(&out);
+  return !out.sink_failed;
+}
+
+static int write_to_file(void *context, const char *chars, size_t len) {
+  return fwrite(chars, 1, len, (FILE *)context) == len;
+}
+
+static int write_to_fd(void *context, const char *chars, size_t len) {
+  int fd = (int)(intptr_t)context;
+  while (len) {
+    ssize_t n = write(fd, chars, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    chars += n;
+    len   -= n;
+  }
+  return true;
+}
+
+json_Sink json_file_sink(FILE *file) {
+  return (json_Sink){ .write = write_to_file, .context = file };
+}
+
+json_Sink json_fd_sink(int fd) {
+  return (json_Sink){ .write = write_to_fd, .context = (void *)(intptr_t)fd };
 }
 
 void json_release_item(void *item_ptr) {
-  json_Item *item = (json_Item *)item_ptr;
-  if ((item->type == item_string || item->type == item_error) &&
-      item->value.string != NULL) {
-    free(item->value.string);
+  json_Item item = *(json_Item *)item_ptr;
+  Array stack = NULL;  // Containers waiting to be released.
+  for (;;) {
+    release_item_shallowly(item, &stack);
+    if (stack == NULL || stack->count == 0) break;
+    item = array__item_val(stack, --stack->count, json_Item);
   }
-  if (item->type == item_object) map__delete(item->value.object);
-  if (item->type == item_array) array__delete(item->value.array);
+  if (stack) array__delete(stack);
 }
 
 void json_free_item(void *item) {
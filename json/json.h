@@ -10,17 +10,25 @@
 
 #include "../cstructs/cstructs.h"
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 typedef union {
-  char * string;
-  long   boolean;
-  Array  array;
-  Map    object;
-  double number;
+  char *  string;
+  long    boolean;
+  Array   array;
+  Map     object;
+  double  number;
+  int64_t integer;
 } json_ItemValue;
 
+// Parsed numbers without a fraction or exponent that fit in an int64_t have
+// type item_integer; all other numbers have type item_number.
 typedef enum {
   item_string,
   item_number,
+  item_integer,
   item_object,
   item_array,
   item_true,
@@ -31,21 +39,131 @@ typedef enum {
 
 typedef struct {
   json_ItemType type;
+  // If nonzero, value.string points into memory this item doesn't own, such as
+  // the input of an in-situ parse, and releasing the item won't free it.
+  // Items built by hand should set this to 0; initializers do so implicitly.
+  int is_borrowed;
   json_ItemValue value;
 } json_Item;
 
+// Options for json_parse_with_options. A zero-initialized struct gives the
+// same behavior as json_parse.
+typedef struct {
+  // If nonzero, the input is first scanned 64 bytes at a time, using SIMD when
+  // available, into an index of structural characters. The parser then jumps
+  // over whitespace using the index. This pays off on large inputs.
+  int use_index;
+
+  // If nonzero, the input is overwritten as it's parsed: strings and object
+  // keys are decoded in place and null-terminated where their closing quotes
+  // were. The parsed strings and keys point into the input, so it must remain
+  // valid and unchanged until the item is released. The input to
+  // json_parse_n_with_options must be writable in this mode.
+  int in_situ;
+
+  // The most arrays and objects that may be nested within each other; deeper
+  // input is an error. Zero means json_max_depth.
+  int max_depth;
+
+  // If nonzero, object keys are pointers into a global pool of interned
+  // strings (see jsonintern.h) rather than copies, and objects use
+  // json_interned_hash and json_interned_eq. Keys then take no memory per
+  // document and are compared by pointer. The pool is never freed, so this is
+  // only for input with a bounded set of distinct keys. This takes precedence
+  // over in_situ for keys.
+  int intern_keys;
+} json_ParseOptions;
+
+#define json_max_depth 1024
+
+// A document is a parsed item along with an arena that holds all of its
+// memory: its containers, strings, keys, and map internals. Deleting the
+// document frees everything at once instead of item by item. Items within a
+// document must not be released, and shouldn't be modified in ways that
+// allocate or free memory.
+typedef struct {
+  json_Item root;   // The parsed item.
+  void *    arena;  // Internal to json.c.
+} json_DocumentStruct;
+
+typedef json_DocumentStruct *json_Document;
+
+// A destination for json_stringify_to. The write function is called with the
+// output in order, a chunk at a time, along with context; it returns false if
+// the chunk couldn't be written.
+typedef struct {
+  int (*write)(void *context, const char *chars, size_t len);
+  void *context;
+} json_Sink;
+
 // Main functions to parse or jsonify.
 
 // Returns the tail of json_str after the first valid json object.
 // On error, *item has type item_error with a message in value.string.
 char *json_parse(char *json_str, json_Item *item);
 
+// This is json_parse with the behavior adjusted by options.
+char *json_parse_with_options(char *json_str, json_Item *item,
+                              json_ParseOptions options);
+
+// These parse the len bytes at buf, which don't need a terminating null.
+// Nothing at or after buf + len is read; the input ends as if a null were
+// there. The return value is like json_parse's, but never beyond buf + len.
+const char *json_parse_n(const char *buf, size_t len, json_Item *item);
+const char *json_parse_n_with_options(const char *buf, size_t len,
+                                      json_Item *item,
+                                      json_ParseOptions options);
+
+// Parses len bytes at buf as json_parse_n_with_options does, into the root of
+// a new document at *doc. Parse errors are reported in (*doc)->root, and the
+// document always needs to be deleted.
+const char *json_parse_document(const char *buf, size_t len,
+                                json_Document *doc,
+                                json_ParseOptions options);
+
+void json_document_delete(json_Document doc);
+
 // Terse output with no extra whitespace.
 char *json_stringify(json_Item item);
 
 // Human-friendly output with more whitespace.
 char *json_pretty_stringify(json_Item item);
 
+// Flags for the stringify functions below, which may be combined with |. Zero
+// gives the output of json_stringify.
+#define json_pretty   1  // Indent as json_pretty_stringify does.
+#define json_raw_utf8 2  // Write non-ASCII characters as UTF-8 rather than as
+                         // \u escapes. Only quotes, backslashes, and control
+                         // characters are escaped; bytes that aren't valid
+                         // UTF-8 become \uFFFD.
+
+// This is json_stringify with the output adjusted by flags.
+char *json_stringify_with_flags(json_Item item, int flags);
+
+// Writes the output of json_stringify_with_flags into buf, which has room for
+// cap chars, rather than into a new string, and sets *len to the full output
+// length, not counting the final null. Returns true if the output and a null
+// fit; otherwise the contents of buf are unspecified, and the call can be
+// repeated with a buffer of at least *len + 1 chars. A single buffer can be
+// reused for many items this way.
+int json_stringify_into(json_Item item, char *buf, size_t cap, size_t *len,
+                        int flags);
+
+// Returns the length of the output of json_stringify_with_flags, not counting
+// the final null, without writing it anywhere or allocating memory. A buffer of
+// this length plus one can then be given to json_stringify_into.
+size_t json_stringified_length(json_Item item, int flags);
+
+// Writes the output of json_stringify_with_flags to sink through a small
+// fixed-size buffer, which is passed on each time it fills, so memory use
+// doesn't grow with the size of the output. Returns false if a write to the
+// sink failed, in which case nothing more was sent to it.
+int json_stringify_to(json_Item item, json_Sink sink, int flags);
+
+// Sinks that write with fwrite to a FILE * or with write to a file descriptor.
+json_Sink json_file_sink(FILE *file);
+json_Sink json_fd_sink(int fd);
+
 // Helper function to deallocate items.
 // release_item is designed for Array; free_item is designed for Map.
 // They accept a void * type to be a valid releaser for a Map/Array.
@@ -61,5 +179,13 @@ void json_free_item(void *item);
 int json_str_hash(void *str_void_ptr);
 int json_str_eq(void *str_void_ptr1, void *str_void_ptr2);
 
+#include "jsonbatch.h"
+#include "jsonevents.h"
+#include "jsonintern.h"
+#include "jsonondemand.h"
+#include "jsonpush.h"
+#include "jsontape.h"
 #include "jsonutil.h"
+#include "jsonvalidate.h"
+#include "jsonwriter.h"
 
@@ -0,0 +1,448 @@
+// jsonbatch.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The input is cut at newlines into batches of about batch_size bytes. Worker
+// threads take batches in turn, so a thread that finishes early takes on more
+// of the work, and each batch's items go into their own array. The arrays are
+// then joined in input order.
+//
+// A big top-level array is cut the same way, but at guesses of where one
+// element ends and the next begins: places that look like the separator
+// between its first two elements. A batch's items are used only once parsing
+// from the start of the array has reached the batch's start, which proves the
+// guess was right. Between batches, and wherever a guess was wrong, elements
+// are parsed one at a time in the calling thread.
+//
+// A big top-level array or object is stringified by cutting its subitems
+// into runs of about batch_size bytes of output, judged from a sample of
+// them. Each run is written to a buffer of its own, and the buffers are joined
+// in order.
+//
+
+#include "jsonbatch.h"
+
+#include "jsonoutput.h"
+#include "jsonparse.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define true  1
+#define false 0
+
+// Batches are big enough that taking one is cheap next to parsing it, and
+// small enough to spread the work evenly.
+#define batch_size ((size_t)1 << 16)
+
+#define is_space(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+typedef struct {
+  const char *start;
+  const char *end;
+  Array       items;
+  const char *parsed_end;  // For array batches, the start of the first
+                           // element not in items, or the closing ']'.
+  int         is_closed;   // True if parsed_end is the array's closing ']'.
+  int         first;       // For stringify batches, the subitems in
+  int         last;        // [first, last), and their output.
+  json_Output out;
+} Batch;
+
+typedef struct Work Work;
+
+struct Work {
+  const char *      buf;
+  const char *      buf_end;
+  json_ParseOptions options;
+  json_Item **      subitems;  // For stringifying, the subitems of the
+  char **           keys;      // container, their keys if it's an object,
+  int               flags;     // and the stringify flags.
+  Batch *           batches;
+  int               num_batches;
+  void (*run)(Work *work, Batch *batch);  // Does one batch.
+  int               next;   // The next batch to be taken.
+  pthread_mutex_t   mutex;  // Guards next.
+};
+
+static void parse_batch(Work *work, Batch *batch) {
+  batch->items = array__new(64, sizeof(json_Item));
+  for (const char *line = batch->start; line < batch->end;) {
+    const char *line_end = memchr(line, '\n', batch->end - line);
+    if (line_end == NULL) line_end = batch->end;
+    const char *s = line;
+    while (s) {
+      while (s < line_end && is_space(*s)) s++;
+      if (s == line_end) break;
+      json_Item *item = (json_Item *)array__new_ptr(batch->items);
+      s = json_parse_at(s, line_end - s, s - work->buf, item, work->options);
+    }
+    line = line_end + 1;
+  }
+}
+
+static void *run_worker(void *work_ptr) {
+  Work *work = (Work *)work_ptr;
+  for (;;) {
+    pthread_mutex_lock(&work->mutex);
+    int i = work->next++;
+    pthread_mutex_unlock(&work->mutex);
+    if (i >= work->num_batches) return NULL;
+    work->run(work, &work->batches[i]);
+  }
+}
+
+// Cuts buf into batches that end just after a newline, or at the end of buf.
+static Array split_into_batches(const char *buf, size_t len) {
+  Array batches = array__new(len / batch_size + 1, sizeof(Batch));
+  const char *start = buf, *end = buf + len;
+  while (start < end) {
+    const char *batch_end = end;
+    if ((size_t)(end - start) > batch_size) {
+      batch_end = memchr(start + batch_size, '\n',
+                         end - (start + batch_size));
+      batch_end = (batch_end ? batch_end + 1 : end);
+    }
+    Batch *batch = (Batch *)array__new_ptr(batches);
+    batch->start = start;
+    batch->end = batch_end;
+    start = batch_end;
+  }
+  return batches;
+}
+
+// Runs all of work's batches with num_threads threads, including this one.
+static void run_workers(Work *work, int num_threads) {
+  pthread_mutex_init(&work->mutex, NULL);
+  if (num_threads > work->num_batches) num_threads = work->num_batches;
+  pthread_t *threads = malloc(sizeof(pthread_t) * (num_threads + 1));
+  int num_started = 0;
+  for (int i = 1; i < num_threads; ++i) {
+    if (pthread_create(&threads[num_started], NULL, run_worker, work)) break;
+    num_started++;
+  }
+  run_worker(work);
+  for (int i = 0; i < num_started; ++i) pthread_join(threads[i], NULL);
+  free(threads);
+  pthread_mutex_destroy(&work->mutex);
+}
+
+
+// Array parsing.
+
+// Array batches hold at least this many bytes, so that small arrays are
+// parsed in one thread.
+#define min_array_batch batch_size
+
+// Parses array elements from the start of batch until one would run past its
+// end. The batch is done if parsed_end reaches its end.
+static void parse_array_batch(Work *work, Batch *batch) {
+  batch->items = array__new(64, sizeof(json_Item));
+  const char *s = batch->parsed_end = batch->start;
+  batch->is_closed = false;
+  while (s < batch->end) {
+    json_Item item;
+    const char *tail = json_parse_at(s, batch->end - s, s - work->buf, &item,
+                                     work->options);
+    if (tail == NULL || tail == batch->end || (*tail != ',' && *tail != ']')) {
+      json_release_item(&item);
+      return;
+    }
+    array__add_item_val(batch->items, item);
+    if (*tail == ']') {
+      batch->parsed_end = tail;
+      batch->is_closed = true;
+      return;
+    }
+    s = tail + 1;
+    while (s < batch->end && is_space(*s)) s++;
+    batch->parsed_end = s;
+  }
+}
+
+// The most chars that the first two elements share at their starts to be
+// included in the separator pattern.
+#define max_shared_prefix 16
+
+// Finds a pattern for recognizing element starts: the text between the
+// array's first two elements, after the first one's last char if that's a
+// bracket or quote, and followed by the chars that both elements start with,
+// such as `{"id":` for an array of records. Returns false if there aren't two
+// elements.
+static int find_separator(Work *work, const char *first, const char **sep,
+                          size_t *sep_len) {
+  json_Item item;
+  const char *tail = json_parse_at(first, work->buf_end - first,
+                                   first - work->buf, &item, work->options);
+  json_release_item(&item);
+  if (tail == NULL || tail == work->buf_end || *tail != ',') return false;
+  const char *second = tail + 1;
+  while (second < work->buf_end && is_space(*second)) second++;
+  size_t shared = 0;
+  while (shared < max_shared_prefix && second + shared < work->buf_end &&
+         first[shared] == second[shared]) {
+    shared++;
+  }
+  const char *sep_start = tail;
+  while (is_space(sep_start[-1])) sep_start--;
+  if (strchr("}]\"", sep_start[-1])) sep_start--;
+  *sep = sep_start;
+  *sep_len = second + shared - sep_start;
+  return true;
+}
+
+// Cuts the elements starting at first into batches at guessed element starts.
+static Array split_array(Work *work, const char *first, int num_threads) {
+  Array batches = array__new(16, sizeof(Batch));
+  const char *sep;
+  size_t sep_len;
+  if (!find_separator(work, first, &sep, &sep_len)) return batches;
+  size_t target = (work->buf_end - first) / (4 * num_threads);
+  if (target < min_array_batch) target = min_array_batch;
+
+  const char *start = first, *end = work->buf_end;
+  while (start < end) {
+    const char *batch_end = end;
+    if ((size_t)(end - start) > 2 * target) {
+      const char *match = memmem(start + target, end - (start + target), sep,
+                                 sep_len);
+      if (match) {
+        batch_end = (const char *)memchr(match, ',', sep_len) + 1;
+        while (batch_end < end && is_space(*batch_end)) batch_end++;
+      }
+    }
+    Batch *batch = (Batch *)array__new_ptr(batches);
+    batch->start = start;
+    batch->end = batch_end;
+    start = batch_end;
+  }
+  return batches;
+}
+
+// Parses one element at *s, in this thread, into array. Returns true and
+// moves *s to the next element or, setting *is_closed, to the closing ']'.
+// Otherwise returns false with an error item in *error.
+static int parse_element(Work *work, const char **s, Array array,
+                         int *is_closed, json_Item *error) {
+  json_Item *item = (json_Item *)array__new_ptr(array);
+  const char *tail = json_parse_at(*s, work->buf_end - *s, *s - work->buf,
+                                   item, work->options);
+  if (tail == NULL) {
+    *error = *item;
+    array->count--;
+    return false;
+  }
+  if (tail == work->buf_end || (*tail != ',' && *tail != ']')) {
+    json_set_error(error, "expected ']' or ','", tail - work->buf);
+    return false;
+  }
+  *is_closed = (*tail == ']');
+  if (*tail == ',') {
+    tail++;
+    while (tail < work->buf_end && is_space(*tail)) tail++;
+  }
+  *s = tail;
+  return true;
+}
+
+// Parses the elements from first on into array, joining batches with
+// elements parsed here. Returns a pointer to the closing ']', or NULL with an
+// error item in *error.
+static const char *join_array(Work *work, const char *first, Array array,
+                              json_Item *error) {
+  const char *s = first;
+  int b = 0, is_closed = (s < work->buf_end && *s == ']');
+  while (!is_closed) {
+    while (b < work->num_batches && work->batches[b].start < s) b++;
+    Batch *batch = (b < work->num_batches ? &work->batches[b] : NULL);
+    if (batch && batch->start == s && batch->items->count) {
+      // The batch's guessed start is a real element start, so its items are
+      // the elements that follow.
+      int count = array->count;
+      array__add_zeroed_items(array, batch->items->count);
+      memcpy(array__item_ptr(array, count), batch->items->items,
+             batch->items->count * sizeof(json_Item));
+      batch->items->count = 0;
+      s = batch->parsed_end;
+      is_closed = batch->is_closed;
+      continue;
+    }
+    if (!parse_element(work, &s, array, &is_closed, error)) return NULL;
+  }
+  return s;
+}
+
+
+// Stringifying.
+
+// Containers with fewer subitems than this are stringified in one thread.
+#define min_parallel_subitems 64
+
+// The number of subitems whose output lengths are measured to judge the rest.
+#define num_samples 16
+
+static void stringify_batch(Work *work, Batch *batch) {
+  batch->out = (json_Output){ .buf = malloc(batch_size), .len = 0,
+                              .cap = batch_size, .can_grow = true,
+                              .flags = work->flags };
+  for (int i = batch->first; i < batch->last; ++i) {
+    json_out_subitem_start(&batch->out, work->keys ? work->keys[i] : NULL,
+                           i == 0, 1);
+    json_out_item(&batch->out, *work->subitems[i], 1);
+  }
+}
+
+// Sets up work->subitems, and work->keys for an object, in the order that
+// json_stringify prints them.
+static void list_subitems(Work *work, json_Item item) {
+  if (item.type == item_array) {
+    Array array = item.value.array;
+    work->subitems = malloc(array->count * sizeof(json_Item *));
+    array__for(json_Item *, subitem, array, i) work->subitems[i] = subitem;
+    return;
+  }
+  Map obj = item.value.object;
+  work->subitems = malloc(obj->count * sizeof(json_Item *));
+  work->keys = malloc(obj->count * sizeof(char *));
+  int i = 0;
+  map__for(pair, obj) {
+    work->keys[i] = (char *)pair->key;
+    work->subitems[i++] = (json_Item *)pair->value;
+  }
+}
+
+// Cuts the count subitems into runs of about batch_size bytes of output, as
+// judged by the average length of a few evenly spaced ones.
+static Array split_subitems(Work *work, int count) {
+  size_t sampled_len = 0;
+  for (int s = 0; s < num_samples; ++s) {
+    int i = (int)((int64_t)s * count / num_samples);
+    sampled_len += json_stringified_length(*work->subitems[i], work->flags);
+    if (work->keys) sampled_len += strlen(work->keys[i]) + 4;
+  }
+  size_t per_batch = batch_size * num_samples / (sampled_len + 1);
+  if (per_batch < 1) per_batch = 1;
+  Array batches = array__new(count / per_batch + 1, sizeof(Batch));
+  for (size_t first = 0; first < (size_t)count; first += per_batch) {
+    Batch *batch = (Batch *)array__new_ptr(batches);
+    batch->first = (int)first;
+    batch->last = (int)(first + per_batch < (size_t)count ? first + per_batch
+                                                          : (size_t)count);
+  }
+  return batches;
+}
+
+// Public functions.
+
+Array json_parse_batch(const char *buf, size_t len, json_ParseOptions options,
+                       int num_threads) {
+  options.in_situ = false;  // buf is const.
+  Array batches = split_into_batches(buf, len);
+  Work work = { .buf = buf, .buf_end = buf + len, .options = options,
+                .batches = (Batch *)batches->items,
+                .num_batches = batches->count, .run = parse_batch,
+                .next = 0 };
+  if (num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  run_workers(&work, num_threads);
+
+  // Join the batches' items in order.
+  int num_items = 0;
+  array__for(Batch *, batch, batches, i) num_items += batch->items->count;
+  Array items = array__new(num_items ? num_items : 1, sizeof(json_Item));
+  items->releaser = json_item_releaser;
+  array__for(Batch *, batch, batches, i) {
+    memcpy((json_Item *)items->items + items->count, batch->items->items,
+           batch->items->count * sizeof(json_Item));
+    items->count += batch->items->count;
+    array__delete(batch->items);
+  }
+  array__delete(batches);
+  return items;
+}
+
+char *json_stringify_parallel(json_Item item, int flags, int num_threads) {
+  if (num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int count = (item.type == item_array  ? item.value.array->count  :
+               item.type == item_object ? item.value.object->count : 0);
+  if (num_threads < 2 || count < min_parallel_subitems) {
+    return json_stringify_with_flags(item, flags);
+  }
+
+  Work work = { .flags = flags, .run = stringify_batch, .next = 0 };
+  list_subitems(&work, item);
+  Array batches = split_subitems(&work, count);
+  work.batches = (Batch *)batches->items;
+  work.num_batches = batches->count;
+  char *str;
+  if (work.num_batches < 2) {
+    str = json_stringify_with_flags(item, flags);
+  } else {
+    run_workers(&work, num_threads);
+
+    // Join the batches' output in order, inside the brackets.
+    int be_terse = !(flags & json_pretty);
+    size_t len = 0;
+    array__for(Batch *, batch, batches, i) len += batch->out.len;
+    str = malloc(len + 5);
+    char *s = str;
+    *s++ = (item.type == item_array ? '[' : '{');
+    if (!be_terse) *s++ = '\n';
+    array__for(Batch *, batch, batches, i) {
+      memcpy(s, batch->out.buf, batch->out.len);
+      s += batch->out.len;
+      free(batch->out.buf);
+    }
+    if (!be_terse) *s++ = '\n';
+    *s++ = (item.type == item_array ? ']' : '}');
+    *s = '\0';
+  }
+  array__delete(batches);
+  free(work.subitems);
+  free(work.keys);
+  return str;
+}
+
+const char *json_parse_array(const char *buf, size_t len, json_Item *item,
+                             json_ParseOptions options, int num_threads) {
+  const char *end = buf + len, *s = buf;
+  while (s < end && is_space(*s)) s++;
+  if (num_threads <= 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+  // Elements are parsed one level down, and parallel in-situ parses could
+  // decode strings over a wrong guess's neighbors.
+  int max_depth = (options.max_depth ? options.max_depth : json_max_depth);
+  if (s == end || *s != '[' || num_threads < 2 || options.in_situ ||
+      max_depth < 2 || len < 2 * min_array_batch) {
+    return json_parse_at(buf, len, 0, item, options);
+  }
+  const char *first = s + 1;
+  while (first < end && is_space(*first)) first++;
+
+  Work work = { .buf = buf, .buf_end = end, .options = options,
+                .run = parse_array_batch, .next = 0 };
+  work.options.max_depth = max_depth - 1;
+  work.options.use_index = false;  // Indexing each element isn't worth it.
+  Array batches = split_array(&work, first, num_threads);
+  work.batches = (Batch *)batches->items;
+  work.num_batches = batches->count;
+  run_workers(&work, num_threads);
+
+  json_new_container(item, '[');
+  json_Item error;
+  s = join_array(&work, first, item->value.array, &error);
+  array__for(Batch *, batch, batches, i) {
+    batch->items->releaser = json_item_releaser;  // Drop any unused items.
+    array__delete(batch->items);
+  }
+  array__delete(batches);
+  if (s == NULL) {
+    json_release_item(item);
+    *item = error;
+    return NULL;
+  }
+  s++;
+  while (s < end && is_space(*s)) s++;
+  return s;
+}
@@ -0,0 +1,48 @@
+// jsonbatch.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Parses many json values at once, such as the records in a json lines
+// (NDJSON) file or one huge array, using several threads. Big arrays and
+// objects can be stringified with several threads as well.
+//
+// Example:
+//
+//   json_ParseOptions options = { 0 };
+//   Array items = json_parse_batch(buf, len, options, 0);
+//   array__for(json_Item *, item, items, i) {
+//     if (item->type == item_error) printf("%s\n", item->value.string);
+//   }
+//   array__delete(items);  // This releases the items as well.
+//
+
+#pragma once
+
+#include "json.h"
+
+// Parses every value in buf[0, len), where each line holds zero or more whole
+// values separated by whitespace. Returns an Array of json_Item's in the order
+// the values appear. An error ends its line: the rest of that line gives a
+// single error item, and parsing picks up on the next line. Error indexes are
+// counted from the start of buf.
+//
+// Lines are divided up among num_threads threads, or one per core when
+// num_threads is 0; small inputs are parsed without extra threads. The
+// options apply to each value, except in_situ: buf is left as is and the
+// items' strings are always copies.
+Array json_parse_batch(const char *buf, size_t len, json_ParseOptions options,
+                       int num_threads);
+
+// Parses buf[0, len) as json_parse_n_with_options does, but parses the
+// elements of a top-level array with num_threads threads, or one per core when
+// num_threads is 0. The result is identical to a single-threaded parse,
+// including any error. Small arrays, other values, and in-situ parses use one
+// thread.
+const char *json_parse_array(const char *buf, size_t len, json_Item *item,
+                             json_ParseOptions options, int num_threads);
+
+// Returns json_stringify_with_flags(item, flags), stringifying the subitems
+// of a top-level array or object with num_threads threads, or one per core
+// when num_threads is 0. The output is identical to a single-threaded
+// stringify. Small arrays and objects, and other values, use one thread.
+char *json_stringify_parallel(json_Item item, int flags, int num_threads);
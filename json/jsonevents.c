@@ -0,0 +1,173 @@
+// jsonevents.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The event parser takes the steps of json.c's parser with a json_Tokenizer,
+// so it gives the same error messages, but calls the handler instead of
+// building items.
+//
+
+#include "jsonevents.h"
+
+#include "jsonnum.h"
+#include "jsonparse.h"
+#include "jsonscan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+typedef struct {
+  const char *              start;    // The beginning of the input.
+  const char *              end;      // Just past the end of the input.
+  const json_EventHandler * handler;
+  void *                    context;
+  Array                     scratch;  // Decoded escaped strings, as chars.
+  json_Item *               error;    // Where to put the error, or NULL.
+} EventParser;
+
+// The macros below expect an EventParser *p to be in scope.
+
+#define index_of(input) ((long)((input) - p->start))
+
+#define peek(input) ((input) < p->end ? *(input) : '\0')
+
+// Calls the handler's fn, if it has one, with the parenthesized args; returns
+// NULL from the caller if fn asks to stop at input.
+#define emit(input, fn, args) \
+  if (p->handler->fn && !p->handler->fn args) { \
+    return fail(p, "stopped by handler", index_of(input)); \
+  }
+
+// Records an error; returns NULL.
+static const char *fail(EventParser *p, char *msg, long index) {
+  if (p->error) json_set_error(p->error, msg, index);
+  return NULL;
+}
+
+// Finds the string at input and calls the handler's key or string function
+// with it, according to is_key. At the end, input points to the closing
+// quote.
+static const char *emit_string(EventParser *p, const char *input,
+                               int is_key) {
+  const char *start = input + 1;
+  const char *run_end = json_scan_string_utf8(start, p->end);
+  const char *str = start;
+  size_t len = run_end - start;
+  if (run_end == p->end || *run_end != '"') {
+    // Slow path: the string has escapes or control characters.
+    p->scratch->count = 0;
+    json_Item error;
+    run_end = json_decode_string(input, p->end, index_of(input), p->scratch,
+                                 &error);
+    if (run_end == NULL) {
+      if (p->error) {
+        *p->error = error;
+      } else {
+        json_release_item(&error);
+      }
+      return NULL;
+    }
+    str = p->scratch->items;
+    len = p->scratch->count;
+  }
+  if (is_key) {
+    emit(input, key, (p->context, str, len));
+  } else {
+    emit(input, string, (p->context, str, len));
+  }
+  return run_end;
+}
+
+// Handles a number, string, or literal. At the end, input points to its last
+// character.
+static const char *emit_scalar(EventParser *p, const char *input) {
+  char c = peek(input);
+
+  if (c == '-' || ('0' <= c && c <= '9')) {
+    json_Item item;
+    const char *end;
+    char *msg = json_parse_number(input, p->end, &item, &end);
+    if (msg) return fail(p, msg, index_of(end));
+    if (item.type == item_integer && p->handler->integer) {
+      emit(input, integer, (p->context, item.value.integer));
+    } else if (item.type == item_integer) {
+      emit(input, number, (p->context, (double)item.value.integer));
+    } else {
+      emit(input, number, (p->context, item.value.number));
+    }
+    return end - 1;
+  }
+
+  if (c == '"') return emit_string(p, input, false);
+
+  json_ItemType type;
+  char *msg;
+  const char *last = json_parse_literal(input, p->end, &type, &msg);
+  if (last == NULL) return fail(p, msg, index_of(input));
+  emit(input, literal, (p->context, type));
+  return last;
+}
+
+// Calls the handler for each step through the value that t reads. Returns a
+// pointer just past the value and any trailing whitespace.
+static const char *emit_value(EventParser *p, json_Tokenizer *t) {
+  for (;;) {
+    const char *last;
+    switch (json_next_token(t)) {
+      case json_token_open:
+        if (*t->input == '[') {
+          emit(t->input, start_array, (p->context));
+        } else {
+          emit(t->input, start_object, (p->context));
+        }
+        break;
+      case json_token_close:
+        if (*t->input == ']') {
+          emit(t->input, end_array, (p->context));
+        } else {
+          emit(t->input, end_object, (p->context));
+        }
+        break;
+      case json_token_key:
+        last = emit_string(p, t->input, true);
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_scalar:
+        last = emit_scalar(p, t->input);
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_done:
+        return t->input;
+      default:
+        return fail(p, t->error, index_of(t->input));
+    }
+  }
+}
+
+
+// Public functions.
+
+const char *json_parse_events(const char *buf, size_t len,
+                              const json_EventHandler *handler, void *context,
+                              json_ParseOptions options, json_Item *error) {
+  EventParser parser = {
+    .start   = buf,
+    .end     = buf + len,
+    .handler = handler,
+    .context = context,
+    .scratch = array__new(64, sizeof(char)),
+    .error   = error
+  };
+  json_Tokenizer tokenizer;
+  json_tokenizer_init(&tokenizer, buf, len, options.max_depth);
+  const char *input = emit_value(&parser, &tokenizer);
+  json_tokenizer_end(&tokenizer);
+  array__delete(parser.scratch);
+  return input;
+}
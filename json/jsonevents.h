@@ -0,0 +1,61 @@
+// jsonevents.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// An event-driven parser. Instead of building items, it calls a handler
+// function for each token as it's read, so aggregating or forwarding values
+// takes memory only for the nesting depth and the longest escaped string.
+//
+// Example:
+//
+//   int add(void *context, double number) {
+//     *(double *)context += number;
+//     return true;
+//   }
+//
+//   json_EventHandler handler = { .number = add };
+//   double sum = 0;
+//   json_Item error;
+//   if (json_parse_events(buf, len, &handler, &sum, options, &error) == NULL) {
+//     printf("%s\n", error.value.string);
+//     json_release_item(&error);
+//   }
+//
+
+#pragma once
+
+#include "json.h"
+
+// Each function gets the context given to json_parse_events, and returns
+// false to stop parsing or true to go on. Any of them may be NULL to skip
+// those events.
+//
+// Strings and keys are given as views of len chars which are valid only for
+// the duration of the call. They're usually within the input, and so aren't
+// null-terminated; escaped strings are decoded into a scratch buffer first.
+typedef struct {
+  int (*start_object)(void *context);
+  int (*end_object)  (void *context);
+  int (*start_array) (void *context);
+  int (*end_array)   (void *context);
+  int (*key)         (void *context, const char *str, size_t len);
+  int (*string)      (void *context, const char *str, size_t len);
+  int (*number)      (void *context, double number);
+
+  // Integers go to number, as doubles, when this is NULL.
+  int (*integer)     (void *context, int64_t integer);
+
+  // This is called for true, false, and null with item_true, item_false, or
+  // item_null.
+  int (*literal)     (void *context, json_ItemType type);
+} json_EventHandler;
+
+// Parses buf[0, len), calling the handler's functions in input order, and
+// returns the tail as json_parse_n does. Events for the valid start of the
+// input come before any error is found. On error, or when a handler function
+// returns false, NULL is returned and, if error isn't NULL, it's made an error
+// item to be released by the caller; stopping gives the error "stopped by
+// handler". Of the parse options, only max_depth applies.
+const char *json_parse_events(const char *buf, size_t len,
+                              const json_EventHandler *handler, void *context,
+                              json_ParseOptions options, json_Item *error);
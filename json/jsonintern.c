@@ -0,0 +1,188 @@
+// jsonintern.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Interned strings are carved out of a few big chunks, each after a header
+// with its hash and length. A pointer lies within a chunk exactly when it's
+// interned, which lets the hash and equality functions treat other strings
+// normally. The chunks are found through a hash table guarded by a
+// reader-writer lock, so lookups of keys that are already interned, which is
+// nearly all of them, can run in parallel.
+//
+
+#include "jsonintern.h"
+
+#include "jsonparse.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+typedef struct {
+  int      hash;  // The same value json_str_hash gives.
+  uint32_t len;
+  char     str[];
+} Key;
+
+#define key_of(s) ((Key *)((char *)(s) - offsetof(Key, str)))
+
+typedef struct {
+  char *start;
+  char *end;
+} Chunk;
+
+// Chunks double in size, so there are never many of them.
+#define max_chunks       48
+#define first_chunk_size ((size_t)1 << 16)
+
+// The pool. Everything but num_chunks is guarded by lock. Chunks are only
+// added, and num_chunks is updated after a new chunk is in place, so a chunk
+// can be checked without the lock.
+static pthread_rwlock_t lock = PTHREAD_RWLOCK_INITIALIZER;
+static Chunk  chunks[max_chunks];
+static int    num_chunks = 0;
+static char * next_free = NULL;  // The next free byte in the newest chunk.
+static Key ** table = NULL;      // Open addressing; NULL entries are free.
+static size_t table_size = 0;    // A power of two.
+static size_t num_keys = 0;
+
+// This gives the same value as json_str_hash, but without signed overflow.
+static int hash_n(const char *str, size_t len) {
+  unsigned int h = (len ? (unsigned int)str[0] : 0);
+  for (size_t i = 0; i < len; ++i) h = h * 84207u + (unsigned int)str[i];
+  return (int)h;
+}
+
+static size_t table_index(int hash) {
+  unsigned int h = (unsigned int)hash;
+  return (h ^ (h >> 16)) & (table_size - 1);
+}
+
+static int is_interned(const char *str) {
+  int n = __atomic_load_n(&num_chunks, __ATOMIC_ACQUIRE);
+  for (int i = n - 1; i >= 0; --i) {
+    if ((uintptr_t)chunks[i].start <= (uintptr_t)str &&
+        (uintptr_t)str < (uintptr_t)chunks[i].end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Expects the lock to be held.
+static Key *find(const char *str, size_t len, int hash) {
+  if (table == NULL) return NULL;
+  for (size_t i = table_index(hash);; i = (i + 1) & (table_size - 1)) {
+    Key *key = table[i];
+    if (key == NULL) return NULL;
+    if (key->hash == hash && key->len == len &&
+        memcmp(key->str, str, len) == 0) {
+      return key;
+    }
+  }
+}
+
+// Expects the write lock to be held.
+static Key *alloc_key(size_t len) {
+  size_t size = (offsetof(Key, str) + len + 1 + sizeof(int) - 1) &
+                ~(sizeof(int) - 1);
+  Chunk *chunk = num_chunks ? &chunks[num_chunks - 1] : NULL;
+  if (chunk == NULL || (size_t)(chunk->end - next_free) < size) {
+    size_t chunk_size = first_chunk_size << num_chunks;
+    if (chunk_size < size) chunk_size = size;
+    chunk = &chunks[num_chunks];
+    chunk->start = next_free = malloc(chunk_size);
+    chunk->end = chunk->start + chunk_size;
+    __atomic_store_n(&num_chunks, num_chunks + 1, __ATOMIC_RELEASE);
+  }
+  Key *key = (Key *)next_free;
+  next_free += size;
+  return key;
+}
+
+// Expects the write lock to be held.
+static void add_to_table(Key *key) {
+  size_t i = table_index(key->hash);
+  while (table[i]) i = (i + 1) & (table_size - 1);
+  table[i] = key;
+}
+
+// Expects the write lock to be held.
+static Key *insert(const char *str, size_t len, int hash) {
+  if (2 * (num_keys + 1) > table_size) {
+    Key **old_table = table;
+    size_t old_size = table_size;
+    table_size = (table_size ? 2 * table_size : 1024);
+    table = calloc(table_size, sizeof(Key *));
+    for (size_t i = 0; i < old_size; ++i) {
+      if (old_table[i]) add_to_table(old_table[i]);
+    }
+    free(old_table);
+  }
+  Key *key = alloc_key(len);
+  key->hash = hash;
+  key->len = (uint32_t)len;
+  memcpy(key->str, str, len);
+  key->str[len] = '\0';
+  add_to_table(key);
+  num_keys++;
+  return key;
+}
+
+static const char *intern_with_hash(const char *str, size_t len, int hash) {
+  pthread_rwlock_rdlock(&lock);
+  Key *key = find(str, len, hash);
+  pthread_rwlock_unlock(&lock);
+  if (key) return key->str;
+
+  pthread_rwlock_wrlock(&lock);
+  key = find(str, len, hash);  // Another thread may have just added it.
+  if (key == NULL) key = insert(str, len, hash);
+  pthread_rwlock_unlock(&lock);
+  return key->str;
+}
+
+
+// Library-internal functions.
+
+const char *json_intern_cached(const char *str, size_t len,
+                               const char **cache) {
+  int hash = hash_n(str, len);
+  unsigned int h = (unsigned int)hash;
+  const char **slot = &cache[(h ^ (h >> 16)) % json_intern_cache_size];
+  if (*slot) {
+    Key *key = key_of(*slot);
+    if (key->hash == hash && key->len == len &&
+        memcmp(key->str, str, len) == 0) {
+      return *slot;
+    }
+  }
+  *slot = intern_with_hash(str, len, hash);
+  return *slot;
+}
+
+
+// Public functions.
+
+const char *json_intern(const char *str) {
+  return json_intern_n(str, strlen(str));
+}
+
+const char *json_intern_n(const char *str, size_t len) {
+  return intern_with_hash(str, len, hash_n(str, len));
+}
+
+int json_interned_hash(void *str_void_ptr) {
+  if (is_interned(str_void_ptr)) return key_of(str_void_ptr)->hash;
+  return json_str_hash(str_void_ptr);
+}
+
+int json_interned_eq(void *str_void_ptr1, void *str_void_ptr2) {
+  if (str_void_ptr1 == str_void_ptr2) return true;
+  if (is_interned(str_void_ptr1) && is_interned(str_void_ptr2)) return false;
+  return json_str_eq(str_void_ptr1, str_void_ptr2);
+}
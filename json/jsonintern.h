@@ -0,0 +1,35 @@
+// jsonintern.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// A global pool of interned strings for object keys. Each distinct key is
+// stored once, with its hash, for the life of the program. Parsing with the
+// intern_keys option makes every object key a pointer into the pool, so keys
+// cost no memory per document, and objects compare their keys by pointer.
+//
+// The pool is safe to use from several threads at once.
+//
+// Nothing is ever removed from the pool, so it grows with every distinct key
+// it sees. That suits a fixed set of keys, as in records with the same fields,
+// but input with unbounded distinct keys, such as untrusted json lines, should
+// be parsed without intern_keys.
+//
+
+#pragma once
+
+#include "json.h"
+
+// Returns the pool's copy of str, adding it if needed. The copy is never
+// freed.
+const char *json_intern(const char *str);
+
+// This is like json_intern for the len chars at str, which needn't be
+// null-terminated but shouldn't include a '\0'.
+const char *json_intern_n(const char *str, size_t len);
+
+// The map__Hash and equality functions for objects parsed with interned
+// keys. Interned keys use their stored hash and are compared by pointer;
+// other strings, such as a literal passed to map__get, work as they would
+// with json_str_hash and json_str_eq.
+int json_interned_hash(void *str_void_ptr);
+int json_interned_eq(void *str_void_ptr1, void *str_void_ptr2);
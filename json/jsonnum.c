@@ -0,0 +1,426 @@
+// jsonnum.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// A decimal number is read as w * 10^q with up to 19 significant digits in the
+// uint64 w. Integers that fit in an int64_t are done at that point. Otherwise
+// the number is converted to the nearest double by the first of these that
+// applies:
+//
+// 1. When w and 10^|q| are both exact doubles, a single multiply or divide is
+//    correctly rounded. This is Clinger's fast path.
+// 2. Otherwise w is multiplied by a 128-bit approximation of 5^q from a table,
+//    and the result is rounded with a few integer operations. This is the
+//    Eisel-Lemire algorithm; see Daniel Lemire, "Number Parsing at a Gigabyte
+//    per Second" (2021), and the fast_float library.
+// 3. Numbers with more than 19 significant digits go through strtod.
+//
+// Doubles are written with the fewest significant digits that read back as
+// the same double, and of those, the digits closest to it. Integral values
+// below 2^53 are printed as integers. The rest go through the Schubfach
+// algorithm, which uses the same table of powers as parsing; see Raffaello
+// Giulietti, "The Schubfach way to render doubles" (2020).
+//
+
+#include "jsonnum.h"
+
+#include "jsonnum_tables.h"
+
+#include <float.h>
+#include <locale.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <intrin.h>
+
+static int clz64(uint64_t x) {
+  unsigned long index;
+  _BitScanReverse64(&index, x);
+  return 63 - (int)index;
+}
+#else
+#define clz64(x) __builtin_clzll(x)
+#endif
+
+#define is_digit(c) ((c) >= '0' && (c) <= '9')
+
+#define mantissa_bits 52
+#define infinity_bits (0x7FFULL << mantissa_bits)
+
+
+// 128-bit products.
+
+typedef struct {
+  uint64_t hi;
+  uint64_t lo;
+} U128;
+
+static U128 mul_64x64(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+  unsigned __int128 product = (unsigned __int128)a * b;
+  U128 result = { (uint64_t)(product >> 64), (uint64_t)product };
+#else
+  uint64_t a_lo = (uint32_t)a, a_hi = a >> 32;
+  uint64_t b_lo = (uint32_t)b, b_hi = b >> 32;
+  uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo;
+  uint64_t lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+  uint64_t cross = (lo_lo >> 32) + (uint32_t)hi_lo + lo_hi;
+  U128 result = { hi_hi + (hi_lo >> 32) + (cross >> 32),
+                  (cross << 32) | (uint32_t)lo_lo };
+#endif
+  return result;
+}
+
+
+// Conversion paths.
+
+static const double exact_powers_of_ten[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Returns the bits of the double nearest to w * 10^q, for w != 0.
+static uint64_t eisel_lemire(uint64_t w, int64_t q) {
+  if (q < smallest_power_of_ten) return 0;
+  if (q > largest_power_of_ten)  return infinity_bits;
+
+  int lz = clz64(w);
+  w <<= lz;
+  const uint64_t *pow5 = power_of_five_128[q - smallest_power_of_ten];
+
+  // We need the top 55 bits of the product to be exact; the low half of the
+  // table entry can only change them when the next 9 bits are all 1's.
+  U128 product = mul_64x64(w, pow5[0]);
+  const uint64_t precision_mask = ~0ULL >> (mantissa_bits + 3);
+  if ((product.hi & precision_mask) == precision_mask) {
+    U128 second = mul_64x64(w, pow5[1]);
+    product.lo += second.hi;
+    if (second.hi > product.lo) product.hi++;
+  }
+
+  int upperbit = (int)(product.hi >> 63);
+  int shift = upperbit + 64 - mantissa_bits - 3;
+  uint64_t mantissa = product.hi >> shift;
+
+  // This is floor(log2(10^q)) + 63 + the exponent bias of 1023.
+  int power2 = (int)(((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023;
+
+  if (power2 <= 0) {  // A subnormal result.
+    if (-power2 + 1 >= 64) return 0;
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    // If rounding carried into bit 52, we have the smallest normal number,
+    // whose exponent bits are also just bit 52.
+    return mantissa;
+  }
+
+  // If we're exactly halfway between two doubles, round to even. That can
+  // only happen for this range of q.
+  if (product.lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == product.hi) {
+    mantissa &= ~1ULL;
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (2ULL << mantissa_bits)) {
+    mantissa = (1ULL << mantissa_bits);
+    power2++;
+  }
+  mantissa &= ~(1ULL << mantissa_bits);
+  if (power2 >= 0x7FF) return infinity_bits;
+  return mantissa | ((uint64_t)power2 << mantissa_bits);
+}
+
+// The precise path for long inputs.
+static double slow_parse(const char *s, const char *end) {
+  size_t len = end - s;
+  char buf[64];
+  char *copy = (len < sizeof(buf) ? buf : malloc(len + 1));
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+
+  // strtod honors the LC_NUMERIC decimal point; json always uses '.'.
+  char *dot = memchr(copy, '.', len);
+  if (dot) *dot = localeconv()->decimal_point[0];
+
+  double value = strtod(copy, NULL);
+  if (copy != buf) free(copy);
+  return value;
+}
+
+
+// Public functions.
+
+// The char at p, or '\0' at the limit of the input.
+#define at(p) ((p) < limit ? *(p) : '\0')
+
+char *json_parse_number(const char *s, const char *limit, json_Item *item,
+                        const char **end) {
+  const char *p = s;
+  int is_negative = (at(p) == '-');
+  if (is_negative) p++;
+  if (!is_digit(at(p))) {
+    *end = p;
+    return "expected digit";
+  }
+
+  // Read the digits into w; w may wrap, which is checked for below.
+  uint64_t w = 0;
+  const char *digits = p;
+  if (at(p) == '0') {
+    p++;
+  } else {
+    while (is_digit(at(p))) w = 10 * w + (*p++ - '0');
+  }
+  int64_t num_digits = p - digits;
+  int64_t q = 0;
+
+  // The integer fast path. For negatives, w - 1 wraps when w is 0; that keeps
+  // -0 as a double, which preserves its sign.
+  if (at(p) != '.' && at(p) != 'e' && at(p) != 'E' && num_digits <= 19 &&
+      (is_negative ? (w - 1) <= (uint64_t)INT64_MAX : w <= INT64_MAX)) {
+    *end = p;
+    item->type = item_integer;
+    item->value.integer = is_negative ? (int64_t)(0 - w) : (int64_t)w;
+    return NULL;
+  }
+
+  if (at(p) == '.') {
+    p++;
+    if (!is_digit(at(p))) {
+      *end = p;
+      return "expected digit after .";
+    }
+    const char *frac_digits = p;
+    while (is_digit(at(p))) w = 10 * w + (*p++ - '0');
+    q = -(p - frac_digits);
+    num_digits += p - frac_digits;
+  }
+
+  if (at(p) == 'e' || at(p) == 'E') {
+    p++;
+    if (at(p) == '\0') {
+      *end = p;
+      return "expected exponent";
+    }
+    int exp_is_negative = (at(p) == '-');
+    if (at(p) == '-' || at(p) == '+') p++;
+    if (!is_digit(at(p))) {
+      *end = p;
+      return "expected digit";
+    }
+    int64_t exp_number = 0;
+    for (; is_digit(at(p)); ++p) {
+      // Beyond this, the result is 0 or infinity anyway.
+      if (exp_number < 0x10000000) exp_number = 10 * exp_number + (*p - '0');
+    }
+    q += exp_is_negative ? -exp_number : exp_number;
+  }
+  *end = p;
+
+  if (num_digits > 19) {
+    // Leading zeros, as in 0.000123, aren't significant.
+    for (const char *d = digits; d < p && (*d == '0' || *d == '.'); ++d) {
+      num_digits -= (*d == '0');
+    }
+    if (num_digits > 19) {
+      item->type = item_number;
+      item->value.number = slow_parse(s, p);
+      return NULL;
+    }
+  }
+
+  double d;
+  if (w == 0) {
+    d = 0.0;
+#if FLT_EVAL_METHOD == 0
+  } else if (-22 <= q && q <= 22 && w <= (1ULL << 53)) {
+    d = (double)w;
+    if (q < 0) {
+      d /= exact_powers_of_ten[-q];
+    } else {
+      d *= exact_powers_of_ten[q];
+    }
+#endif
+  } else {
+    uint64_t bits = eisel_lemire(w, q);
+    memcpy(&d, &bits, sizeof(d));
+  }
+  item->type = item_number;
+  item->value.number = is_negative ? -d : d;
+  return NULL;
+}
+
+int json_format_integer(char *buf, int64_t n) {
+  static const char digit_pairs[] =
+      "00010203040506070809101112131415161718192021222324252627282930313233343536"
+      "37383940414243444546474849505152535455565758596061626364656667686970717273"
+      "7475767778798081828384858687888990919293949596979899";
+  char digits[20];
+  char *d = digits + sizeof(digits);
+  uint64_t u = (n < 0 ? 0 - (uint64_t)n : (uint64_t)n);
+  while (u >= 100) {
+    int pair = (int)(u % 100) * 2;
+    u /= 100;
+    *--d = digit_pairs[pair + 1];
+    *--d = digit_pairs[pair];
+  }
+  if (u >= 10) {
+    *--d = digit_pairs[u * 2 + 1];
+    *--d = digit_pairs[u * 2];
+  } else {
+    *--d = '0' + (char)u;
+  }
+  char *b = buf;
+  if (n < 0) *b++ = '-';
+  size_t len = digits + sizeof(digits) - d;
+  memcpy(b, d, len);
+  return (int)(b - buf + len);
+}
+
+
+// Shortest round-trip formatting.
+
+#define floor_log2_pow10(e)  (((e) * 1741647) >> 19)
+#define floor_log10_pow2(e)  (((e) * 1262611) >> 22)
+#define floor_log10_three_quarters_pow2(e) (((e) * 1262611 - 524031) >> 22)
+
+// Returns the top 64 bits of the 192-bit product g * cp, with the lowest bit
+// set if any of the bits below them are nonzero, save the lowest one.
+static uint64_t round_to_odd(uint64_t g_hi, uint64_t g_lo, uint64_t cp) {
+  U128 x = mul_64x64(g_lo, cp);
+  U128 y = mul_64x64(g_hi, cp);
+  y.lo += x.hi;
+  if (y.lo < x.hi) y.hi++;
+  return y.hi | (y.lo > 1);
+}
+
+// Finds the shortest decimal digits * 10^*exp10 that rounds to the positive
+// double c * 2^q, where c has 53 bits for normal numbers.
+static void shortest_decimal(uint64_t c, int q, int lower_is_closer,
+                             uint64_t *digits, int *exp10) {
+  int is_even = (c % 2 == 0);
+  uint64_t cbl = 4 * c - 2 + lower_is_closer;
+  uint64_t cb  = 4 * c;
+  uint64_t cbr = 4 * c + 2;
+
+  // The table holds 10^-k rounded down, except for -k in [-27, -1], where it's
+  // rounded up; Schubfach wants it rounded down, plus one.
+  int k = lower_is_closer ? floor_log10_three_quarters_pow2(q) :
+                            floor_log10_pow2(q);
+  int h = q + floor_log2_pow10(-k) + 1;
+  const uint64_t *pow10 = power_of_five_128[-k - smallest_power_of_ten];
+  uint64_t inc = (-k < -27 || -k >= 0);
+  uint64_t g_lo = pow10[1] + inc;
+  uint64_t g_hi = pow10[0] + (g_lo < inc);
+
+  // These are the rounding interval and c * 2^q, scaled by 4 * 10^-k.
+  uint64_t vbl = round_to_odd(g_hi, g_lo, cbl << h);
+  uint64_t vb  = round_to_odd(g_hi, g_lo, cb  << h);
+  uint64_t vbr = round_to_odd(g_hi, g_lo, cbr << h);
+  uint64_t lower = vbl + !is_even;
+  uint64_t upper = vbr - !is_even;
+
+  // Try one fewer digit first, then the two nearest with this many.
+  uint64_t s = vb / 4;
+  if (s >= 10) {
+    uint64_t sp = s / 10;
+    int u_inside = (lower <= 40 * sp);
+    int w_inside = (40 * sp + 40 <= upper);
+    if (u_inside != w_inside) {
+      *digits = sp + w_inside;
+      *exp10 = k + 1;
+      return;
+    }
+  }
+  int u_inside = (lower <= 4 * s);
+  int w_inside = (4 * s + 4 <= upper);
+  if (u_inside != w_inside) {
+    *digits = s + w_inside;
+    *exp10 = k;
+    return;
+  }
+  uint64_t mid = 4 * s + 2;
+  *digits = s + (vb > mid || (vb == mid && (s & 1)));
+  *exp10 = k;
+}
+
+int json_format_number(char *buf, double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, sizeof(d));
+  uint64_t significand = bits & ((1ULL << mantissa_bits) - 1);
+  int exponent = (int)(bits >> mantissa_bits) & 0x7FF;
+  if (exponent == 0x7FF) return snprintf(buf, 32, "%g", d);
+
+  char *b = buf;
+  if (bits >> 63) *b++ = '-';
+  if ((bits << 1) == 0) {
+    *b++ = '0';
+    return (int)(b - buf);
+  }
+
+  // The fast path for integral values.
+  double magnitude = (d < 0 ? -d : d);
+  if (magnitude < 9007199254740992.0 && magnitude == (int64_t)magnitude) {
+    return (int)(b - buf) + json_format_integer(b, (int64_t)magnitude);
+  }
+
+  uint64_t c;
+  int q;
+  if (exponent) {
+    c = significand | (1ULL << mantissa_bits);
+    q = exponent - 1075;
+  } else {
+    c = significand;
+    q = -1074;
+  }
+  uint64_t digits;
+  int exp10;
+  shortest_decimal(c, q, (significand == 0 && exponent > 1), &digits,
+                   &exp10);
+  while (digits % 10 == 0) {
+    digits /= 10;
+    exp10++;
+  }
+
+  // Lay out the digits as JavaScript does: plainly when the decimal point is
+  // within 21 places left or 6 places right of the first digit, and otherwise
+  // with an exponent.
+  char d_str[20];
+  int num_digits = json_format_integer(d_str, (int64_t)digits);
+  int point = num_digits + exp10;  // The point goes after d_str[0, point).
+  if (0 < point && point <= 21) {
+    if (exp10 >= 0) {
+      memcpy(b, d_str, num_digits);
+      memset(b + num_digits, '0', exp10);
+      b += point;
+    } else {
+      memcpy(b, d_str, point);
+      b[point] = '.';
+      memcpy(b + point + 1, d_str + point, num_digits - point);
+      b += num_digits + 1;
+    }
+  } else if (-6 < point && point <= 0) {
+    *b++ = '0';
+    *b++ = '.';
+    memset(b, '0', -point);
+    b += -point;
+    memcpy(b, d_str, num_digits);
+    b += num_digits;
+  } else {
+    *b++ = d_str[0];
+    if (num_digits > 1) {
+      *b++ = '.';
+      memcpy(b, d_str + 1, num_digits - 1);
+      b += num_digits - 1;
+    }
+    *b++ = 'e';
+    *b++ = (point > 0 ? '+' : '-');
+    b += json_format_integer(b, point > 0 ? point - 1 : 1 - point);
+  }
+  return (int)(b - buf);
+}
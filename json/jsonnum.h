@@ -0,0 +1,32 @@
+// jsonnum.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Library-internal number conversion used by json.c.
+// This is not part of the public interface.
+//
+
+#pragma once
+
+#include "json.h"
+
+// Parses the json number at s, which must start with '-' or a digit, into
+// *item, reading nothing at or after limit. Integers without a fraction or
+// exponent that fit in an int64_t become item_integer; other numbers become an
+// item_number bit-for-bit equal to what strtod gives. *end is set to the first
+// character after the number. On a syntax error, *end points to the offending
+// character and the return value is an error message; otherwise the return
+// value is NULL.
+char *json_parse_number(const char *s, const char *limit, json_Item *item,
+                        const char **end);
+
+// Writes the decimal digits of n to buf, which needs room for 20 characters,
+// and returns the number of characters written. No null is appended.
+int json_format_integer(char *buf, int64_t n);
+
+// Writes the shortest decimal form of d that parses back to d to buf, which
+// needs room for 32 characters, and returns the number of characters written.
+// No null is appended. The layout is that of JavaScript's Number toString,
+// such as 0.1, 123456789, 1e+21, or 5e-7, except that -0 keeps its sign.
+// Infinities and NaNs are written by snprintf's %g, as they have no json form.
+int json_format_number(char *buf, double d);
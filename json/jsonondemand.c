@@ -0,0 +1,297 @@
+// jsonondemand.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+
+#include "jsonondemand.h"
+
+#include "jsonnum.h"
+#include "jsonparse.h"
+#include "jsonscan.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+#define is_space(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+#define is_digit(c) ('0' <= (c) && (c) <= '9')
+
+// The macros below expect a json_Value v to be in scope for the input's end.
+
+#define skip_space(s) while ((s) < v.end && is_space(*(s))) (s)++
+
+// The char at s, or '\0' at the end of the input.
+#define peek(s) ((s) < v.end ? *(s) : '\0')
+
+// Returns v as an error with the given message at s.
+static json_Value error_at(json_Value v, const char *s, char *msg) {
+  v.type = item_error;
+  v.at = s;
+  v.error = msg;
+  return v;
+}
+
+// Returns the value whose first char is at s, within the input of v.
+static json_Value value_at(json_Value v, const char *s) {
+  v.at = s;
+  v.error = NULL;
+  switch (peek(s)) {
+    case '{': v.type = item_object; return v;
+    case '[': v.type = item_array;  return v;
+    case '"': v.type = item_string; return v;
+  }
+  if (peek(s) == '-' || is_digit(peek(s))) {
+    v.type = item_number;
+    return v;
+  }
+  char *msg;
+  if (json_parse_literal(s, v.end, &v.type, &msg) == NULL) {
+    return error_at(v, s, msg);
+  }
+  return v;
+}
+
+// Returns a pointer just past the string whose contents start at s, or NULL
+// if it isn't closed before end.
+static const char *skip_string(const char *s, const char *end) {
+  for (;;) {
+    s = json_scan_string(s, end);
+    if (s == end) return NULL;
+    if (*s == '"') return s + 1;
+    // Skip a backslash and the char it escapes, or a control character.
+    s += (*s == '\\' ? 2 : 1);
+    if (s > end) return NULL;
+  }
+}
+
+// Returns a pointer just past the value at s, or NULL if a string or container
+// isn't closed before the end of the input. Containers are only
+// bracket-matched; their contents aren't checked.
+static const char *skip_value(json_Value v, const char *s) {
+  if (*s == '"') return skip_string(s + 1, v.end);
+  if (*s != '[' && *s != '{') {
+    // Scalars run until whitespace or structural chars.
+    while (s < v.end && !is_space(*s) && *s != ',' && *s != ']' &&
+           *s != '}' && *s != ':') {
+      s++;
+    }
+    return s;
+  }
+  int depth = 0;
+  while (s < v.end) {
+    char c = *s++;
+    if (c == '"') {
+      s = skip_string(s, v.end);
+      if (s == NULL) return NULL;
+    } else if (c == '[' || c == '{') {
+      depth++;
+    } else if (c == ']' || c == '}') {
+      if (--depth == 0) return s;
+    }
+  }
+  return NULL;
+}
+
+// Escaped keys no longer than this are decoded on the stack for comparison.
+#define max_stack_key 256
+
+// Returns true if the len chars at str are the JSON Pointer reference token
+// [token, token_end), in which "~1" stands for '/' and "~0" for '~'.
+static int is_pointer_token(const char *str, size_t len, const char *token,
+                            const char *token_end) {
+  const char *str_end = str + len;
+  while (str < str_end && token < token_end) {
+    char c = *token++;
+    if (c == '~' && token < token_end && (*token == '0' || *token == '1')) {
+      c = (*token++ == '0' ? '~' : '/');
+    }
+    if (c != *str++) return false;
+  }
+  return str == str_end && token == token_end;
+}
+
+// Returns true if the string token [token, token_end) decodes to the key_len
+// chars at key, or, if is_pointer is true, to the JSON Pointer reference token
+// [key, key + key_len).
+static int key_matches(const char *token, const char *token_end,
+                       const char *key, size_t key_len, int is_pointer) {
+  const char *str = token + 1;
+  size_t len = token_end - 1 - str;
+  char stack_buf[max_stack_key];
+  char *buf = NULL;
+  if (memchr(str, '\\', len)) {
+    // Escaped keys are rare; decode them to compare.
+    buf = (len <= max_stack_key ? stack_buf : malloc(len));
+    if (buf == NULL) return false;  // Without memory, nothing matches.
+    if (json_decode_string_to(token, token_end, buf, &len) == NULL) {
+      if (buf != stack_buf) free(buf);
+      return false;  // A key that doesn't decode matches nothing.
+    }
+    str = buf;
+  }
+  int matches = (is_pointer ? is_pointer_token(str, len, key, key + key_len) :
+                 len == key_len && memcmp(str, key, len) == 0);
+  if (buf != stack_buf) free(buf);
+  return matches;
+}
+
+// Returns the value for the key_len chars at key, which is a JSON Pointer
+// reference token if is_pointer is true, in object v.
+static json_Value find_key(json_Value v, const char *key, size_t key_len,
+                           int is_pointer) {
+  if (v.type == item_error) return v;
+  if (v.type != item_object) return error_at(v, v.at, "not an object");
+
+  const char *s = v.at + 1;
+  skip_space(s);
+  if (peek(s) == '}') return error_at(v, v.at, "key not found");
+  for (;;) {
+    if (peek(s) != '"') return error_at(v, s, "expected '\"'");
+    const char *key_end = skip_string(s + 1, v.end);
+    if (key_end == NULL) return error_at(v, s, "string not closed");
+    int is_match = key_matches(s, key_end, key, key_len, is_pointer);
+    s = key_end;
+    skip_space(s);
+    if (peek(s) != ':') return error_at(v, s, "expected ':'");
+    s++;
+    skip_space(s);
+    if (is_match) return value_at(v, s);
+
+    json_Value value = value_at(v, s);
+    if (value.type == item_error) return value;
+    const char *value_end = skip_value(v, s);
+    if (value_end == NULL) return error_at(v, s, "value not closed");
+    s = value_end;
+    skip_space(s);
+    if (peek(s) == '}') return error_at(v, v.at, "key not found");
+    if (peek(s) != ',') return error_at(v, s, "expected '}' or ','");
+    s++;
+    skip_space(s);
+  }
+}
+
+json_Value json_ondemand(const char *buf, size_t len) {
+  json_Value v = { .start = buf, .end = buf + len };
+  const char *s = buf;
+  skip_space(s);
+  return value_at(v, s);
+}
+
+json_Value json_ondemand_get(json_Value v, const char *key) {
+  return find_key(v, key, strlen(key), false);
+}
+
+json_Value json_ondemand_at(json_Value v, int index) {
+  if (v.type == item_error) return v;
+  if (v.type != item_array) return error_at(v, v.at, "not an array");
+
+  const char *s = v.at + 1;
+  skip_space(s);
+  if (peek(s) == ']' || index < 0) {
+    return error_at(v, v.at, "index out of range");
+  }
+  for (int i = 0;; ++i) {
+    json_Value value = value_at(v, s);
+    if (i == index || value.type == item_error) return value;
+    const char *value_end = skip_value(v, s);
+    if (value_end == NULL) return error_at(v, s, "value not closed");
+    s = value_end;
+    skip_space(s);
+    if (peek(s) == ']') return error_at(v, v.at, "index out of range");
+    if (peek(s) != ',') return error_at(v, s, "expected ']' or ','");
+    s++;
+    skip_space(s);
+  }
+}
+
+json_Value json_ondemand_pointer(json_Value v, const char *pointer) {
+  if (*pointer && *pointer != '/') return error_at(v, v.at, "invalid pointer");
+  while (*pointer && v.type != item_error) {
+    const char *token = pointer + 1;
+    const char *token_end = strchr(token, '/');
+    if (token_end == NULL) token_end = token + strlen(token);
+    pointer = token_end;
+
+    if (v.type == item_object) {
+      v = find_key(v, token, token_end - token, true);
+    } else if (v.type == item_array) {
+      // Indexes are digits without leading zeros; "-", for the element after
+      // the last, is always out of range here.
+      long index = 0;
+      if (token == token_end) return error_at(v, v.at, "invalid index");
+      if (*token == '-' && token_end == token + 1) {
+        return error_at(v, v.at, "index out of range");
+      }
+      for (const char *t = token; t < token_end; ++t) {
+        if (!is_digit(*t) || (*token == '0' && token_end > token + 1)) {
+          return error_at(v, v.at, "invalid index");
+        }
+        index = index * 10 + (*t - '0');
+        if (index > INT_MAX) return error_at(v, v.at, "index out of range");
+      }
+      v = json_ondemand_at(v, (int)index);
+    } else {
+      return error_at(v, v.at, "not an object or array");
+    }
+  }
+  return v;
+}
+
+int json_ondemand_number(json_Value value, double *number) {
+  if (value.type != item_number) return false;
+  json_Item item;
+  const char *end;
+  if (json_parse_number(value.at, value.end, &item, &end)) return false;
+  *number = (item.type == item_integer ? (double)item.value.integer :
+                                         item.value.number);
+  return true;
+}
+
+int json_ondemand_integer(json_Value value, int64_t *integer) {
+  if (value.type != item_number) return false;
+  json_Item item;
+  const char *end;
+  if (json_parse_number(value.at, value.end, &item, &end) ||
+      item.type != item_integer) {
+    return false;
+  }
+  *integer = item.value.integer;
+  return true;
+}
+
+int json_ondemand_bool(json_Value value, int *boolean) {
+  if (value.type != item_true && value.type != item_false) return false;
+  *boolean = (value.type == item_true);
+  return true;
+}
+
+char *json_ondemand_string(json_Value value) {
+  if (value.type != item_string) return NULL;
+  json_Item item;
+  if (json_parse_scalar(value.at, value.end - value.at,
+                        value.at - value.start, &item) == NULL) {
+    json_release_item(&item);
+    return NULL;
+  }
+  return item.value.string;
+}
+
+const char *json_ondemand_item(json_Value value, json_Item *item) {
+  long index = value.at - value.start;
+  if (value.type == item_error) {
+    json_set_error(item, value.error, index);
+    return NULL;
+  }
+  json_ParseOptions options = { 0 };
+  return json_parse_at(value.at, value.end - value.at, index, item, options);
+}
+
+const char *json_extract(const char *buf, size_t len, const char *pointer,
+                         json_Item *item) {
+  json_Value value = json_ondemand_pointer(json_ondemand(buf, len), pointer);
+  return json_ondemand_item(value, item);
+}
@@ -0,0 +1,65 @@
+// jsonondemand.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// On-demand access to json input. Instead of building the whole item tree,
+// these functions look through the input for just the values that are asked
+// for. Values that are passed over are only bracket-matched, not parsed or
+// checked, so reading a few fields of a big document is cheap.
+//
+// Example:
+//
+//   json_Value doc = json_ondemand(buf, len);
+//   json_Value id = json_ondemand_get(json_ondemand_get(doc, "user"), "id");
+//   int64_t n;
+//   if (json_ondemand_integer(id, &n)) printf("user id: %lld\n", n);
+//
+
+#pragma once
+
+#include "json.h"
+
+// A value within some json input. It's only a position in the input, so it's
+// cheap to copy, and valid for as long as the input is.
+typedef struct {
+  json_ItemType type;   // Numbers are item_number; the type is item_error if
+                        // the value wasn't found or the input is malformed.
+  const char *  at;     // The value's first char, or where the error is.
+  char *        error;  // For errors, a message such as "key not found".
+  const char *  start;  // The start of the input; indexes count from here.
+  const char *  end;    // Just past the end of the input.
+} json_Value;
+
+// Returns the top-level value of buf[0, len).
+json_Value json_ondemand(const char *buf, size_t len);
+
+// Returns the value for key in object, the first one if the key is repeated.
+// Errors pass through, so calls can be chained.
+json_Value json_ondemand_get(json_Value object, const char *key);
+
+// Returns the value at index in array. Errors pass through.
+json_Value json_ondemand_at(json_Value array, int index);
+
+// Returns the value that the RFC 6901 JSON Pointer pointer, such as
+// "/items/3/price", refers to within v; "" refers to v itself. Errors pass
+// through. Keys are matched without allocating.
+json_Value json_ondemand_pointer(json_Value v, const char *pointer);
+
+// These return true and set their output if value has the right type.
+int json_ondemand_number (json_Value value, double *number);
+int json_ondemand_integer(json_Value value, int64_t *integer);
+int json_ondemand_bool   (json_Value value, int *boolean);
+
+// Returns a newly-allocated copy of the decoded string, or NULL if value isn't
+// a well-formed string.
+char *json_ondemand_string(json_Value value);
+
+// Fully parses value into *item, as json_parse_n would, and returns a pointer
+// just past it. For error values, *item is an error item and NULL is returned.
+const char *json_ondemand_item(json_Value value, json_Item *item);
+
+// Parses just the value that pointer refers to within buf[0, len), as with
+// json_ondemand_pointer and json_ondemand_item, into *item. Returns a pointer
+// just past the value, or NULL with an error item in *item.
+const char *json_extract(const char *buf, size_t len, const char *pointer,
+                         json_Item *item);
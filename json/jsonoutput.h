@@ -0,0 +1,88 @@
+// jsonoutput.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Library-internal pieces of json.c's stringifier that are shared with the
+// writer in jsonwriter.c and the parallel stringifier in jsonbatch.c. This is
+// not part of the public interface.
+//
+// Output goes straight into one buffer, which either grows as needed, has a
+// fixed size, or is flushed to a sink as it fills. A fixed buffer that fills
+// up keeps counting the chars that would have been written, so the full length
+// is known after one pass; with no room at all, it only counts.
+//
+
+#pragma once
+
+#include "json.h"
+
+#include <string.h>
+
+// The size of the buffers that output to sinks goes through.
+#define json_sink_buffer_size 4096
+
+typedef struct {
+  char *      buf;
+  size_t      len;          // The chars output so far, including any that
+                            // didn't fit, or since the last flush to a sink.
+  size_t      cap;
+  int         can_grow;     // If true, buf is malloc'd and grows as needed.
+  json_Sink * sink;         // If not NULL, full buffers are written here.
+  int         sink_failed;  // If true, the sink gets nothing more.
+  int         flags;        // Stringify flags, such as json_pretty.
+} json_Output;
+
+// The slow path of json_out_write and json_out_char: grows the buffer, flushes
+// it to the sink, or writes as much as fits in a fixed one.
+void json_out_overflow(json_Output *out, const char *chars, size_t n);
+
+// A buffer with no room only counts; that's checked here, not in the slow
+// path, to keep counting cheap.
+static inline void json_out_write(json_Output *out, const char *chars,
+                                  size_t n) {
+  if (out->len + n <= out->cap) {
+    memcpy(out->buf + out->len, chars, n);
+    out->len += n;
+  } else if (out->cap == 0) {
+    out->len += n;
+  } else {
+    json_out_overflow(out, chars, n);
+  }
+}
+
+static inline void json_out_char(json_Output *out, char c) {
+  if (out->len < out->cap) {
+    out->buf[out->len++] = c;
+  } else if (out->cap == 0) {
+    out->len++;
+  } else {
+    json_out_overflow(out, &c, 1);
+  }
+}
+
+#define json_out_literal(out, str) json_out_write(out, str, sizeof(str) - 1)
+
+// Writes n spaces.
+void json_out_indent(json_Output *out, int n);
+
+// Writes the len chars at s as a quoted json string, escaped as out's flags
+// call for.
+void json_out_string(json_Output *out, const char *s, size_t len);
+
+// Writes item as json_stringify does, indented in pretty output as if it were
+// nested depth containers deep.
+void json_out_item(json_Output *out, json_Item item, int depth);
+
+// Writes what goes before a subitem of a container at depth - 1: a comma
+// unless it's the first, the indent in pretty output, and for an object, the
+// key. The key is NULL for an array's subitem.
+void json_out_subitem_start(json_Output *out, const char *key, int is_first,
+                            int depth);
+
+// Writes d or n as json_stringify does.
+void json_out_number(json_Output *out, double d);
+void json_out_integer(json_Output *out, int64_t n);
+
+// Passes the buffered chars to out's sink, unless an earlier write failed, and
+// empties the buffer.
+void json_out_flush(json_Output *out);
@@ -0,0 +1,225 @@
+// jsonparse.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Library-internal pieces of json.c's parser that are shared with the other
+// parsers, such as the push parser in jsonpush.c. This is not part of the
+// public interface.
+//
+
+#pragma once
+
+#include "json.h"
+
+// Parses the number, string, or literal at token into *item, reading nothing
+// at or after token + len. Error messages give indexes as if token were at
+// index offset. Returns a pointer to the last character of the value, or NULL
+// on error, in which case *item is an error item.
+const char *json_parse_scalar(const char *token, size_t len, long offset,
+                              json_Item *item);
+
+// Reads the literal false, true, or null at input, whose first char may be
+// anything. Returns a pointer to its last character and sets *type, or returns
+// NULL and sets *msg to json_parse's error message for input.
+const char *json_parse_literal(const char *input, const char *end,
+                               json_ItemType *type, char **msg);
+
+// Decodes the string at input, which points to its opening quote, and appends
+// its chars to the char Array chars. Returns a pointer to the closing quote,
+// or NULL if the string isn't closed or isn't valid UTF-8, with an error item
+// in *error whose index counts from offset.
+const char *json_decode_string(const char *input, const char *end,
+                               long offset, Array chars, json_Item *error);
+
+// Decodes the string at input, which points to its opening quote, into dest,
+// which needs room for as many chars as the string's source has. Returns a
+// pointer to the closing quote and sets *len to the decoded length, or returns
+// NULL if the string isn't closed or isn't valid UTF-8. Nothing is allocated.
+const char *json_decode_string_to(const char *input, const char *end,
+                                  char *dest, size_t *len);
+
+// Makes item an empty array or object, as json_parse does, for the bracket
+// '[' or '{'.
+void json_new_container(json_Item *item, char bracket);
+
+// Adds a placeholder null item to container and returns it. Objects take
+// ownership of key.
+json_Item *json_add_subitem(json_Item *container, char *key);
+
+// Makes item an error item with a message formatted like json_parse's.
+void json_set_error(json_Item *item, char *msg, long index);
+
+// Replaces the partially parsed item at root with the error item at failed,
+// which may be within root.
+void json_fail(json_Item *root, json_Item *failed);
+
+// A tokenizer takes the steps of json.c's parse_value through the structure of
+// one value: it tracks the open containers and checks the punctuation between
+// values, and leaves each number, string, literal, and key to its caller. The
+// event parser, tape parser, and validator are built on it.
+//
+// Call json_next_token until it returns json_token_done or an error. After a
+// json_token_key or json_token_scalar, the caller reads what's at t->input and
+// leaves t->input pointing to its last character.
+
+typedef enum {
+  json_token_none,      // Nothing has been read yet.
+  json_token_open,      // t->input points to a '[' or '{'.
+  json_token_close,     // t->input points to a ']' or '}'.
+  json_token_key,       // t->input points to an object key's opening quote.
+  json_token_scalar,    // t->input points to the start of any other value.
+  json_token_done,      // t->input is past the value and trailing whitespace.
+  json_token_error,     // t->input points to the error, described by t->error.
+  json_token_too_deep   // As json_token_error, for too many open containers.
+} json_TokenType;
+
+typedef struct {
+  const char *   start;      // The beginning of the input.
+  const char *   end;        // Just past the end of the input.
+  const char *   input;      // The current token.
+  char *         error;      // The error message, if any.
+  json_TokenType last;       // The token returned last.
+  int            depth;      // The number of open containers.
+  int            max_depth;  // The most containers that may be open at once.
+  uint64_t *     is_object;  // One bit per open container.
+  uint64_t       bits[json_max_depth / 64];  // is_object, unless deeper.
+} json_Tokenizer;
+
+// Sets up t to read the value in buf[0, len), skipping leading whitespace.
+// A max_depth of zero means json_max_depth. Call json_tokenizer_end when done.
+void json_tokenizer_init(json_Tokenizer *t, const char *buf, size_t len,
+                         int max_depth);
+
+// Frees what t allocated.
+void json_tokenizer_end(json_Tokenizer *t);
+
+// The macros below expect a json_Tokenizer *t to be in scope.
+
+#define json_tok_space(c) \
+  ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+#define json_tok_peek(input) ((input) < t->end ? *(input) : '\0')
+
+#define json_tok_next(input) \
+  input++; \
+  while (input < t->end && json_tok_space(*input)) input++;
+
+#define json_tok_in_object() \
+  ((t->is_object[(t->depth - 1) / 64] >> ((t->depth - 1) % 64)) & 1)
+
+// Moves t to the next token and returns its type. After json_token_done or an
+// error, this returns the same token again. It's inlined into each parser's
+// loop, as a call per token would be a good part of the validator's time.
+static inline json_TokenType json_next_token(json_Tokenizer *t) {
+  const char *input = t->input;
+  json_TokenType token;
+  char *msg;
+  switch (t->last) {
+    case json_token_none:
+      goto value;
+
+    case json_token_open: {
+      char close = (*input == '[' ? ']' : '}');
+      json_tok_next(input);
+      if (json_tok_peek(input) == close) {
+        t->depth--;
+        token = json_token_close;
+        goto found;
+      }
+      if (close == '}') goto key;
+      goto value;
+    }
+
+    case json_token_key:
+      json_tok_next(input);
+      if (json_tok_peek(input) != ':') {
+        msg = "expected ':'";
+        goto error;
+      }
+      json_tok_next(input);
+      goto value;
+
+    case json_token_close:
+    case json_token_scalar: {
+      // The value is complete; move on as parse_value does.
+      json_tok_next(input);
+      if (t->depth == 0) {
+        token = json_token_done;
+        goto found;
+      }
+      int in_object = json_tok_in_object();
+      if (json_tok_peek(input) == ',') {
+        json_tok_next(input);
+        if (in_object) goto key;
+        goto value;
+      }
+      if (json_tok_peek(input) != (in_object ? '}' : ']')) {
+        msg = in_object ? "expected '}' or ','" : "expected ']' or ','";
+        goto error;
+      }
+      t->depth--;
+      token = json_token_close;
+      goto found;
+    }
+
+    default:  // After json_token_done or an error.
+      return t->last;
+  }
+
+key:
+  if (json_tok_peek(input) != '"') {
+    msg = "expected '\"'";
+    goto error;
+  }
+  token = json_token_key;
+  goto found;
+
+value:
+  if (json_tok_peek(input) == '[' || json_tok_peek(input) == '{') {
+    if (t->depth == t->max_depth) {
+      t->input = input;
+      t->error = "nesting too deep";
+      return t->last = json_token_too_deep;
+    }
+    uint64_t bit = (uint64_t)1 << (t->depth % 64);
+    if (*input == '{') {
+      t->is_object[t->depth / 64] |= bit;
+    } else {
+      t->is_object[t->depth / 64] &= ~bit;
+    }
+    t->depth++;
+    token = json_token_open;
+  } else {
+    token = json_token_scalar;
+  }
+
+found:
+  t->input = input;
+  return t->last = token;
+
+error:
+  t->input = input;
+  t->error = msg;
+  return t->last = json_token_error;
+}
+
+#undef json_tok_space
+#undef json_tok_peek
+#undef json_tok_next
+#undef json_tok_in_object
+
+// Parses like json_parse_n_with_options, with error indexes given as if buf
+// were at index offset.
+const char *json_parse_at(const char *buf, size_t len, long offset,
+                          json_Item *item, json_ParseOptions options);
+
+// The releaser of parsed arrays; it releases each json_Item in the array.
+void json_item_releaser(void *item, void *context);
+
+// Parsers intern keys through a cache of this many recently seen keys, which
+// saves locking the pool for keys that repeat. Start the cache out zeroed.
+#define json_intern_cache_size 64
+
+// Returns the pool's copy of the len chars at str, as json_intern_n does.
+const char *json_intern_cached(const char *str, size_t len,
+                               const char **cache);
@@ -0,0 +1,350 @@
+// jsonpush.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The push parser keeps the state that json.c's parser keeps on its call
+// stack and in its input pointer: the open containers, the item being parsed,
+// and what kind of token comes next. Scalars are decoded by json.c's own
+// functions. A scalar that lies within one chunk is decoded in place; one
+// that's split between chunks has its raw chars saved until its end arrives,
+// so split escapes and surrogate pairs are decoded exactly as usual.
+//
+
+#include "jsonpush.h"
+
+#include "jsonparse.h"
+#include "jsonscan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+// What the parser expects next, outside of scalar tokens.
+typedef enum {
+  expect_value,  // A value, as at the start of the input or after a ':'.
+  array_start,   // A value or ']' after a '['.
+  object_start,  // A key or '}' after a '{'.
+  expect_key,    // A key after a ',' in an object.
+  expect_colon,  // The ':' after a key.
+  after_value,   // A ',' or closing bracket after a value in a container.
+  done,          // Nothing but whitespace after the top-level value.
+  failed         // Nothing; root is the error item.
+} State;
+
+struct json_PushParserStruct {
+  json_Item  root;
+  json_Item *item;       // The item the next value is parsed into.
+  Array      stack;      // The open arrays and objects, as json_Item *'s.
+  int        max_depth;  // The most containers that may be open at once.
+  State      state;
+  long       offset;     // The index of the next chunk's first char.
+
+  // The scalar token being parsed, if any.
+  char  kind;         // Its first char, or '\0' between tokens.
+  int   is_key;       // True for object keys.
+  long  token_index;  // The index of its first char.
+  int   remaining;    // For literals, the number of chars still to come.
+  int   escape;       // For strings, -1 just after a backslash, the number of
+                      // \u hex digits still to come, or 0.
+  Array token;        // The chars so far of a token split between chunks.
+};
+
+#define is_space(c) ((c) == ' ' || (c) == '\n' || (c) == '\r' || (c) == '\t')
+
+#define is_digit(c) ('0' <= (c) && (c) <= '9')
+
+#define is_hex(c) \
+  (is_digit(c) || ('a' <= (c) && (c) <= 'f') || ('A' <= (c) && (c) <= 'F'))
+
+#define is_number_char(c) \
+  (is_digit(c) || (c) == '-' || (c) == '+' || (c) == '.' || (c) == 'e' || \
+   (c) == 'E')
+
+#define is_scalar_start(c) \
+  ((c) == '"' || (c) == '-' || is_digit(c) || (c) == 't' || (c) == 'f' || \
+   (c) == 'n')
+
+#define is_number(kind) ((kind) == '-' || is_digit(kind))
+
+static json_Item *top(json_PushParser p) {
+  return array__item_val(p->stack, p->stack->count - 1, json_Item *);
+}
+
+// Replaces the root with the error item at error; returns NULL.
+static const char *fail(json_PushParser p, json_Item *error) {
+  json_fail(&p->root, error);
+  p->state = failed;
+  p->kind = '\0';
+  return NULL;
+}
+
+static const char *fail_at(json_PushParser p, char *msg, long index) {
+  json_Item error;
+  json_set_error(&error, msg, index);
+  return fail(p, &error);
+}
+
+// Moves on from a complete value.
+static void end_value(json_PushParser p) {
+  p->state = (p->stack->count ? after_value : done);
+}
+
+// Returns a pointer just past the end of the current token, looking no further
+// than end, or NULL if the token may go on past end. Strings end after their
+// closing quote, or at a '\0' since those aren't allowed in strings. Numbers
+// end at their first non-number char, which is left for the number parser to
+// look at, as it would be within one buffer.
+static const char *find_token_end(json_PushParser p, const char *s,
+                                  const char *end) {
+  if (p->kind == '"') {
+    // Follow the escapes the same way the string decoder does, so that we
+    // agree on which quote closes the string.
+    while (s < end) {
+      if (p->escape == 0) {
+        s = json_scan_string(s, end);
+        if (s == end) break;
+      }
+      char c = *s++;
+      if (c == '\0') return s;
+      if (p->escape > 0) {
+        if (is_hex(c)) {
+          p->escape--;
+          continue;
+        }
+        p->escape = 0;  // c ends a short \u escape and counts as usual.
+      }
+      if (p->escape == 0) {
+        if (c == '"') return s;
+        if (c == '\\') p->escape = -1;
+      } else {
+        p->escape = (c == 'u' ? 4 : 0);
+      }
+    }
+    return NULL;
+  }
+
+  if (is_number(p->kind)) {
+    while (s < end && is_number_char(*s)) s++;
+    return (s < end ? s : NULL);
+  }
+
+  // It's a literal.
+  if (end - s < p->remaining) {
+    p->remaining -= (int)(end - s);
+    return NULL;
+  }
+  return s + p->remaining;
+}
+
+// Parses the whole token at token into the next item or key. Numbers may be
+// followed by one more char. Returns a pointer just past the value, or NULL
+// on error.
+static const char *parse_token(json_PushParser p, const char *token,
+                               size_t len) {
+  json_Item key;
+  json_Item *item = (p->is_key ? &key : p->item);
+  const char *last = json_parse_scalar(token, len, p->token_index, item);
+  p->kind = '\0';
+  if (last == NULL) return fail(p, item);
+  if (p->is_key) {
+    p->item = json_add_subitem(top(p), key.value.string);
+    p->state = expect_colon;
+  } else {
+    end_value(p);
+  }
+  return last + 1;
+}
+
+static int consume(json_PushParser p, const char *input, const char *end,
+                   long index);
+
+// Parses a token that was split between chunks, now that its end is known.
+// The char after it has been saved when lookahead is true.
+static int parse_split_token(json_PushParser p, int lookahead) {
+  const char *token = p->token->items;
+  const char *token_end = token + p->token->count - lookahead;
+  long index = p->token_index;
+  const char *rest = parse_token(p, token, p->token->count);
+  if (rest == NULL) return false;
+
+  // A number may have been followed by more number chars, as in 1-2; these
+  // are errors here, and so they never start a new token.
+  return consume(p, rest, token_end, index + (rest - token));
+}
+
+// Starts the token at input and parses it if it ends before end; otherwise
+// its chars are saved for the next chunk. Returns the rest of the input, or
+// NULL on error.
+static const char *start_token(json_PushParser p, const char *input,
+                               const char *end, long index, int is_key) {
+  p->kind = *input;
+  p->is_key = is_key;
+  p->token_index = index;
+  p->remaining = (*input == 'f' ? 4 : 3);
+  p->escape = 0;
+
+  // Let the scalar parser report unexpected characters.
+  if (!is_scalar_start(*input)) return parse_token(p, input, 1);
+
+  const char *token_end = find_token_end(p, input + 1, end);
+  if (token_end == NULL) {
+    p->token->count = 0;
+    array__insert_items(p->token, 0, (void *)input, (int)(end - input));
+    return end;
+  }
+  size_t len = token_end - input;
+  return parse_token(p, input, is_number(p->kind) ? len + 1 : len);
+}
+
+// Parses the chars in [input, end), where input is at the given index, and
+// returns false on error. Tokens that reach end are left unfinished.
+static int consume(json_PushParser p, const char *input, const char *end,
+                   long index) {
+  const char *start = input;
+#define index_of(s) (index + (long)((s) - start))
+
+  while (input < end) {
+    char c = *input;
+    if (is_space(c)) {
+      input++;
+      continue;
+    }
+
+    switch (p->state) {
+      case array_start:
+      case object_start:
+        if (c == (p->state == array_start ? ']' : '}')) {
+          p->stack->count--;  // The container is closed while empty.
+          end_value(p);
+          input++;
+        } else if (p->state == array_start) {
+          p->item = json_add_subitem(top(p), NULL);
+          p->state = expect_value;
+        } else {
+          p->state = expect_key;
+        }
+        break;
+
+      case expect_value:
+        if (c == '[' || c == '{') {
+          if (p->stack->count == p->max_depth) {
+            fail_at(p, "nesting too deep", index_of(input));
+            return false;
+          }
+          json_new_container(p->item, c);
+          array__new_val(p->stack, json_Item *) = p->item;
+          p->state = (c == '[' ? array_start : object_start);
+          input++;
+          break;
+        }
+        input = start_token(p, input, end, index_of(input), false);
+        if (input == NULL) return false;
+        break;
+
+      case expect_key:
+        if (c != '"') {
+          fail_at(p, "expected '\"'", index_of(input));
+          return false;
+        }
+        input = start_token(p, input, end, index_of(input), true);
+        if (input == NULL) return false;
+        break;
+
+      case expect_colon:
+        if (c != ':') {
+          fail_at(p, "expected ':'", index_of(input));
+          return false;
+        }
+        p->state = expect_value;
+        input++;
+        break;
+
+      case after_value: {
+        int in_array = (top(p)->type == item_array);
+        if (c == ',') {
+          if (in_array) {
+            p->item = json_add_subitem(top(p), NULL);
+            p->state = expect_value;
+          } else {
+            p->state = expect_key;
+          }
+          input++;
+          break;
+        }
+        if (c != (in_array ? ']' : '}')) {
+          fail_at(p, in_array ? "expected ']' or ','" : "expected '}' or ','",
+                  index_of(input));
+          return false;
+        }
+        p->stack->count--;  // The container is closed.
+        end_value(p);
+        input++;
+        break;
+      }
+
+      case done:
+        fail_at(p, "expected end of input", index_of(input));
+        return false;
+
+      case failed:
+        return false;
+    }
+  }
+  return true;
+
+#undef index_of
+}
+
+
+// Public functions.
+
+json_PushParser json_push_parser_new(json_ParseOptions options) {
+  json_PushParser p = malloc(sizeof(struct json_PushParserStruct));
+  memset(p, 0, sizeof(struct json_PushParserStruct));
+  p->root.type = item_null;
+  p->item = &p->root;
+  p->stack = array__new(16, sizeof(json_Item *));
+  p->max_depth = options.max_depth ? options.max_depth : json_max_depth;
+  p->state = expect_value;
+  p->token = array__new(64, sizeof(char));
+  return p;
+}
+
+int json_push_parser_feed(json_PushParser p, const char *chunk, size_t len) {
+  if (p->state == failed) return false;
+  const char *input = chunk, *end = chunk + len;
+  long offset = p->offset;
+  p->offset += len;
+
+  // Finish a token left over from earlier chunks.
+  if (p->kind) {
+    const char *token_end = find_token_end(p, input, end);
+    if (token_end == NULL) {
+      array__insert_items(p->token, p->token->count, (void *)input, (int)len);
+      return true;
+    }
+    int lookahead = is_number(p->kind);
+    array__insert_items(p->token, p->token->count, (void *)input,
+                        (int)(token_end - input) + lookahead);
+    if (!parse_split_token(p, lookahead)) return false;
+    input = token_end;
+  }
+
+  return consume(p, input, end, offset + (input - chunk));
+}
+
+void json_push_parser_finish(json_PushParser p, json_Item *item) {
+  // The end of the input ends any token; then it's treated like a '\0' so
+  // that unfinished input gets the same errors json_parse_n gives it.
+  if (p->kind) parse_split_token(p, false);
+  if (p->state != done && p->state != failed) {
+    const char *nul = "";
+    consume(p, nul, nul + 1, p->offset);
+  }
+  *item = p->root;
+  array__delete(p->stack);
+  array__delete(p->token);
+  free(p);
+}
@@ -0,0 +1,38 @@
+// jsonpush.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// A push parser for json that arrives in chunks, such as from a socket.
+// Each chunk is parsed as it's fed in, so parsing overlaps with receiving,
+// and only the parse state is kept between chunks - not the input itself.
+//
+// Example:
+//
+//   json_PushParser parser = json_push_parser_new(options);
+//   while ((len = recv(sock, buf, sizeof(buf), 0)) > 0) {
+//     if (!json_push_parser_feed(parser, buf, len)) break;  // Stop on errors.
+//   }
+//   json_Item item;
+//   json_push_parser_finish(parser, &item);
+//
+
+#pragma once
+
+#include "json.h"
+
+typedef struct json_PushParserStruct *json_PushParser;
+
+// Only the max_depth option applies to push parsers.
+json_PushParser json_push_parser_new(json_ParseOptions options);
+
+// Parses the next len bytes of input. Chunks may split the input anywhere,
+// including within strings, escapes, numbers, and literals. Returns false
+// once the input is known to be invalid; the error is given by finish.
+int json_push_parser_feed(json_PushParser parser, const char *chunk,
+                          size_t len);
+
+// Ends the input, sets *item to the parsed item, and deletes the parser. As
+// with json_parse, *item has type item_error if the input wasn't valid, and
+// error messages give indexes within the whole input. Unlike json_parse, any
+// non-whitespace after the value is an error.
+void json_push_parser_finish(json_PushParser parser, json_Item *item);
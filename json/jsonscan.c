@@ -0,0 +1,637 @@
+// jsonscan.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Each 64-byte block is classified into bit masks - one bit per byte - of
+// quotes, backslashes, whitespace, and operators ({}[]:,). Those masks are
+// combined with plain 64-bit arithmetic to find which quotes are escaped, which
+// bytes are inside strings, and finally which bytes are structural.
+//
+// The classification uses AVX2 or SSE2 when available, and a lookup table
+// otherwise. String contents are scanned the same way.
+//
+
+#include "jsonscan.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define have_x86_simd 1
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#include <intrin.h>
+
+static int ctz64(uint64_t x) {
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return (int)index;
+}
+#else
+#define ctz64(x) __builtin_ctzll(x)
+#endif
+
+// The scanning functions are each chosen on first use. Racing threads all pick
+// the same function, and relaxed atomic loads and stores keep the race benign.
+#define load_chosen(var)      __atomic_load_n(&(var), __ATOMIC_RELAXED)
+#define store_chosen(var, fn) __atomic_store_n(&(var), fn, __ATOMIC_RELAXED)
+
+
+// Byte classification.
+
+typedef struct {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t space;
+  uint64_t op;
+} Classes;
+
+enum { cls_quote = 1, cls_backslash = 2, cls_space = 4, cls_op = 8 };
+
+static const unsigned char char_class[256] = {
+  ['"']  = cls_quote,
+  ['\\'] = cls_backslash,
+  [' ']  = cls_space, ['\t'] = cls_space, ['\r'] = cls_space, ['\n'] = cls_space,
+  ['{']  = cls_op, ['}'] = cls_op, ['['] = cls_op, [']'] = cls_op,
+  [':']  = cls_op, [','] = cls_op
+};
+
+static void classify_scalar(const unsigned char *s, Classes *c) {
+  uint64_t quote = 0, backslash = 0, space = 0, op = 0;
+  for (int i = 0; i < 64; ++i) {
+    uint64_t k = char_class[s[i]];
+    quote     |= ((k     ) & 1) << i;
+    backslash |= ((k >> 1) & 1) << i;
+    space     |= ((k >> 2) & 1) << i;
+    op        |= ((k >> 3) & 1) << i;
+  }
+  c->quote = quote;
+  c->backslash = backslash;
+  c->space = space;
+  c->op = op;
+}
+
+#ifdef have_x86_simd
+
+// In both vector versions, the operators are found with 4 compares instead of
+// 6 since '[' | 0x20 == '{' and ']' | 0x20 == '}'.
+
+static void classify_sse2(const unsigned char *s, Classes *c) {
+  const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+  const __m128i spc = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t');
+  const __m128i cr  = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+  const __m128i open = _mm_set1_epi8('{'), close = _mm_set1_epi8('}');
+  const __m128i colon = _mm_set1_epi8(':'), comma = _mm_set1_epi8(',');
+  const __m128i bit5 = _mm_set1_epi8(0x20);
+  memset(c, 0, sizeof(Classes));
+  for (int i = 0; i < 4; ++i) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(s + 16 * i));
+    __m128i v_or_20 = _mm_or_si128(v, bit5);
+    __m128i sp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, spc),
+                                           _mm_cmpeq_epi8(v, tab)),
+                              _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                           _mm_cmpeq_epi8(v, lf)));
+    __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v_or_20, open),
+                                           _mm_cmpeq_epi8(v_or_20, close)),
+                              _mm_or_si128(_mm_cmpeq_epi8(v, colon),
+                                           _mm_cmpeq_epi8(v, comma)));
+    int shift = 16 * i;
+    c->quote     |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(v, quote)) << shift;
+    c->backslash |= (uint64_t)(uint16_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(v, backslash)) << shift;
+    c->space     |= (uint64_t)(uint16_t)_mm_movemask_epi8(sp) << shift;
+    c->op        |= (uint64_t)(uint16_t)_mm_movemask_epi8(op) << shift;
+  }
+}
+
+__attribute__((target("avx2")))
+static void classify_avx2(const unsigned char *s, Classes *c) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i spc = _mm256_set1_epi8(' '), tab = _mm256_set1_epi8('\t');
+  const __m256i cr  = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n');
+  const __m256i open = _mm256_set1_epi8('{'), close = _mm256_set1_epi8('}');
+  const __m256i colon = _mm256_set1_epi8(':'), comma = _mm256_set1_epi8(',');
+  const __m256i bit5 = _mm256_set1_epi8(0x20);
+  memset(c, 0, sizeof(Classes));
+  for (int i = 0; i < 2; ++i) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(s + 32 * i));
+    __m256i v_or_20 = _mm256_or_si256(v, bit5);
+    __m256i sp = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, spc), _mm256_cmpeq_epi8(v, tab)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, cr),  _mm256_cmpeq_epi8(v, lf)));
+    __m256i op = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v_or_20, open),
+                        _mm256_cmpeq_epi8(v_or_20, close)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, colon),
+                        _mm256_cmpeq_epi8(v, comma)));
+    int shift = 32 * i;
+    c->quote     |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(v, quote)) << shift;
+    c->backslash |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(v, backslash)) << shift;
+    c->space     |= (uint64_t)(uint32_t)_mm256_movemask_epi8(sp) << shift;
+    c->op        |= (uint64_t)(uint32_t)_mm256_movemask_epi8(op) << shift;
+  }
+}
+
+#endif
+
+typedef void (*Classifier)(const unsigned char *s, Classes *c);
+
+static Classifier classify = NULL;
+
+static Classifier pick_classifier() {
+#ifdef have_x86_simd
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return classify_avx2;
+  if (__builtin_cpu_supports("sse2")) return classify_sse2;
+#endif
+  return classify_scalar;
+}
+
+
+// Mask arithmetic.
+
+// Returns the mask of escaped bytes; *carry is 1 when the first byte of the
+// next block is escaped. Backslashes are rare, so a loop over them is cheap.
+static uint64_t find_escaped(uint64_t backslash, uint64_t *carry) {
+  uint64_t escaped = *carry;
+  backslash &= ~escaped;
+  *carry = 0;
+  while (backslash) {
+    int i = ctz64(backslash);
+    if (i == 63) {
+      *carry = 1;
+      break;
+    }
+    escaped |= 2ULL << i;
+    backslash &= ~(3ULL << i);  // Bit i+1 is escaped, so it can't escape.
+  }
+  return escaped;
+}
+
+// Bit i of the result is the xor of bits 0 through i of x.
+static uint64_t prefix_xor(uint64_t x) {
+  x ^= x << 1;
+  x ^= x << 2;
+  x ^= x << 4;
+  x ^= x << 8;
+  x ^= x << 16;
+  x ^= x << 32;
+  return x;
+}
+
+
+// String scanning.
+
+typedef const char *(*StringScanner)(const char *s, const char *end);
+
+static const unsigned char is_string_special[256] = {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // Control characters.
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  ['"'] = 1, ['\\'] = 1
+};
+
+static const char *scan_string_scalar(const char *s, const char *end) {
+  while (s < end && !is_string_special[(unsigned char)*s]) s++;
+  return s;
+}
+
+static const char *scan_ascii_scalar(const char *s, const char *end) {
+  while (s < end && !is_string_special[(unsigned char)*s] &&
+         (unsigned char)*s < 0x80) {
+    s++;
+  }
+  return s;
+}
+
+#ifdef have_x86_simd
+
+// The vector scanners use unaligned loads that stay within [s, end) and leave
+// any final partial block to the given scalar scanner. When stop_at_high is
+// true, bytes of 0x80 or more count as special, too.
+
+static inline const char *scan_sse2(const char *s, const char *end,
+                                    int stop_at_high, StringScanner scalar) {
+  const __m128i quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+  const __m128i max_ctrl = _mm_set1_epi8(0x1F);
+  for (; end - s >= 16; s += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)s);
+    __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+        _mm_cmpeq_epi8(_mm_min_epu8(v, max_ctrl), v));  // v <= 0x1F.
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+    if (stop_at_high) mask |= (uint32_t)_mm_movemask_epi8(v);
+    if (mask) return s + ctz64(mask);
+  }
+  return scalar(s, end);
+}
+
+__attribute__((target("avx2")))
+static inline const char *scan_avx2(const char *s, const char *end,
+                                    int stop_at_high, StringScanner scalar) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i max_ctrl = _mm256_set1_epi8(0x1F);
+  for (; end - s >= 32; s += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)s);
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                        _mm256_cmpeq_epi8(v, backslash)),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(v, max_ctrl), v));  // v <= 0x1F.
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+    if (stop_at_high) mask |= (uint32_t)_mm256_movemask_epi8(v);
+    if (mask) return s + ctz64(mask);
+  }
+  return scalar(s, end);
+}
+
+static const char *scan_string_sse2(const char *s, const char *end) {
+  return scan_sse2(s, end, 0, scan_string_scalar);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_string_avx2(const char *s, const char *end) {
+  return scan_avx2(s, end, 0, scan_string_scalar);
+}
+
+static const char *scan_ascii_sse2(const char *s, const char *end) {
+  return scan_sse2(s, end, 1, scan_ascii_scalar);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_ascii_avx2(const char *s, const char *end) {
+  return scan_avx2(s, end, 1, scan_ascii_scalar);
+}
+
+#endif
+
+static StringScanner scan_string = NULL;
+static StringScanner scan_ascii  = NULL;
+
+static StringScanner pick_string_scanner() {
+#ifdef have_x86_simd
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return scan_string_avx2;
+  if (__builtin_cpu_supports("sse2")) return scan_string_sse2;
+#endif
+  return scan_string_scalar;
+}
+
+static StringScanner pick_ascii_scanner() {
+#ifdef have_x86_simd
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return scan_ascii_avx2;
+  if (__builtin_cpu_supports("sse2")) return scan_ascii_sse2;
+#endif
+  return scan_ascii_scalar;
+}
+
+
+// UTF-8 validation.
+
+// Returns the number of continuation bytes after the lead byte c, or -1 if c
+// can't start a character. Overlong 2-byte forms and lead bytes past U+10FFFF
+// are rejected here; the rest are checked by the second byte.
+static int utf8_tail_len(unsigned char c) {
+  if (c < 0x80) return 0;
+  if (c < 0xC2) return -1;
+  if (c < 0xE0) return 1;
+  if (c < 0xF0) return 2;
+  if (c < 0xF5) return 3;
+  return -1;
+}
+
+static const char *scan_utf8_scalar(const char *str, const char *end) {
+  const unsigned char *s = (const unsigned char *)str;
+  const unsigned char *e = (const unsigned char *)end;
+  while (s < e) {
+    // Skip ASCII 8 bytes at a time.
+    uint64_t word;
+    if (e - s >= 8 && (memcpy(&word, s, 8), !(word & 0x8080808080808080))) {
+      s += 8;
+      continue;
+    }
+    int n = utf8_tail_len(*s);
+    if (n < 0 || e - s <= n) return (const char *)s;
+    // The second byte's range excludes overlong 3- and 4-byte forms, encoded
+    // surrogates, and code points past U+10FFFF.
+    unsigned char lo = 0x80, hi = 0xBF;
+    if (*s == 0xE0) lo = 0xA0;
+    if (*s == 0xED) hi = 0x9F;
+    if (*s == 0xF0) lo = 0x90;
+    if (*s == 0xF4) hi = 0x8F;
+    if (n && (s[1] < lo || s[1] > hi)) return (const char *)s;
+    for (int i = 2; i <= n; ++i) {
+      if ((s[i] & 0xC0) != 0x80) return (const char *)s;
+    }
+    s += n + 1;
+  }
+  return end;
+}
+
+// Returns the start of the character that contains s[-1], or s if s[-1] is
+// ASCII or s is start. Characters have at most 3 continuation bytes.
+static const char *char_start(const char *start, const char *s) {
+  for (int i = 0; i < 3 && s > start && (s[-1] & 0xC0) == 0x80; ++i) s--;
+  if (s > start && (unsigned char)s[-1] >= 0xC0) s--;
+  return s;
+}
+
+#ifdef have_x86_simd
+
+// The vector validator classifies each byte by its high nibble and the
+// previous byte's high and low nibbles through three 16-entry tables; every
+// error sets a bit that the three lookups have in common. Characters that need
+// a 3rd or 4th byte are checked by looking 2 and 3 bytes back. This is the
+// "lookup" algorithm of Keiser and Lemire, Validating UTF-8 in less than one
+// instruction per byte (2021).
+
+enum {
+  too_short  = 1 << 0,  // A lead byte not followed by enough continuations.
+  too_long   = 1 << 1,  // A continuation byte after ASCII.
+  overlong_3 = 1 << 2,
+  too_large  = 1 << 3,
+  surrogate  = 1 << 4,
+  overlong_2 = 1 << 5,
+  overlong_4 = 1 << 6,  // This bit also flags 0xF4 followed by 0x90 or more.
+  two_conts  = 1 << 7,  // Two continuations in a row; ok if a lead needs them.
+  carry      = too_short | too_long | two_conts
+};
+
+#define too_large_1000 overlong_4
+
+// Makes a 32-byte vector of two copies of a 16-entry table.
+#define table16(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// Returns the bytes of a vector shifted 32 - n bytes back by the prior vector,
+// so that byte i of the result is n bytes before byte i of input.
+#define prev_bytes(input, prior, n) \
+  _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prior, input, 0x21), \
+                     16 - (n))
+
+__attribute__((target("avx2")))
+static inline __m256i utf8_errors(__m256i input, __m256i prior) {
+  const __m256i byte_1_high = table16(
+      too_long, too_long, too_long, too_long,        // 0___ ASCII.
+      too_long, too_long, too_long, too_long,
+      two_conts, two_conts, two_conts, two_conts,    // 10__ continuations.
+      too_short | overlong_2,                        // 1100
+      too_short,                                     // 1101
+      too_short | overlong_3 | surrogate,            // 1110
+      too_short | too_large | too_large_1000 | overlong_4);  // 1111
+  const __m256i byte_1_low = table16(
+      carry | overlong_3 | overlong_2 | overlong_4,  // ____0000
+      carry | overlong_2,                            // ____0001
+      carry, carry,                                  // ____001_
+      carry | too_large,                             // ____0100
+      carry | too_large | too_large_1000,            // ____0101
+      carry | too_large | too_large_1000,            // ____011_
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000,            // ____1___
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000 | surrogate,  // ____1101
+      carry | too_large | too_large_1000,
+      carry | too_large | too_large_1000);
+  const __m256i byte_2_high = table16(
+      too_short, too_short, too_short, too_short,    // 0___ ASCII.
+      too_short, too_short, too_short, too_short,
+      too_long | overlong_2 | two_conts | overlong_3 | too_large_1000 |
+          overlong_4,                                // 1000
+      too_long | overlong_2 | two_conts | overlong_3 | too_large,  // 1001
+      too_long | overlong_2 | two_conts | surrogate | too_large,   // 101_
+      too_long | overlong_2 | two_conts | surrogate | too_large,
+      too_short, too_short, too_short, too_short);   // 11__ leads.
+  const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+  __m256i prev1 = prev_bytes(input, prior, 1);
+  __m256i prev1_high = _mm256_and_si256(_mm256_srli_epi16(prev1, 4),
+                                        low_nibble);
+  __m256i input_high = _mm256_and_si256(_mm256_srli_epi16(input, 4),
+                                        low_nibble);
+  __m256i special = _mm256_and_si256(
+      _mm256_and_si256(
+          _mm256_shuffle_epi8(byte_1_high, prev1_high),
+          _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(prev1,
+                                                           low_nibble))),
+      _mm256_shuffle_epi8(byte_2_high, input_high));
+
+  // Bytes 2 or 3 after a 3- or 4-byte lead must be continuations.
+  __m256i is_third = _mm256_subs_epu8(prev_bytes(input, prior, 2),
+                                      _mm256_set1_epi8(0xE0 - 0x80));
+  __m256i is_fourth = _mm256_subs_epu8(prev_bytes(input, prior, 3),
+                                       _mm256_set1_epi8(0xF0 - 0x80));
+  __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(is_third, is_fourth),
+                                          _mm256_set1_epi8((char)0x80));
+  return _mm256_xor_si256(must_be_cont, special);
+}
+
+// Bytes that need more bytes after them when they're in the last 3 spots.
+#define max_complete_bytes()                                                   \
+  _mm256_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, \
+                   -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,     \
+                   0xF0 - 1, 0xE0 - 1, 0xC0 - 1)
+
+// Loads the 32-byte block at s into *input. A final partial block is padded
+// with nulls, which end any character that's cut off as an error.
+#define load_block(input, s, end, tail)                      \
+  do {                                                        \
+    if ((end) - (s) < 32) {                                   \
+      memset(tail, 0, 32);                                    \
+      memcpy(tail, s, (end) - (s));                           \
+      input = _mm256_loadu_si256((const __m256i *)tail);      \
+    } else {                                                  \
+      input = _mm256_loadu_si256((const __m256i *)(s));       \
+    }                                                         \
+  } while (0)
+
+__attribute__((target("avx2")))
+static const char *scan_utf8_avx2(const char *s, const char *end) {
+  const __m256i max_complete = max_complete_bytes();
+  const char *start = s;
+  char tail[32];
+  __m256i prior = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  for (; s < end; s += 32) {
+    __m256i input, error;
+    load_block(input, s, end, tail);
+    if (_mm256_movemask_epi8(input) == 0) {
+      error = incomplete;  // ASCII can't finish a character.
+    } else {
+      error = utf8_errors(input, prior);
+      incomplete = _mm256_subs_epu8(input, max_complete);
+    }
+    // Errors are rare, so the scalar validator finds the exact byte, starting
+    // with the character that's cut off by s.
+    if (!_mm256_testz_si256(error, error)) {
+      return scan_utf8_scalar(char_start(start, s), end);
+    }
+    if (end - s < 32) return end;
+    prior = input;
+  }
+  if (!_mm256_testz_si256(incomplete, incomplete)) {
+    return scan_utf8_scalar(char_start(start, end), end);
+  }
+  return end;
+}
+
+// This finds the end of a string's clean run as scan_string_avx2 does while
+// validating the run, so the bytes are read once.
+__attribute__((target("avx2")))
+static const char *scan_string_utf8_avx2(const char *s, const char *end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i max_ctrl = _mm256_set1_epi8(0x1F);
+  const __m256i max_complete = max_complete_bytes();
+  const char *start = s;
+  char tail[32];
+  __m256i prior = _mm256_setzero_si256();
+  __m256i incomplete = _mm256_setzero_si256();
+  for (; s < end; s += 32) {
+    __m256i input, error;
+    load_block(input, s, end, tail);
+    __m256i special = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(input, quote),
+                        _mm256_cmpeq_epi8(input, backslash)),
+        _mm256_cmpeq_epi8(_mm256_min_epu8(input, max_ctrl), input));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+
+    // Only bytes up to the first special one, which ends the run, count.
+    uint32_t in_run = mask ? mask ^ (mask - 1) : ~(uint32_t)0;
+    const char *run_end = (mask && ctz64(mask) < end - s ? s + ctz64(mask)
+                                                         : end);
+    if ((_mm256_movemask_epi8(input) & in_run) == 0) {
+      error = incomplete;  // ASCII can't finish a character.
+    } else {
+      error = utf8_errors(input, prior);
+      incomplete = _mm256_subs_epu8(input, max_complete);
+      uint32_t is_ok = (uint32_t)_mm256_movemask_epi8(
+          _mm256_cmpeq_epi8(error, _mm256_setzero_si256()));
+      if ((~is_ok & in_run) == 0) error = _mm256_setzero_si256();
+    }
+    if (!_mm256_testz_si256(error, error)) {
+      return scan_utf8_scalar(char_start(start, s), run_end);
+    }
+    if (mask || end - s < 32) return run_end;
+    prior = input;
+  }
+  if (!_mm256_testz_si256(incomplete, incomplete)) {
+    return scan_utf8_scalar(char_start(start, end), end);
+  }
+  return end;
+}
+
+#endif
+
+static const char *scan_string_then_utf8(const char *s, const char *end) {
+  return scan_utf8_scalar(s, json_scan_string(s, end));
+}
+
+static StringScanner scan_utf8 = NULL;
+static StringScanner scan_string_utf8 = NULL;
+
+static StringScanner pick_utf8_scanner() {
+#ifdef have_x86_simd
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return scan_utf8_avx2;
+#endif
+  return scan_utf8_scalar;
+}
+
+static StringScanner pick_string_utf8_scanner() {
+#ifdef have_x86_simd
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return scan_string_utf8_avx2;
+#endif
+  return scan_string_then_utf8;
+}
+
+
+// Public functions.
+
+uint64_t json_scan_block(const char *block, json_ScanState *state) {
+  Classifier classify_block = load_chosen(classify);
+  if (classify_block == NULL) {
+    store_chosen(classify, classify_block = pick_classifier());
+  }
+  Classes c;
+  classify_block((const unsigned char *)block, &c);
+
+  uint64_t escaped = find_escaped(c.backslash, &state->escaped);
+  uint64_t quote = c.quote & ~escaped;
+
+  // in_string includes opening quotes but not closing quotes.
+  uint64_t in_string = prefix_xor(quote) ^ state->in_string;
+  state->in_string = (uint64_t)((int64_t)in_string >> 63);
+
+  // A scalar starts wherever a non-space, non-op byte doesn't directly follow
+  // another one; quotes don't count as predecessors so `"a"x` still indexes x.
+  uint64_t scalar = ~(c.op | c.space);
+  uint64_t nonquote_scalar = scalar & ~quote;
+  uint64_t follows_scalar = (nonquote_scalar << 1) | state->scalar;
+  state->scalar = nonquote_scalar >> 63;
+
+  uint64_t string_tail = in_string ^ quote;  // Inner bytes and closing quotes.
+  return (c.op | (scalar & ~follows_scalar)) & ~string_tail;
+}
+
+uint32_t *json_structural_index(const char *buf, size_t len) {
+  if (len >= UINT32_MAX) return NULL;
+  size_t cap = len / 8 + 128, n = 0;
+  uint32_t *index = malloc(cap * sizeof(uint32_t));
+  json_ScanState state = { 0, 0, 0 };
+  char tail[64];
+  for (size_t pos = 0; pos < len; pos += 64) {
+    const char *block = buf + pos;
+    if (len - pos < 64) {
+      // Spaces are never structural, so they're safe padding.
+      memset(tail, ' ', 64);
+      memcpy(tail, block, len - pos);
+      block = tail;
+    }
+    uint64_t mask = json_scan_block(block, &state);
+    if (n + 65 > cap) {  // Room for 64 new entries and the sentinel.
+      cap *= 2;
+      index = realloc(index, cap * sizeof(uint32_t));
+    }
+    while (mask) {
+      index[n++] = (uint32_t)(pos + ctz64(mask));
+      mask &= mask - 1;
+    }
+  }
+  index[n] = (uint32_t)len;
+  return index;
+}
+
+const char *json_scan_string(const char *s, const char *end) {
+  StringScanner scan = load_chosen(scan_string);
+  if (scan == NULL) store_chosen(scan_string, scan = pick_string_scanner());
+  return scan(s, end);
+}
+
+const char *json_scan_ascii(const char *s, const char *end) {
+  StringScanner scan = load_chosen(scan_ascii);
+  if (scan == NULL) store_chosen(scan_ascii, scan = pick_ascii_scanner());
+  return scan(s, end);
+}
+
+const char *json_scan_utf8(const char *s, const char *end) {
+  StringScanner scan = load_chosen(scan_utf8);
+  if (scan == NULL) store_chosen(scan_utf8, scan = pick_utf8_scanner());
+  return scan(s, end);
+}
+
+const char *json_scan_string_utf8(const char *s, const char *end) {
+  StringScanner scan = load_chosen(scan_string_utf8);
+  if (scan == NULL) {
+    store_chosen(scan_string_utf8, scan = pick_string_utf8_scanner());
+  }
+  return scan(s, end);
+}
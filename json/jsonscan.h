@@ -0,0 +1,48 @@
+// jsonscan.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Library-internal functions that classify json input 64 bytes at a time.
+// This is used by json.c; it's not part of the public interface.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The state carried from one 64-byte block to the next.
+// Start it out zeroed.
+typedef struct {
+  uint64_t in_string;  // All 1's if the previous block ended inside a string.
+  uint64_t escaped;    // 1 if the first byte of the next block is escaped.
+  uint64_t scalar;     // 1 if the previous block ended inside a literal/number.
+} json_ScanState;
+
+// Returns a bit mask of the structural characters in the 64 bytes at block.
+// Bit i is set when block[i] is a bracket, brace, colon, or comma outside of a
+// string, an opening quote, or the first character of a literal or number.
+uint64_t json_scan_block(const char *block, json_ScanState *state);
+
+// Returns a malloc'd list of the offsets of all structural characters in
+// buf[0, len), followed by a sentinel offset equal to len.
+// Returns NULL when len is too large for 32-bit offsets.
+uint32_t *json_structural_index(const char *buf, size_t len);
+
+// Returns a pointer to the first quote, backslash, or control character in
+// [s, end), or end if there is none. Nothing at or after end is read.
+const char *json_scan_string(const char *s, const char *end);
+
+// Returns a pointer to the first quote, backslash, control character, or
+// non-ASCII byte in [s, end), or end if there is none; that is, the end of the
+// run that can be copied into a json string as is.
+const char *json_scan_ascii(const char *s, const char *end);
+
+// Returns a pointer to the first byte in [s, end) that doesn't start a valid,
+// complete UTF-8 character, or end if there is none.
+const char *json_scan_utf8(const char *s, const char *end);
+
+// Returns json_scan_string(s, end), unless some byte before that isn't part of
+// a valid, complete UTF-8 character; then the first such byte is returned. It
+// is never ASCII, so it can't be mistaken for the end of the string's run.
+const char *json_scan_string_utf8(const char *s, const char *end);
@@ -0,0 +1,346 @@
+// jsontape.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The tape parser takes the steps of json.c's parser with a json_Tokenizer, so
+// it gives the same error messages, but appends words to the tape instead of
+// building items.
+//
+
+#include "jsontape.h"
+
+#include "jsonnum.h"
+#include "jsonparse.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+#define word(type, payload) (((uint64_t)(type) << 56) | (payload))
+#define word_type(word)     ((char)((word) >> 56))
+#define word_payload(word)  ((word) & 0xFFFFFFFFFFFFFF)
+
+#define max_count 0xFFFFFF
+
+typedef struct {
+  size_t pos;    // The position of the '[' or '{' word.
+  size_t count;  // The number of elements or entries so far.
+} OpenContainer;
+
+typedef struct {
+  const char *start;    // The beginning of the input.
+  const char *end;      // Just past the end of the input.
+  Array       words;    // The tape, as uint64_t's.
+  Array       strings;  // The string buffer, as chars.
+  Array       stack;    // The open containers, as OpenContainer's.
+  char *      error;    // The error message, if any.
+} TapeParser;
+
+// The macros below expect a TapeParser *p to be in scope.
+
+#define index_of(input) ((long)((input) - p->start))
+
+#define peek(input) ((input) < p->end ? *(input) : '\0')
+
+// Records an error; returns NULL.
+static const char *fail(TapeParser *p, char *msg, long index) {
+  json_Item error;
+  json_set_error(&error, msg, index);
+  p->error = error.value.string;
+  return NULL;
+}
+
+static void add_word(TapeParser *p, char type, uint64_t payload) {
+  array__new_val(p->words, uint64_t) = word(type, payload);
+}
+
+// Adds the string at input with the given type, '"' or 'k'. At the end, input
+// points to the closing quote.
+static const char *add_string(TapeParser *p, const char *input, char type) {
+  Array strings = p->strings;
+  size_t offset = strings->count;
+  uint32_t len = 0;
+  array__insert_items(strings, strings->count, &len, sizeof(len));
+  json_Item error;
+  input = json_decode_string(input, p->end, index_of(input), strings, &error);
+  if (input == NULL) {
+    p->error = error.value.string;
+    return NULL;
+  }
+  len = (uint32_t)(strings->count - offset - sizeof(len));
+  memcpy(strings->items + offset, &len, sizeof(len));
+  array__new_val(strings, char) = '\0';
+  add_word(p, type, offset);
+  return input;
+}
+
+// Adds a number, string, or literal. At the end, input points to its last
+// character.
+static const char *add_scalar(TapeParser *p, const char *input) {
+  char c = peek(input);
+
+  if (c == '-' || ('0' <= c && c <= '9')) {
+    json_Item item;
+    const char *end;
+    char *msg = json_parse_number(input, p->end, &item, &end);
+    if (msg) return fail(p, msg, index_of(end));
+    uint64_t bits;
+    if (item.type == item_integer) {
+      add_word(p, 'l', 0);
+      memcpy(&bits, &item.value.integer, sizeof(bits));
+    } else {
+      add_word(p, 'd', 0);
+      memcpy(&bits, &item.value.number, sizeof(bits));
+    }
+    array__new_val(p->words, uint64_t) = bits;
+    return end - 1;
+  }
+
+  if (c == '"') return add_string(p, input, '"');
+
+  json_ItemType type;
+  char *msg;
+  const char *last = json_parse_literal(input, p->end, &type, &msg);
+  if (last == NULL) return fail(p, msg, index_of(input));
+  add_word(p, c, 0);
+  return last;
+}
+
+// Adds the closing word of the container that opened at pos, and fills in the
+// opening word.
+static void close_container(TapeParser *p, size_t pos, size_t count) {
+  uint64_t *words = (uint64_t *)p->words->items;
+  char type = word_type(words[pos]);
+  size_t close = p->words->count;
+  if (count > max_count) count = max_count;
+  words[pos] = word(type, ((uint64_t)count << 32) | close);
+  add_word(p, type == '[' ? ']' : '}', pos);
+}
+
+// Adds the words for each step through the value that t reads. Returns a
+// pointer just past the value and any trailing whitespace.
+static const char *add_value(TapeParser *p, json_Tokenizer *t) {
+  for (;;) {
+    json_TokenType token = json_next_token(t);
+    if (p->stack->count && (token == json_token_open ||
+                            token == json_token_scalar)) {
+      // Each element or entry has one value.
+      OpenContainer *open = (OpenContainer *)array__item_ptr(
+          p->stack, p->stack->count - 1);
+      open->count++;
+    }
+    const char *last;
+    switch (token) {
+      case json_token_open: {
+        OpenContainer open = { .pos = p->words->count, .count = 0 };
+        add_word(p, *t->input, 0);
+        array__add_item_val(p->stack, open);
+        break;
+      }
+      case json_token_close: {
+        OpenContainer *open = (OpenContainer *)array__item_ptr(
+            p->stack, p->stack->count - 1);
+        close_container(p, open->pos, open->count);
+        p->stack->count--;
+        break;
+      }
+      case json_token_key:
+        last = add_string(p, t->input, 'k');
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_scalar:
+        last = add_scalar(p, t->input);
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_done:
+        return t->input;
+      default:
+        return fail(p, t->error, index_of(t->input));
+    }
+  }
+}
+
+
+// Public functions.
+
+const char *json_parse_tape(const char *buf, size_t len, json_Tape *tape,
+                            json_ParseOptions options) {
+  // These guesses for typical json are doubled as needed.
+  TapeParser parser = {
+    .start   = buf,
+    .end     = buf + len,
+    .words   = array__new((int)(len / 8) + 16, sizeof(uint64_t)),
+    .strings = array__new((int)(len / 2) + 16, sizeof(char)),
+    .stack   = array__new(16, sizeof(OpenContainer)),
+    .error   = NULL
+  };
+  TapeParser *p = &parser;
+
+  json_Tokenizer tokenizer;
+  json_tokenizer_init(&tokenizer, buf, len, options.max_depth);
+  const char *input = add_value(p, &tokenizer);
+  json_tokenizer_end(&tokenizer);
+
+  *tape = malloc(sizeof(json_TapeStruct));
+  (*tape)->error = p->error;
+  (*tape)->num_words = (p->error ? 0 : p->words->count);
+  (*tape)->words = (uint64_t *)p->words->items;
+  (*tape)->strings = p->strings->items;
+  free(p->words);
+  free(p->strings);
+  array__delete(p->stack);
+  return input;
+}
+
+void json_tape_delete(json_Tape tape) {
+  free(tape->words);
+  free(tape->strings);
+  free(tape->error);
+  free(tape);
+}
+
+json_ItemType json_tape_type(json_Tape tape, size_t pos) {
+  switch (word_type(tape->words[pos])) {
+    case '[': return item_array;
+    case '{': return item_object;
+    case '"':
+    case 'k': return item_string;
+    case 'l': return item_integer;
+    case 'd': return item_number;
+    case 't': return item_true;
+    case 'f': return item_false;
+    default:  return item_null;
+  }
+}
+
+size_t json_tape_next(json_Tape tape, size_t pos) {
+  uint64_t word = tape->words[pos];
+  switch (word_type(word)) {
+    case '[':
+    case '{': return (word & 0xFFFFFFFF) + 1;
+    case 'l':
+    case 'd': return pos + 2;
+    default:  return pos + 1;
+  }
+}
+
+size_t json_tape_count(json_Tape tape, size_t pos) {
+  size_t count = (word_payload(tape->words[pos]) >> 32);
+  if (count < max_count) return count;
+  count = 0;
+  for (pos = json_tape_first(tape, pos); pos;
+       pos = json_tape_sibling(tape, pos)) {
+    count++;
+  }
+  return count;
+}
+
+size_t json_tape_first(json_Tape tape, size_t pos) {
+  char type = word_type(tape->words[pos + 1]);
+  return (type == ']' || type == '}') ? 0 : pos + 1;
+}
+
+size_t json_tape_sibling(json_Tape tape, size_t pos) {
+  if (word_type(tape->words[pos]) == 'k') pos++;
+  pos = json_tape_next(tape, pos);
+  char type = word_type(tape->words[pos]);
+  return (type == ']' || type == '}') ? 0 : pos;
+}
+
+size_t json_tape_get(json_Tape tape, size_t pos, const char *key) {
+  size_t key_len = strlen(key);
+  for (pos = json_tape_first(tape, pos); pos;
+       pos = json_tape_sibling(tape, pos)) {
+    size_t len;
+    const char *str = json_tape_string(tape, pos, &len);
+    if (len == key_len && memcmp(str, key, len) == 0) return pos + 1;
+  }
+  return 0;
+}
+
+size_t json_tape_at(json_Tape tape, size_t pos, size_t index) {
+  for (pos = json_tape_first(tape, pos); pos && index;
+       pos = json_tape_sibling(tape, pos)) {
+    index--;
+  }
+  return pos;
+}
+
+const char *json_tape_string(json_Tape tape, size_t pos, size_t *len) {
+  const char *s = tape->strings + word_payload(tape->words[pos]);
+  if (len) {
+    uint32_t len32;
+    memcpy(&len32, s, sizeof(len32));
+    *len = len32;
+  }
+  return s + sizeof(uint32_t);
+}
+
+double json_tape_number(json_Tape tape, size_t pos) {
+  if (word_type(tape->words[pos]) == 'l') {
+    return (double)json_tape_integer(tape, pos);
+  }
+  double number;
+  memcpy(&number, &tape->words[pos + 1], sizeof(number));
+  return number;
+}
+
+int64_t json_tape_integer(json_Tape tape, size_t pos) {
+  int64_t integer;
+  memcpy(&integer, &tape->words[pos + 1], sizeof(integer));
+  return integer;
+}
+
+// This walks the value's words in order, keeping a stack of the items for the
+// open containers, so it needs no recursion.
+void json_tape_item(json_Tape tape, size_t pos, json_Item *item) {
+  size_t end = json_tape_next(tape, pos);
+  Array stack = array__new(16, sizeof(json_Item *));
+  char *key = NULL;
+  for (size_t next; pos < end; pos = next) {
+    char type = word_type(tape->words[pos]);
+    // Step into containers rather than over them.
+    next = (type == '[' || type == '{') ? pos + 1 : json_tape_next(tape, pos);
+    if (type == ']' || type == '}') {
+      stack->count--;
+      continue;
+    }
+    if (type == 'k') {
+      size_t len;
+      const char *str = json_tape_string(tape, pos, &len);
+      key = malloc(len + 1);
+      memcpy(key, str, len + 1);
+      continue;
+    }
+
+    json_Item *slot = item;
+    if (stack->count) {
+      slot = json_add_subitem(array__item_val(stack, stack->count - 1,
+                                              json_Item *), key);
+      key = NULL;
+    }
+    slot->is_borrowed = false;
+    slot->type = json_tape_type(tape, pos);
+    if (type == '[' || type == '{') {
+      json_new_container(slot, type);
+      array__new_val(stack, json_Item *) = slot;
+    } else if (type == '"') {
+      size_t len;
+      const char *str = json_tape_string(tape, pos, &len);
+      slot->value.string = malloc(len + 1);
+      memcpy(slot->value.string, str, len + 1);
+    } else if (type == 'l') {
+      slot->value.integer = json_tape_integer(tape, pos);
+    } else if (type == 'd') {
+      slot->value.number = json_tape_number(tape, pos);
+    } else {
+      slot->value.boolean = (type == 't');
+    }
+  }
+  array__delete(stack);
+}
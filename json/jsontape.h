@@ -0,0 +1,94 @@
+// jsontape.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// A flat parse target. A tape holds a parsed value as one array of 64-bit
+// words in input order, plus one buffer of decoded strings, so a whole
+// document takes a handful of allocations and is read by walking memory in
+// order.
+//
+// Each value is a word whose top byte gives its type, with these payloads:
+//
+//   '[', '{'  The element count in bits 32-55 (saturated at 2^24 - 1), and
+//             the position of the matching ']' or '}' in the low 32 bits.
+//   ']', '}'  The position of the matching '[' or '{'.
+//   '"', 'k'  The offset in strings of a string value or object key; it's
+//             preceded there by its uint32_t length and followed by a '\0'.
+//   'l', 'd'  Nothing; the next word holds an int64_t or a double.
+//   't', 'f', 'n'  Nothing.
+//
+// Object entries are a 'k' word followed by the value's words. Values are
+// found by their position, the index of their first word; the top-level
+// value is at position 0, so 0 also serves as "none" below.
+//
+// Example:
+//
+//   json_Tape tape;
+//   json_parse_tape(buf, len, &tape, options);
+//   size_t user = json_tape_get(tape, 0, "user");
+//   for (size_t pos = json_tape_first(tape, user); pos;
+//        pos = json_tape_sibling(tape, pos)) {
+//     printf("key: %s\n", json_tape_string(tape, pos, NULL));
+//   }
+//   json_tape_delete(tape);
+//
+
+#pragma once
+
+#include "json.h"
+
+typedef struct {
+  uint64_t *words;
+  size_t    num_words;
+  char *    strings;
+  char *    error;  // NULL, or an error message as json_parse would give.
+} json_TapeStruct;
+
+typedef json_TapeStruct *json_Tape;
+
+// Parses buf[0, len) into a new tape at *tape and returns the tail, as
+// json_parse_n does. On error, NULL is returned and (*tape)->error is set.
+// The in_situ and use_index options don't apply. Delete the tape either way.
+const char *json_parse_tape(const char *buf, size_t len, json_Tape *tape,
+                            json_ParseOptions options);
+
+void json_tape_delete(json_Tape tape);
+
+// Returns the type of the value at pos. Keys are item_string.
+json_ItemType json_tape_type(json_Tape tape, size_t pos);
+
+// Returns the position just past the value at pos, skipping over containers.
+size_t json_tape_next(json_Tape tape, size_t pos);
+
+// Returns the number of elements or entries in the array or object at pos.
+size_t json_tape_count(json_Tape tape, size_t pos);
+
+// Returns the position of the first element or key in the array or object at
+// pos, or 0 if it's empty.
+size_t json_tape_first(json_Tape tape, size_t pos);
+
+// Returns the position of the element or key after the one at pos in the same
+// container, or 0 if it's the last. An object's value follows its key at
+// pos + 1.
+size_t json_tape_sibling(json_Tape tape, size_t pos);
+
+// Returns the position of key's value in the object at pos, or 0 if key isn't
+// there.
+size_t json_tape_get(json_Tape tape, size_t pos, const char *key);
+
+// Returns the position of the element at index in the array at pos, or 0 if
+// index is out of range.
+size_t json_tape_at(json_Tape tape, size_t pos, size_t index);
+
+// Returns the string or key at pos, and sets *len to its length if len isn't
+// NULL. The string is owned by the tape.
+const char *json_tape_string(json_Tape tape, size_t pos, size_t *len);
+
+// Returns the number at pos; integers are converted to doubles.
+double json_tape_number(json_Tape tape, size_t pos);
+
+// Returns the integer at pos.
+int64_t json_tape_integer(json_Tape tape, size_t pos);
+
+// Copies the value at pos into a new item, as json_parse would make it.
+void json_tape_item(json_Tape tape, size_t pos, json_Item *item);
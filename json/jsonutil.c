@@ -22,6 +22,13 @@ Array json_array() {
   return array;
 }
 
+int64_t json_number_to_int(double d) {
+  if (d != d) return 0;
+  if (d >= 9223372036854775808.0) return INT64_MAX;
+  if (d <= -9223372036854775808.0) return INT64_MIN;
+  return (int64_t)d;
+}
+
 // Internal; checks the start of fmt against item and leaves fmt pointing
 // to the unparsed tail. Returns true iff item matches the start of fmt.
 static int json_item_has_format_(json_Item item, char **fmt) {
@@ -61,7 +68,9 @@ static int json_item_has_format_(json_Item item, char **fmt) {
   for (int i = 0; i < array_size(char_type_pairs); ++i) {
     if (**fmt == char_type_pairs[i].type_char ) {
       (*fmt)++;
-      return item.type == char_type_pairs[i].item_type;
+      json_ItemType type = char_type_pairs[i].item_type;
+      return item.type == type ||
+             (type == item_number && item.type == item_integer);
     }
   }
 
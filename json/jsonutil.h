@@ -22,6 +22,10 @@
 
 Array json_array();  // Returns an empty Array of json items.
 
+// Returns d truncated toward zero, clamped to the range of int64_t; NaN gives
+// 0. A plain cast would be undefined for these values.
+int64_t json_number_to_int(double d);
+
 // For now the json_Item helper macros do zero bounds or key checking.
 // In the future, I'm considering adding an optional flag that could
 // control bounds/key-checking at compile time. Perhaps on-by-default is
@@ -35,9 +39,18 @@ Array json_array();  // Returns an empty Array of json items.
 #define _item_at(arr_itm, idx) \
     (*(json_Item *)array__item_ptr((arr_itm).value.array, idx))
 
+// item_num and item_int each convert from the other kind of number; item_int
+// clamps numbers that are out of range.
 #define item_str(str_itm) ((str_itm).value.string)
-#define item_num(num_itm) ((num_itm).value.number)
+#define item_num(num_itm) \
+    ((num_itm).type == item_integer ? (double)(num_itm).value.integer : \
+                                      (num_itm).value.number)
+#define item_int(int_itm) \
+    ((int_itm).type == item_number ? \
+         json_number_to_int((int_itm).value.number) : (int_itm).value.integer)
 #define str_at(arr_itm, idx) item_str(item_at(arr_itm, idx))
+#define num_at(arr_itm, idx) item_num(item_at(arr_itm, idx))
+#define int_at(arr_itm, idx) item_int(item_at(arr_itm, idx))
 #define bool_at(arr_itm, idx) ((item_at(arr_itm, idx)).type == item_true)
 
 // json_Item getters
@@ -52,9 +65,9 @@ Array json_array();  // Returns an empty Array of json items.
 // json_Item creators
 // The item needs to be released iff 'new' or 'copy' is in its name.
 
-#define true_item ((json_Item){  .type = item_true })
-#define false_item ((json_Item){ .type = item_false })
-#define error_item ((json_Item){ .type = item_error })
+#define true_item  ((json_Item){ .type = item_true,  .is_borrowed = 0 })
+#define false_item ((json_Item){ .type = item_false, .is_borrowed = 0 })
+#define error_item ((json_Item){ .type = item_error, .is_borrowed = 0 })
 
 // Pointer conversion
 
@@ -64,16 +77,24 @@ void *item_copy_ptr(json_Item item);
 #ifndef _WIN32
 
 #define copy_str_item(str) \
-    ((json_Item){ .type = item_string, .value.string = strdup(str) })
+    ((json_Item){ .type = item_string, .is_borrowed = 0, \
+                  .value.string = strdup(str) })
 
 #define wrap_str_item(str) \
-    ((json_Item){ .type = item_string, .value.string = (char *)str })
+    ((json_Item){ .type = item_string, .is_borrowed = 0, \
+                  .value.string = (char *)str })
 
 #define new_arr_item() \
-    ((json_Item){ .type = item_array,  .value.array = json_array() })
+    ((json_Item){ .type = item_array, .is_borrowed = 0, \
+                  .value.array = json_array() })
 
 #define num_item(num) \
-    ((json_Item){ .type = item_number, .value.number = num })
+    ((json_Item){ .type = item_number, .is_borrowed = 0, \
+                  .value.number = num })
+
+#define int_item(num) \
+    ((json_Item){ .type = item_integer, .is_borrowed = 0, \
+                  .value.integer = num })
 
 #else
 
@@ -82,6 +103,7 @@ void *item_copy_ptr(json_Item item);
 __inline json_Item copy_str_item(const char *s) {
   json_Item item;
   item.type = item_string;
+  item.is_borrowed = 0;
   item.value.string = _strdup(s);
   return item;
 }
@@ -93,6 +115,7 @@ __inline json_Item copy_str_item(const char *s) {
 __inline json_Item _wrap_str_item(char *s) {
   json_Item item;
   item.type = item_string;
+  item.is_borrowed = 0;
   item.value.string = s;
   return item;
 }
@@ -100,6 +123,7 @@ __inline json_Item _wrap_str_item(char *s) {
 __inline json_Item new_arr_item() {
   json_Item item;
   item.type = item_array;
+  item.is_borrowed = 0;
   item.value.array = json_array();
   return item;
 }
@@ -107,10 +131,19 @@ __inline json_Item new_arr_item() {
 __inline json_Item num_item(double val) {
   json_Item item;
   item.type = item_number;
+  item.is_borrowed = 0;
   item.value.number = val;
   return item;
 }
 
+__inline json_Item int_item(int64_t val) {
+  json_Item item;
+  item.type = item_integer;
+  item.is_borrowed = 0;
+  item.value.integer = val;
+  return item;
+}
+
 #endif
 
 // TODO Clean up the comments for json_item_has_format.
@@ -122,7 +155,7 @@ __inline json_Item num_item(double val) {
 // t true
 // f false
 // n null
-// # number
+// # number (either item_number or item_integer)
 //
 // For now I'm leaving out object formats.
 // In the future, they could take a form like this:
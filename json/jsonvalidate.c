@@ -0,0 +1,165 @@
+// jsonvalidate.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The validator takes the steps of json.c's parser with a json_Tokenizer, which
+// keeps only one bit per open container - whether it's an object - in a
+// fixed-size stack.
+//
+
+#include "jsonvalidate.h"
+
+#include "jsonnum.h"
+#include "jsonparse.h"
+#include "jsonscan.h"
+
+#include <string.h>
+
+#define true  1
+#define false 0
+
+typedef struct {
+  const char *start;  // The beginning of the input.
+  const char *end;    // Just past the end of the input.
+  json_Error *error;  // Where to describe the error, or NULL.
+} Validator;
+
+#define is_hex(c) \
+  (('0' <= (c) && (c) <= '9') || ('a' <= (c) && (c) <= 'f') || \
+   ('A' <= (c) && (c) <= 'F'))
+
+// The macros below expect a Validator *v to be in scope.
+
+#define peek(input) ((input) < v->end ? *(input) : '\0')
+
+// Describes the error at input; returns NULL.
+static const char *fail(Validator *v, json_ErrorCode code,
+                        const char *message, const char *input) {
+  json_Error *error = v->error;
+  if (error == NULL) return NULL;
+  error->code = code;
+  error->message = message;
+  error->offset = input - v->start;
+  error->line = 1;
+  const char *line_start = v->start;
+  for (const char *s = v->start; s < input; ++s) {
+    if (*s == '\n') {
+      error->line++;
+      line_start = s + 1;
+    }
+  }
+  error->column = input - line_start + 1;
+  return NULL;
+}
+
+// Checks the string whose opening quote is at input. At the end, input points
+// to the closing quote.
+static const char *check_string(Validator *v, const char *input) {
+  const char *s = input + 1;
+  for (;;) {
+    const char *run_end = json_scan_string_utf8(s, v->end);
+    if (run_end == v->end) {
+      return fail(v, json_error_string, "string not closed", run_end);
+    }
+    s = run_end;
+    if (*s == '"') return s;
+    if ((unsigned char)*s >= 0x80) {
+      return fail(v, json_error_utf8, "invalid UTF-8", s);
+    }
+    if (*s != '\\') {
+      return fail(v, json_error_string, "control character in string", s);
+    }
+    char c = peek(s + 1);
+    if (c == 'u') {
+      // Unpaired surrogates are accepted, as the parser decodes them to
+      // U+FFFD.
+      for (int i = 2; i < 6; ++i) {
+        if (!is_hex(peek(s + i))) {
+          return fail(v, json_error_string, "invalid escape", s);
+        }
+      }
+      s += 6;
+    } else if (c && strchr("\"\\/bfnrt", c)) {
+      s += 2;
+    } else {
+      return fail(v, json_error_string, "invalid escape", s);
+    }
+  }
+}
+
+// Checks a number, string, or literal. At the end, input points to its last
+// character.
+static const char *check_scalar(Validator *v, const char *input) {
+  char c = peek(input);
+
+  if (c == '-' || ('0' <= c && c <= '9')) {
+    json_Item item;
+    const char *end;
+    char *msg = json_parse_number(input, v->end, &item, &end);
+    if (msg) return fail(v, json_error_number, msg, end);
+    return end - 1;
+  }
+
+  if (c == '"') return check_string(v, input);
+
+  json_ItemType type;
+  char *msg;
+  const char *last = json_parse_literal(input, v->end, &type, &msg);
+  if (last == NULL) return fail(v, json_error_syntax, msg, input);
+  return last;
+}
+
+// Checks each step through the value that t reads. Returns a pointer just
+// past the value and any trailing whitespace.
+static const char *check_value(Validator *v, json_Tokenizer *t) {
+  for (;;) {
+    const char *last;
+    switch (json_next_token(t)) {
+      case json_token_open:
+      case json_token_close:
+        break;
+      case json_token_key:
+        last = check_string(v, t->input);
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_scalar:
+        last = check_scalar(v, t->input);
+        if (last == NULL) return NULL;
+        t->input = last;
+        break;
+      case json_token_done:
+        return t->input;
+      case json_token_too_deep:
+        return fail(v, json_error_depth, t->error, t->input);
+      default:
+        return fail(v, json_error_syntax, t->error, t->input);
+    }
+  }
+}
+
+
+// Public functions.
+
+int json_validate(const char *buf, size_t len, json_Error *error) {
+  Validator validator = {
+    .start = buf,
+    .end   = buf + len,
+    .error = error
+  };
+  Validator *v = &validator;
+
+  json_Tokenizer tokenizer;
+  json_tokenizer_init(&tokenizer, buf, len, json_max_depth);
+  const char *input = check_value(v, &tokenizer);
+  json_tokenizer_end(&tokenizer);
+  if (input == NULL) return false;
+  if (input < v->end) {
+    fail(v, json_error_trailing, "expected end of input", input);
+    return false;
+  }
+  if (error) {
+    *error = (json_Error){ .code = json_error_none, .message = NULL };
+  }
+  return true;
+}
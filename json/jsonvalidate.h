@@ -0,0 +1,48 @@
+// jsonvalidate.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// Validation without parsing. json_validate checks that a buffer holds exactly
+// one well-formed json value, including that its strings are valid UTF-8, and
+// never allocates memory, so bad input can be rejected for about the cost of
+// reading it.
+//
+// Example:
+//
+//   json_Error error;
+//   if (!json_validate(buf, len, &error)) {
+//     printf("%s at line %zu, column %zu\n", error.message, error.line,
+//            error.column);
+//   }
+//
+
+#pragma once
+
+#include "json.h"
+
+typedef enum {
+  json_error_none,
+  json_error_syntax,     // A missing or unexpected character.
+  json_error_number,     // A malformed number.
+  json_error_string,     // An unclosed string, a bad escape, or a control
+                         // character in a string.
+  json_error_utf8,       // A string with bytes that aren't valid UTF-8.
+  json_error_depth,      // Containers nested more than json_max_depth deep.
+  json_error_trailing    // Something other than whitespace after the value.
+} json_ErrorCode;
+
+typedef struct {
+  json_ErrorCode code;
+  const char *   message;  // A static description, such as "expected ':'".
+  size_t         offset;   // The byte offset of the error.
+  size_t         line;     // The 1-based line and byte column of the error,
+  size_t         column;   // which are found only when there is one.
+} json_Error;
+
+// Returns true if buf[0, len) is a single json value with optional whitespace
+// around it. Otherwise returns false and, if error isn't NULL, describes the
+// first problem in *error.
+//
+// This is stricter than json_parse, which accepts control characters and
+// unknown escapes in strings and content after the value.
+int json_validate(const char *buf, size_t len, json_Error *error);
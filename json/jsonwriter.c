@@ -0,0 +1,223 @@
+// jsonwriter.c
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// The writer keeps just enough state to place separators and indentation: the
+// depth, whether the innermost container is still empty, and whether a key was
+// just written. Debug builds also keep one bit per open container, as the
+// validator does, to check the calls.
+//
+
+#include "jsonwriter.h"
+
+#include "jsonoutput.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define true  1
+#define false 0
+
+struct json_WriterStruct {
+  json_Output out;
+  json_Sink   sink;
+  int         depth;      // The number of open containers.
+  int         is_empty;   // True when the innermost container has no items.
+  int         after_key;  // True when the next value follows a key.
+#ifdef DEBUG
+  uint64_t    is_object[json_max_depth / 64];  // One bit per open container.
+  int         is_done;    // True once the top-level value is complete.
+#endif
+};
+
+#ifdef DEBUG
+
+#define in_object(w) \
+  ((w)->depth && \
+   ((w)->is_object[((w)->depth - 1) / 64] >> (((w)->depth - 1) % 64)) & 1)
+
+#define check(cond, msg) \
+  if (!(cond)) { \
+    fprintf(stderr, "json_Writer: %s\n", msg); \
+    abort(); \
+  }
+
+// Notes that a value is complete.
+#define end_value(w) \
+  if ((w)->depth == 0) (w)->is_done = true
+
+#else
+
+#define check(cond, msg)
+
+#define end_value(w)
+
+#endif
+
+// Writes what goes before a value or key: a comma, and in pretty output, a
+// newline and indentation. Nothing goes between a key and its value.
+static void start_item(json_Writer w) {
+  if (w->after_key) {
+    w->after_key = false;
+    return;
+  }
+  if (w->depth == 0) return;
+  if (!w->is_empty) json_out_char(&w->out, ',');
+  w->is_empty = false;
+  if (w->out.flags & json_pretty) {
+    json_out_char(&w->out, '\n');
+    json_out_indent(&w->out, 2 * w->depth);
+  }
+}
+
+// Checks and starts a value.
+static void start_value(json_Writer w) {
+  check(!in_object(w) || w->after_key, "expected a key before the value");
+  check(!w->is_done, "the top-level value is already complete");
+  start_item(w);
+}
+
+static void begin(json_Writer w, char bracket) {
+  start_value(w);
+  check(w->depth < json_max_depth, "nesting too deep");
+#ifdef DEBUG
+  uint64_t bit = (uint64_t)1 << (w->depth % 64);
+  if (bracket == '{') {
+    w->is_object[w->depth / 64] |= bit;
+  } else {
+    w->is_object[w->depth / 64] &= ~bit;
+  }
+#endif
+  json_out_char(&w->out, bracket);
+  w->depth++;
+  w->is_empty = true;
+}
+
+static void end(json_Writer w, char bracket) {
+  check(w->depth > 0, "nothing to end");
+  check(in_object(w) == (bracket == '}'),
+        bracket == '}' ? "expected the end of an array" :
+                         "expected the end of an object");
+  check(!w->after_key, "expected a value after the key");
+  w->depth--;
+  if (!w->is_empty && (w->out.flags & json_pretty)) {
+    json_out_char(&w->out, '\n');
+    json_out_indent(&w->out, 2 * w->depth);
+  }
+  json_out_char(&w->out, bracket);
+  w->is_empty = false;
+  end_value(w);
+}
+
+
+// Public functions.
+
+json_Writer json_writer_new(int flags) {
+  json_Writer w = calloc(1, sizeof(struct json_WriterStruct));
+  w->out = (json_Output){ .buf = malloc(256), .len = 0, .cap = 256,
+                          .can_grow = true, .flags = flags };
+  return w;
+}
+
+json_Writer json_writer_new_to_sink(json_Sink sink, int flags) {
+  json_Writer w = calloc(1, sizeof(struct json_WriterStruct));
+  w->sink = sink;
+  w->out = (json_Output){ .buf = malloc(json_sink_buffer_size), .len = 0,
+                          .cap = json_sink_buffer_size, .can_grow = false,
+                          .sink = &w->sink, .flags = flags };
+  return w;
+}
+
+void json_writer_delete(json_Writer w) {
+  free(w->out.buf);
+  free(w);
+}
+
+const char *json_writer_output(json_Writer w, size_t *len) {
+  check(w->out.sink == NULL, "output goes to a sink");
+  json_out_char(&w->out, '\0');
+  w->out.len--;
+  if (len) *len = w->out.len;
+  return w->out.buf;
+}
+
+int json_writer_flush(json_Writer w) {
+  if (w->out.sink) json_out_flush(&w->out);
+  return !w->out.sink_failed;
+}
+
+void json_writer_reset(json_Writer w) {
+  w->out.len = 0;
+  w->out.sink_failed = false;
+  w->depth = 0;
+  w->is_empty = false;
+  w->after_key = false;
+#ifdef DEBUG
+  w->is_done = false;
+#endif
+}
+
+void json_writer_begin_object(json_Writer w) {
+  begin(w, '{');
+}
+
+void json_writer_end_object(json_Writer w) {
+  end(w, '}');
+}
+
+void json_writer_begin_array(json_Writer w) {
+  begin(w, '[');
+}
+
+void json_writer_end_array(json_Writer w) {
+  end(w, ']');
+}
+
+void json_writer_key(json_Writer w, const char *key) {
+  check(in_object(w), "a key outside of an object");
+  check(!w->after_key, "expected a value after the key");
+  start_item(w);
+  json_out_string(&w->out, key, strlen(key));
+  json_out_char(&w->out, ':');
+  if (w->out.flags & json_pretty) json_out_char(&w->out, ' ');
+  w->after_key = true;
+}
+
+void json_writer_string(json_Writer w, const char *str) {
+  json_writer_string_n(w, str, strlen(str));
+}
+
+void json_writer_string_n(json_Writer w, const char *str, size_t len) {
+  start_value(w);
+  json_out_string(&w->out, str, len);
+  end_value(w);
+}
+
+void json_writer_number(json_Writer w, double number) {
+  start_value(w);
+  json_out_number(&w->out, number);
+  end_value(w);
+}
+
+void json_writer_integer(json_Writer w, int64_t integer) {
+  start_value(w);
+  json_out_integer(&w->out, integer);
+  end_value(w);
+}
+
+void json_writer_bool(json_Writer w, int boolean) {
+  start_value(w);
+  if (boolean) {
+    json_out_literal(&w->out, "true");
+  } else {
+    json_out_literal(&w->out, "false");
+  }
+  end_value(w);
+}
+
+void json_writer_null(json_Writer w) {
+  start_value(w);
+  json_out_literal(&w->out, "null");
+  end_value(w);
+}
@@ -0,0 +1,73 @@
+// jsonwriter.h
+//
+// https://github.com/tylerneylon/cstructs-json
+//
+// A writer that produces json directly from calls for each value, so data can
+// be serialized without first building json_Items. The output is what
+// json_stringify_with_flags would give for the equivalent items, and goes
+// either into a buffer that grows as needed or to a sink.
+//
+// Example:
+//
+//   json_Writer w = json_writer_new(0);
+//   json_writer_begin_object(w);
+//   json_writer_key(w, "id");
+//   json_writer_integer(w, 42);
+//   json_writer_key(w, "tags");
+//   json_writer_begin_array(w);
+//   json_writer_string(w, "a");
+//   json_writer_end_array(w);
+//   json_writer_end_object(w);
+//   printf("%s\n", json_writer_output(w, NULL));  // {"id":42,"tags":["a"]}
+//   json_writer_delete(w);
+//
+// When built with DEBUG defined, each call checks that it's valid where it
+// is, such as that a key comes before each value in an object and that the
+// end calls match the begin calls, and aborts with a message if not. Other
+// builds do no checking.
+//
+
+#pragma once
+
+#include "json.h"
+
+typedef struct json_WriterStruct *json_Writer;
+
+// Returns a new writer whose output is built up in memory. The flags are those
+// of json_stringify_with_flags.
+json_Writer json_writer_new(int flags);
+
+// Returns a new writer whose output is passed to sink through a small
+// fixed-size buffer.
+json_Writer json_writer_new_to_sink(json_Sink sink, int flags);
+
+void json_writer_delete(json_Writer w);
+
+// Returns the output so far, which is null-terminated, and sets *len to its
+// length if len isn't NULL. It stays valid until the next call with w. This is
+// only for writers without a sink.
+const char *json_writer_output(json_Writer w, size_t *len);
+
+// Passes any buffered output to the sink. Returns false if a write to the sink
+// has failed, in which case nothing more is sent to it.
+int json_writer_flush(json_Writer w);
+
+// Clears the output and state of w so it can write a new value. Reusing a
+// writer avoids allocating for each value.
+void json_writer_reset(json_Writer w);
+
+// Each writer writes one value, which may be an array or object holding other
+// values. Within an object, each value follows a call to json_writer_key.
+
+void json_writer_begin_object(json_Writer w);
+void json_writer_end_object  (json_Writer w);
+void json_writer_begin_array (json_Writer w);
+void json_writer_end_array   (json_Writer w);
+
+void json_writer_key     (json_Writer w, const char *key);
+void json_writer_string  (json_Writer w, const char *str);
+void json_writer_string_n(json_Writer w, const char *str, size_t len);
+void json_writer_number  (json_Writer w, double number);
+void json_writer_integer (json_Writer w, int64_t integer);
+void json_writer_bool    (json_Writer w, int boolean);
+void json_writer_null    (json_Writer w);
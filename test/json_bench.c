@@ -0,0 +1,988 @@
+// json_bench.c
+//
+// Home repo: https://github.com/tylerneylon/cstructs-json
+//
+// Throughput benchmarks for parsing and stringifying.
+// Run this with `make bench`.
+//
+
+#include "json/json.h"
+#include "json/jsonnum.h"
+#include "json/jsonparse.h"
+#include "json/jsonscan.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define true  1
+#define false 0
+
+#define array_size(x) (sizeof(x) / sizeof(x[0]))
+
+// Each measurement repeats until at least this many seconds have passed.
+#define min_seconds 0.5
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// Corpora.
+
+typedef struct {
+  char * buf;
+  size_t len;
+  size_t cap;
+} Text;
+
+static void text_printf(Text *text, const char *fmt, ...) {
+  va_list args;
+  for (;;) {
+    va_start(args, fmt);
+    size_t room = text->cap - text->len;
+    int n = vsnprintf(text->buf + text->len, room, fmt, args);
+    va_end(args);
+    if (n < room) {
+      text->len += n;
+      return;
+    }
+    text->cap = text->cap * 2 + n;
+    text->buf = realloc(text->buf, text->cap);
+  }
+}
+
+static Text new_text() {
+  Text text = { .buf = malloc(1024), .len = 0, .cap = 1024 };
+  text.buf[0] = '\0';
+  return text;
+}
+
+// An array of user-like records without whitespace.
+static char *records_corpus(int n) {
+  Text t = new_text();
+  text_printf(&t, "[");
+  for (int i = 0; i < n; ++i) {
+    text_printf(&t, "%s{\"id\":%d,\"name\":\"user %d\",\"active\":%s,"
+                    "\"score\":%d.%02d,\"tags\":[\"alpha\",\"beta\"],"
+                    "\"geo\":{\"lat\":%d.%04d,\"lng\":-%d.%04d},"
+                    "\"bio\":\"line one\\nline \\\"two\\\"\"}",
+                (i ? "," : ""), i, i, (i % 3 ? "true" : "false"),
+                i % 100, i % 97, i % 90, i % 9973, i % 180, i % 7919);
+  }
+  text_printf(&t, "]");
+  return t.buf;
+}
+
+// The same records, pretty-printed and so heavy on whitespace.
+static char *pretty_corpus(int n) {
+  char *compact = records_corpus(n);
+  json_Item item;
+  json_parse(compact, &item);
+  char *pretty = json_pretty_stringify(item);
+  json_release_item(&item);
+  free(compact);
+  return pretty;
+}
+
+// Telemetry-like records whose values are nearly all integers.
+static char *integers_corpus(int n) {
+  Text t = new_text();
+  text_printf(&t, "[");
+  for (int i = 0; i < n; ++i) {
+    text_printf(&t, "%s{\"ts\":%lld,\"id\":%lld,\"cpu\":%d,\"mem\":%d,"
+                    "\"rx\":%d,\"tx\":%d,\"err\":%d}",
+                (i ? "," : ""), 1700000000000LL + i * 250LL,
+                1152921504606846976LL + i * 7919LL, i % 101, 1000000 + i % 77777,
+                i * 13, i * 17 % 1000003, i % 7 == 0);
+  }
+  text_printf(&t, "]");
+  return t.buf;
+}
+
+// GeoJSON-like coordinate pairs.
+static char *numbers_corpus(int n) {
+  Text t = new_text();
+  srand(1);
+  text_printf(&t, "[");
+  for (int i = 0; i < n; ++i) {
+    text_printf(&t, "%s[%.6f,%.6f]", (i ? "," : ""),
+                rand() / (double)RAND_MAX * 360.0 - 180.0,
+                rand() / (double)RAND_MAX * 180.0 - 90.0);
+  }
+  text_printf(&t, "]");
+  return t.buf;
+}
+
+// Mostly-clean strings of varying length.
+static char *strings_corpus(int n) {
+  Text t = new_text();
+  text_printf(&t, "[");
+  for (int i = 0; i < n; ++i) {
+    text_printf(&t, "%s\"%.*s%s\"", (i ? ", " : ""), 8 + i % 56,
+                "The quick brown fox jumps over the lazy dog; "
+                "pack my box with five dozen liquor jugs.",
+                (i % 10 ? "" : " \\u00e9\\t"));
+  }
+  text_printf(&t, "]");
+  return t.buf;
+}
+
+// The same records as records_corpus, one per line.
+static char *lines_corpus(int n) {
+  char *records = records_corpus(n);
+  // Records start with '{' and end with '}'; only the separating commas
+  // between them are followed by a '{'.
+  for (char *s = strstr(records, "},{"); s; s = strstr(s + 2, "},{")) {
+    s[1] = '\n';
+  }
+  size_t len = strlen(records);
+  memmove(records, records + 1, len - 2);  // Drop the brackets.
+  records[len - 2] = '\n';
+  records[len - 1] = '\0';
+  return records;
+}
+
+typedef struct {
+  char *name;
+  char *json;
+} Corpus;
+
+
+// Parse benchmarks.
+
+typedef struct {
+  char *            name;
+  json_ParseOptions options;
+} ParseVariant;
+
+// Returns the parse throughput in MB/s; freeing the results isn't timed, nor
+// is refreshing the input for in-situ parses.
+static double parse_speed(char *json, json_ParseOptions options) {
+  size_t len = strlen(json);
+  char *input = options.in_situ ? malloc(len + 1) : json;
+  double elapsed = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    json_Item item;
+    if (options.in_situ) memcpy(input, json, len + 1);
+    double start = now();
+    json_parse_with_options(input, &item, options);
+    elapsed += now() - start;
+    json_release_item(&item);
+  }
+  if (input != json) free(input);
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_parse(Corpus *corpora, int num_corpora) {
+  ParseVariant variants[] = {
+    { "json_parse",  { 0 } },
+    { "use_index",   { .use_index = 1 } },
+    { "in_situ",     { .in_situ = 1 } },
+    { "intern_keys", { .intern_keys = 1 } }
+  };
+  printf("Parse throughput in MB/s:\n\n%-10s %10s", "corpus", "size (MB)");
+  for (int v = 0; v < array_size(variants); ++v) {
+    printf(" %12s", variants[v].name);
+  }
+  printf("\n");
+  for (int c = 0; c < num_corpora; ++c) {
+    printf("%-10s %10.1f", corpora[c].name, strlen(corpora[c].json) / 1e6);
+    for (int v = 0; v < array_size(variants); ++v) {
+      printf(" %12.1f", parse_speed(corpora[c].json, variants[v].options));
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+// Returns the push parser's throughput in MB/s when fed chunk_size bytes at a
+// time.
+static double push_speed(char *json, size_t chunk_size) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  double elapsed = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    json_Item item;
+    double start = now();
+    json_PushParser parser = json_push_parser_new(options);
+    for (size_t i = 0; i < len; i += chunk_size) {
+      size_t n = (len - i < chunk_size ? len - i : chunk_size);
+      json_push_parser_feed(parser, json + i, n);
+    }
+    json_push_parser_finish(parser, &item);
+    elapsed += now() - start;
+    json_release_item(&item);
+  }
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_push(Corpus *corpora, int num_corpora) {
+  size_t chunk_sizes[] = { 1460, 65536 };
+  printf("Push parse throughput in MB/s:\n\n%-10s %12s", "corpus",
+         "json_parse");
+  for (int i = 0; i < array_size(chunk_sizes); ++i) {
+    printf(" %9zu B", chunk_sizes[i]);
+  }
+  printf("\n");
+  json_ParseOptions options = { 0 };
+  for (int c = 0; c < num_corpora; ++c) {
+    printf("%-10s %12.1f", corpora[c].name,
+           parse_speed(corpora[c].json, options));
+    for (int i = 0; i < array_size(chunk_sizes); ++i) {
+      printf(" %11.1f", push_speed(corpora[c].json, chunk_sizes[i]));
+      fflush(stdout);
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+// Batch parse benchmarks.
+
+// Returns the batch parse throughput in MB/s.
+static double batch_speed(char *json, int num_threads) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  double elapsed = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    double start = now();
+    Array items = json_parse_batch(json, len, options, num_threads);
+    elapsed += now() - start;
+    array__delete(items);
+  }
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_batch() {
+  char *lines = lines_corpus(200000);
+  int num_cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  printf("Batch parse of %.1f MB of json lines on %d core%s:\n\n",
+         strlen(lines) / 1e6, num_cores, num_cores == 1 ? "" : "s");
+  printf("%-10s %10s %8s\n", "threads", "MB/s", "speedup");
+  double base_speed = 0;
+  int max_threads = (num_cores < 4 ? 4 : num_cores);
+  for (int n = 1;; n *= 2) {
+    if (n > max_threads) n = max_threads;
+    double speed = batch_speed(lines, n);
+    if (n == 1) base_speed = speed;
+    printf("%-10d %10.1f %7.2fx\n", n, speed, speed / base_speed);
+    fflush(stdout);
+    if (n == max_threads) break;
+  }
+  printf("\n");
+  free(lines);
+}
+
+// Returns the throughput in MB/s of parsing one big array with num_threads.
+static double array_speed(char *json, int num_threads) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  double elapsed = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    json_Item item;
+    double start = now();
+    json_parse_array(json, len, &item, options, num_threads);
+    elapsed += now() - start;
+    json_release_item(&item);
+  }
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_array() {
+  char *records = records_corpus(200000);
+  int num_cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  printf("Parse of a %.1f MB array on %d core%s:\n\n",
+         strlen(records) / 1e6, num_cores, num_cores == 1 ? "" : "s");
+  printf("%-10s %10s %8s\n", "threads", "MB/s", "speedup");
+  double base_speed = 0;
+  int max_threads = (num_cores < 4 ? 4 : num_cores);
+  for (int n = 1;; n *= 2) {
+    if (n > max_threads) n = max_threads;
+    double speed = array_speed(records, n);
+    if (n == 1) base_speed = speed;
+    printf("%-10d %10.1f %7.2fx\n", n, speed, speed / base_speed);
+    fflush(stdout);
+    if (n == max_threads) break;
+  }
+  printf("\n");
+  free(records);
+}
+
+// On-demand benchmarks.
+
+// A 200-field object with a nested user record among its fields.
+static char *wide_corpus() {
+  Text t = new_text();
+  text_printf(&t, "{");
+  for (int i = 0; i < 200; ++i) {
+    if (i == 150) {
+      text_printf(&t, "\"user\":{\"name\":\"ann\",\"id\":%d,\"karma\":%d.5},",
+                  123456, 42);
+    }
+    switch (i % 4) {
+      case 0: text_printf(&t, "\"field%d\":%d,", i, i * 31); break;
+      case 1: text_printf(&t, "\"field%d\":\"value %d\",", i, i); break;
+      case 2: text_printf(&t, "\"field%d\":[%d,%d,{\"x\":true}],", i, i, -i);
+              break;
+      case 3: text_printf(&t, "\"field%d\":{\"a\":null,\"b\":%d.25},", i, i);
+              break;
+    }
+  }
+  text_printf(&t, "\"done\":true}");
+  return t.buf;
+}
+
+// Reads the user's id and karma and field199, and returns the number of
+// documents read per second.
+static double field_speed(char *json, int use_ondemand) {
+  size_t len = strlen(json);
+  double elapsed = 0, start = now(), sum = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    if (use_ondemand) {
+      json_Value doc = json_ondemand(json, len);
+      json_Value user = json_ondemand_get(doc, "user");
+      int64_t id, n;
+      double karma;
+      json_ondemand_integer(json_ondemand_get(user, "id"), &id);
+      json_ondemand_number(json_ondemand_get(user, "karma"), &karma);
+      json_ondemand_integer(json_ondemand_get(doc, "field199"), &n);
+      sum += id + karma + n;
+    } else {
+      json_Item item;
+      json_parse_n(json, len, &item);
+      Map obj = item.value.object;
+      json_Item *user = map__get(obj, "user")->value;
+      json_Item *id = map__get(user->value.object, "id")->value;
+      json_Item *karma = map__get(user->value.object, "karma")->value;
+      json_Item *n = map__get(obj, "field199")->value;
+      sum += id->value.integer + karma->value.number + n->value.integer;
+      json_release_item(&item);
+    }
+    elapsed = now() - start;
+  }
+  if (sum == 42) printf(" ");  // Keep the reads from being optimized out.
+  return reps / elapsed;
+}
+
+// Reads the same fields as field_speed with json_extract, and returns the
+// number of documents read per second.
+static double extract_speed(char *json) {
+  size_t len = strlen(json);
+  char *pointers[] = { "/user/id", "/user/karma", "/field199" };
+  double elapsed = 0, start = now(), sum = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    for (int i = 0; i < array_size(pointers); ++i) {
+      json_Item item;
+      json_extract(json, len, pointers[i], &item);
+      sum += (item.type == item_integer ? item.value.integer :
+                                          item.value.number);
+    }
+    elapsed = now() - start;
+  }
+  if (sum == 42) printf(" ");  // Keep the reads from being optimized out.
+  return reps / elapsed;
+}
+
+static void bench_ondemand() {
+  char *wide = wide_corpus();
+  printf("Reading 3 fields of a 200-field, %zu-byte object, in docs/s:\n\n",
+         strlen(wide));
+  double parse_speed = field_speed(wide, false);
+  double ondemand_speed = field_speed(wide, true);
+  double extract = extract_speed(wide);
+  printf("%-20s %12.0f\n%-20s %12.0f %7.2fx\n%-20s %12.0f %7.2fx\n\n",
+         "json_parse_n", parse_speed, "json_ondemand", ondemand_speed,
+         ondemand_speed / parse_speed, "json_extract", extract,
+         extract / parse_speed);
+  free(wide);
+}
+
+// Tape benchmarks.
+
+// Sums the numbers in item, using an explicit stack of containers.
+static double sum_item(json_Item *item) {
+  Array stack = array__new(16, sizeof(json_Item *));
+  array__new_val(stack, json_Item *) = item;
+  double sum = 0;
+  while (stack->count) {
+    json_Item *it = array__item_val(stack, --stack->count, json_Item *);
+    if (it->type == item_integer) sum += it->value.integer;
+    if (it->type == item_number) sum += it->value.number;
+    if (it->type == item_array) {
+      array__for(json_Item *, sub, it->value.array, i) {
+        array__new_val(stack, json_Item *) = sub;
+      }
+    }
+    if (it->type == item_object) {
+      map__for(pair, it->value.object) {
+        array__new_val(stack, json_Item *) = pair->value;
+      }
+    }
+  }
+  array__delete(stack);
+  return sum;
+}
+
+// Sums the numbers on a tape, which is just a walk down its words.
+static double sum_tape(json_Tape tape) {
+  double sum = 0;
+  for (size_t pos = 0; pos < tape->num_words;) {
+    json_ItemType type = json_tape_type(tape, pos);
+    if (type == item_integer || type == item_number) {
+      sum += json_tape_number(tape, pos);
+    }
+    pos = (type == item_array || type == item_object ?
+           pos + 1 : json_tape_next(tape, pos));
+  }
+  return sum;
+}
+
+// Returns the throughput in MB/s of parsing json into items or a tape, or,
+// when traverse is true, of summing its numbers once it's parsed. Freeing
+// isn't timed.
+static double tape_speed(char *json, int use_tape, int traverse) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  double elapsed = 0, sum = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    json_Item item;
+    json_Tape tape;
+    double start = now();
+    if (use_tape) {
+      json_parse_tape(json, len, &tape, options);
+    } else {
+      json_parse_n(json, len, &item);
+    }
+    if (traverse) {
+      start = now();
+      sum += (use_tape ? sum_tape(tape) : sum_item(&item));
+    }
+    elapsed += now() - start;
+    if (use_tape) {
+      json_tape_delete(tape);
+    } else {
+      json_release_item(&item);
+    }
+  }
+  if (sum == 42) printf(" ");  // Keep the traversal from being optimized out.
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_tape(Corpus *corpora, int num_corpora) {
+  printf("Items vs tape in MB/s:\n\n%-10s %12s %12s %12s %12s\n", "corpus",
+         "item parse", "tape parse", "item walk", "tape walk");
+  for (int c = 0; c < num_corpora; ++c) {
+    printf("%-10s", corpora[c].name);
+    for (int traverse = 0; traverse < 2; ++traverse) {
+      for (int use_tape = 0; use_tape < 2; ++use_tape) {
+        printf(" %12.1f", tape_speed(corpora[c].json, use_tape, traverse));
+        fflush(stdout);
+      }
+    }
+    printf("\n");
+  }
+  printf("\n");
+}
+
+// Event parsing benchmarks.
+
+static int add_number(void *sum, double number) {
+  *(double *)sum += number;
+  return true;
+}
+
+// Returns the throughput in MB/s of summing the numbers in json, either by
+// parsing it into an item and walking that, or with parse events. Freeing the
+// item is timed, since event parsing has nothing to free.
+static double events_speed(char *json, int use_events) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  json_EventHandler handler = { .number = add_number };
+  double elapsed = 0, start = now(), sum = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    if (use_events) {
+      json_parse_events(json, len, &handler, &sum, options, NULL);
+    } else {
+      json_Item item;
+      json_parse_n(json, len, &item);
+      sum += sum_item(&item);
+      json_release_item(&item);
+    }
+    elapsed = now() - start;
+  }
+  if (sum == 42) printf(" ");  // Keep the sums from being optimized out.
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_events(Corpus *corpora, int num_corpora) {
+  printf("Summing all numbers in MB/s:\n\n%-10s %12s %12s %8s\n", "corpus",
+         "items", "events", "speedup");
+  for (int c = 0; c < num_corpora; ++c) {
+    double items_speed = events_speed(corpora[c].json, false);
+    double events = events_speed(corpora[c].json, true);
+    printf("%-10s %12.1f %12.1f %7.2fx\n", corpora[c].name, items_speed,
+           events, events / items_speed);
+    fflush(stdout);
+  }
+  printf("\n");
+}
+
+// Validation benchmarks.
+
+// Returns the throughput of json_validate in MB/s.
+static double validate_speed(char *json) {
+  size_t len = strlen(json);
+  double elapsed = 0, start = now();
+  int reps, num_valid = 0;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    num_valid += json_validate(json, len, NULL);
+    elapsed = now() - start;
+  }
+  if (num_valid != reps) printf("Unexpectedly invalid input!\n");
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_validate(Corpus *corpora, int num_corpora) {
+  json_ParseOptions options = { 0 };
+  printf("Validation vs parsing in MB/s:\n\n%-10s %12s %12s %8s\n", "corpus",
+         "json_parse", "validate", "speedup");
+  for (int c = 0; c < num_corpora; ++c) {
+    double parse = parse_speed(corpora[c].json, options);
+    double validate = validate_speed(corpora[c].json);
+    printf("%-10s %12.1f %12.1f %7.2fx\n", corpora[c].name, parse, validate,
+           validate / parse);
+    fflush(stdout);
+  }
+  printf("\n");
+}
+
+// UTF-8 benchmarks.
+
+// Strings in several scripts, with a little ASCII mixed in.
+static char *multilingual_corpus(int n) {
+  char *words[] = {
+    "caf\xC3\xA9", "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82",
+    "\xE4\xBD\xA0\xE5\xA5\xBD", "\xE3\x81\x93\xE3\x82\x93", "hello",
+    "\xF0\x9F\x98\x80", "\xCE\xB1\xCE\xB2\xCE\xB3"
+  };
+  Text t = new_text();
+  text_printf(&t, "[");
+  for (int i = 0; i < n; ++i) {
+    text_printf(&t, "%s\"", (i ? ", " : ""));
+    for (int j = 0; j < 4 + i % 13; ++j) {
+      text_printf(&t, "%s%s", (j ? " " : ""), words[(i + j * 3) % 7]);
+    }
+    text_printf(&t, "\"");
+  }
+  text_printf(&t, "]");
+  return t.buf;
+}
+
+// Returns the throughput in MB/s of copying json, when use_memcpy is true, or
+// of checking it as UTF-8.
+static double scan_speed(char *json, int use_memcpy) {
+  size_t len = strlen(json);
+  char *copy = malloc(len);
+  double elapsed = 0, start = now();
+  int reps, num_valid = 0;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    if (use_memcpy) {
+      memcpy(copy, json, len);
+      num_valid += (copy[len - 1] == json[len - 1]);
+    } else {
+      num_valid += (json_scan_utf8(json, json + len) == json + len);
+    }
+    elapsed = now() - start;
+  }
+  if (num_valid != reps) printf("Unexpectedly invalid input!\n");
+  free(copy);
+  return len * reps / elapsed / 1e6;
+}
+
+// Stringify benchmarks.
+
+enum {
+  stringify_new,     // json_stringify, which returns a new string each time.
+  stringify_into,    // json_stringify_into, reusing one buffer.
+  stringify_to,      // json_stringify_to, with a sink that only counts chars.
+  stringify_sized,   // json_stringified_length, then json_stringify_into an
+                     // exact-size buffer, as when reserving space up front.
+  stringify_pretty,  // json_pretty_stringify.
+  stringify_raw      // json_stringify_with_flags with json_raw_utf8.
+};
+
+static int count_chars(void *context, const char *chars, size_t len) {
+  *(size_t *)context += len;
+  return true;
+}
+
+// Returns the throughput of the given way to stringify in MB of output per
+// second.
+static double stringify_speed(char *json, int how) {
+  json_Item item;
+  json_parse(json, &item);
+  size_t cap = 1024, len = 0;
+  char *buf = malloc(cap);
+  double elapsed = 0, start = now();
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    if (how == stringify_into) {
+      if (!json_stringify_into(item, buf, cap, &len, 0)) {
+        cap = len + 1;
+        buf = realloc(buf, cap);
+        json_stringify_into(item, buf, cap, &len, 0);
+      }
+    } else if (how == stringify_sized) {
+      len = json_stringified_length(item, 0);
+      if (len + 1 > cap) {
+        cap = len + 1;
+        buf = realloc(buf, cap);
+      }
+      json_stringify_into(item, buf, len + 1, &len, 0);
+    } else if (how == stringify_to) {
+      len = 0;
+      json_stringify_to(item, (json_Sink){ .write = count_chars,
+                                           .context = &len }, 0);
+    } else {
+      int flags = (how == stringify_pretty ? json_pretty :
+                   how == stringify_raw    ? json_raw_utf8 : 0);
+      char *str = json_stringify_with_flags(item, flags);
+      len = strlen(str);
+      free(str);
+    }
+    elapsed = now() - start;
+  }
+  free(buf);
+  json_release_item(&item);
+  return len * reps / elapsed / 1e6;
+}
+
+// Returns the average time in ms that json_stringify_with_flags takes on the
+// parsed json, and sets *len to the output length.
+static double stringify_ms(char *json, int flags, size_t *len) {
+  json_Item item;
+  json_parse(json, &item);
+  double elapsed = 0, start = now();
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    char *str = json_stringify_with_flags(item, flags);
+    *len = strlen(str);
+    free(str);
+    elapsed = now() - start;
+  }
+  json_release_item(&item);
+  return elapsed / reps * 1e3;
+}
+
+static void bench_utf8(Corpus *corpora, int num_corpora) {
+  json_ParseOptions options = { 0 };
+  char *multilingual = multilingual_corpus(100000);
+  printf("UTF-8 validation and string throughput in MB/s:\n\n"
+         "%-12s %10s %10s %12s %12s\n", "corpus", "memcpy", "scan_utf8",
+         "json_parse", "stringify");
+  for (int c = 0; c <= num_corpora; ++c) {
+    char *name = (c < num_corpora ? corpora[c].name : "multilingual");
+    char *json = (c < num_corpora ? corpora[c].json : multilingual);
+    printf("%-12s %10.1f %10.1f %12.1f %12.1f\n", name, scan_speed(json, true),
+           scan_speed(json, false), parse_speed(json, options),
+           stringify_speed(json, stringify_new));
+    fflush(stdout);
+  }
+  printf("\nStringify with \\u escapes vs raw UTF-8:\n\n"
+         "%-12s %12s %12s %12s %12s\n", "corpus", "escaped ms", "raw ms",
+         "escaped MB", "raw MB");
+  char *names[] = { "strings", "multilingual" };
+  char *jsons[] = { corpora[num_corpora - 1].json, multilingual };
+  for (int c = 0; c < array_size(names); ++c) {
+    size_t escaped_len, raw_len;
+    double escaped_ms = stringify_ms(jsons[c], 0, &escaped_len);
+    double raw_ms = stringify_ms(jsons[c], json_raw_utf8, &raw_len);
+    printf("%-12s %12.2f %12.2f %12.2f %12.2f\n", names[c], escaped_ms,
+           raw_ms, escaped_len / 1e6, raw_len / 1e6);
+    fflush(stdout);
+  }
+  printf("\n");
+  free(multilingual);
+}
+
+// Returns the throughput in MB of output/s of stringifying item with
+// num_threads.
+static double parallel_stringify_speed(json_Item item, int num_threads) {
+  double elapsed = 0;
+  size_t len = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    double start = now();
+    char *str = json_stringify_parallel(item, 0, num_threads);
+    elapsed += now() - start;
+    len = strlen(str);
+    free(str);
+  }
+  return len * reps / elapsed / 1e6;
+}
+
+static void bench_stringify(Corpus *corpora, int num_corpora) {
+  printf("Stringify throughput in MB of output/s:\n\n"
+         "%-10s %12s %12s %12s %12s %12s\n", "corpus", "stringify", "into",
+         "sized", "to", "pretty");
+  for (int c = 0; c < num_corpora; ++c) {
+    printf("%-10s %12.1f %12.1f %12.1f %12.1f %12.1f\n", corpora[c].name,
+           stringify_speed(corpora[c].json, stringify_new),
+           stringify_speed(corpora[c].json, stringify_into),
+           stringify_speed(corpora[c].json, stringify_sized),
+           stringify_speed(corpora[c].json, stringify_to),
+           stringify_speed(corpora[c].json, stringify_pretty));
+    fflush(stdout);
+  }
+
+  char *records = records_corpus(200000);
+  json_Item item;
+  json_parse(records, &item);
+  int num_cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  printf("\nStringify of a %.1f MB array on %d core%s:\n\n",
+         strlen(records) / 1e6, num_cores, num_cores == 1 ? "" : "s");
+  printf("%-10s %10s %8s\n", "threads", "MB/s", "speedup");
+  double base_speed = 0;
+  int max_threads = (num_cores < 4 ? 4 : num_cores);
+  for (int n = 1;; n *= 2) {
+    if (n > max_threads) n = max_threads;
+    double speed = parallel_stringify_speed(item, n);
+    if (n == 1) base_speed = speed;
+    printf("%-10d %10.1f %7.2fx\n", n, speed, speed / base_speed);
+    fflush(stdout);
+    if (n == max_threads) break;
+  }
+  printf("\n");
+  json_release_item(&item);
+  free(records);
+}
+
+// Writer benchmarks.
+
+// Writes a record like those of records_corpus.
+static void write_record(json_Writer w, int i) {
+  json_writer_begin_object(w);
+  json_writer_key(w, "id");
+  json_writer_integer(w, i);
+  json_writer_key(w, "name");
+  json_writer_string(w, "user name");
+  json_writer_key(w, "active");
+  json_writer_bool(w, i % 3);
+  json_writer_key(w, "score");
+  json_writer_number(w, i % 100 + 0.25);
+  json_writer_key(w, "tags");
+  json_writer_begin_array(w);
+  json_writer_string(w, "alpha");
+  json_writer_string(w, "beta");
+  json_writer_end_array(w);
+  json_writer_end_object(w);
+}
+
+// Builds the item for the same record.
+static void build_record(json_Item *item, int i) {
+  json_new_container(item, '{');
+  *json_add_subitem(item, strdup("id")) =
+      (json_Item){ .type = item_integer, .value.integer = i };
+  *json_add_subitem(item, strdup("name")) =
+      (json_Item){ .type = item_string, .value.string = strdup("user name") };
+  json_add_subitem(item, strdup("active"))->type =
+      (i % 3 ? item_true : item_false);
+  *json_add_subitem(item, strdup("score")) =
+      (json_Item){ .type = item_number, .value.number = i % 100 + 0.25 };
+  json_Item *tags = json_add_subitem(item, strdup("tags"));
+  json_new_container(tags, '[');
+  char *strs[] = { "alpha", "beta" };
+  for (int j = 0; j < 2; ++j) {
+    *json_add_subitem(tags, NULL) =
+        (json_Item){ .type = item_string, .value.string = strdup(strs[j]) };
+  }
+}
+
+// Returns the number of records per second serialized one at a time, either
+// with a reused writer or by building, stringifying, and releasing items.
+static double record_speed(int use_writer) {
+  json_Writer w = json_writer_new(0);
+  double elapsed = 0, start = now();
+  size_t len = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    for (int i = 0; i < 1000; ++i) {
+      if (use_writer) {
+        json_writer_reset(w);
+        write_record(w, i);
+        len += strlen(json_writer_output(w, NULL));
+      } else {
+        json_Item item;
+        build_record(&item, i);
+        char *str = json_stringify(item);
+        len += strlen(str);
+        free(str);
+        json_release_item(&item);
+      }
+    }
+    elapsed = now() - start;
+  }
+  json_writer_delete(w);
+  if (len == 42) printf(" ");  // Keep the output from being optimized out.
+  return reps * 1000 / elapsed;
+}
+
+static void bench_writer() {
+  double items_speed = record_speed(false);
+  double writer_speed = record_speed(true);
+  printf("Serializing records in millions of records/s:\n\n"
+         "%-10s %12s %12s %8s\n%-10s %12.2f %12.2f %7.2fx\n\n", "", "items",
+         "writer", "speedup", "records", items_speed / 1e6, writer_speed / 1e6,
+         writer_speed / items_speed);
+}
+
+// Parse-and-free benchmarks.
+
+// Returns the number of parse-and-free cycles per second, using either
+// individually allocated items or a document.
+static double cycle_speed(char *json, int use_document) {
+  size_t len = strlen(json);
+  json_ParseOptions options = { 0 };
+  double elapsed = 0, start = now();
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    if (use_document) {
+      json_Document doc;
+      json_parse_document(json, len, &doc, options);
+      json_document_delete(doc);
+    } else {
+      json_Item item;
+      json_parse_n(json, len, &item);
+      json_release_item(&item);
+    }
+    elapsed = now() - start;
+  }
+  return reps / elapsed;
+}
+
+static void bench_documents(Corpus *corpora, int num_corpora) {
+  printf("Parse-and-free cycles/s:\n\n%-10s %12s %12s %8s\n", "corpus",
+         "items", "document", "speedup");
+  for (int c = 0; c < num_corpora; ++c) {
+    double items_speed = cycle_speed(corpora[c].json, false);
+    double doc_speed = cycle_speed(corpora[c].json, true);
+    printf("%-10s %12.2f %12.2f %7.2fx\n", corpora[c].name, items_speed,
+           doc_speed, doc_speed / items_speed);
+    fflush(stdout);
+  }
+  printf("\n");
+}
+
+// Number conversion benchmarks.
+
+// Converts every number in the whitespace-separated list nums and returns the
+// rate in millions of numbers per second.
+static double number_speed(char *nums, int count, int use_strtod) {
+  const char *limit = nums + strlen(nums);
+  double elapsed = 0, sum = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    double start = now();
+    const char *s = nums;
+    for (int i = 0; i < count; ++i) {
+      if (use_strtod) {
+        sum += strtod(s, (char **)&s);
+      } else {
+        json_Item item;
+        json_parse_number(s, limit, &item, &s);
+        sum += (item.type == item_integer ? item.value.integer :
+                                            item.value.number);
+      }
+      s++;  // Skip the separating space.
+    }
+    elapsed += now() - start;
+  }
+  if (sum == 42) printf(" ");  // Keep the conversions from being optimized out.
+  return count * reps / elapsed / 1e6;
+}
+
+// Formats count doubles from the list nums, with snprintf's %.17g or with
+// json_format_number, and returns the rate in millions of numbers per second.
+static double format_speed(char *nums, int count, int use_snprintf) {
+  double *values = malloc(count * sizeof(double));
+  char *s = nums;
+  for (int i = 0; i < count; ++i) values[i] = strtod(s, &s);
+  char buf[32];
+  double elapsed = 0;
+  size_t len = 0;
+  int reps;
+  for (reps = 0; elapsed < min_seconds; ++reps) {
+    double start = now();
+    for (int i = 0; i < count; ++i) {
+      len += (use_snprintf ? snprintf(buf, 32, "%.17g", values[i]) :
+                             json_format_number(buf, values[i]));
+    }
+    elapsed += now() - start;
+  }
+  if (len == 42) printf(" ");  // Keep the conversions from being optimized out.
+  free(values);
+  return count * reps / elapsed / 1e6;
+}
+
+static void bench_numbers() {
+  int count = 1000000;
+  Text t = new_text();
+  srand(2);
+  for (int i = 0; i < count; ++i) {
+    double r = rand() / (double)RAND_MAX;
+    switch (i % 4) {
+      case 0: text_printf(&t, "%.6f ", r * 360.0 - 180.0); break;
+      case 1: text_printf(&t, "%.17g ", r);                break;
+      case 2: text_printf(&t, "%.3e ", r * 1e30);          break;
+      case 3: text_printf(&t, "%d ", rand());              break;
+    }
+  }
+  printf("Number conversion in millions of numbers/s:\n\n");
+  printf("%-20s %8.1f\n", "strtod", number_speed(t.buf, count, true));
+  printf("%-20s %8.1f\n", "json_parse_number",
+         number_speed(t.buf, count, false));
+  printf("%-20s %8.1f\n", "snprintf %.17g", format_speed(t.buf, count, true));
+  printf("%-20s %8.1f\n\n", "json_format_number",
+         format_speed(t.buf, count, false));
+  free(t.buf);
+}
+
+int main(int argc, char **argv) {
+  Corpus corpora[] = {
+    { "records", records_corpus(40000) },
+    { "pretty",  pretty_corpus (40000) },
+    { "numbers", numbers_corpus(200000) },
+    { "integers", integers_corpus(60000) },
+    { "strings", strings_corpus(100000) }
+  };
+  bench_parse(corpora, array_size(corpora));
+  bench_push(corpora, array_size(corpora));
+  bench_batch();
+  bench_array();
+  bench_ondemand();
+  bench_tape(corpora, array_size(corpora));
+  bench_events(corpora, array_size(corpora));
+  bench_validate(corpora, array_size(corpora));
+  bench_utf8(corpora, array_size(corpora));
+  bench_stringify(corpora, array_size(corpora));
+  bench_writer();
+  bench_documents(corpora, array_size(corpora));
+  bench_numbers();
+  for (int c = 0; c < array_size(corpora); ++c) free(corpora[c].json);
+  return 0;
+}
@@ -6,10 +6,19 @@
 //
 
 #include "json/json.h"
+#include "json/jsonparse.h"
+#include "json/jsonscan.h"
 
 #include "ctest.h"
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #define true 1
 #define false 0
@@ -24,6 +33,7 @@ extern int cjson_net_arr_allocs;
 static char *item_type_names[] = {
   "item_string",
   "item_number",
+  "item_integer",
   "item_object",
   "item_array",
   "item_true",
@@ -54,21 +64,28 @@ static void check_parse(StringAndItem str_and_item) {
     return;
   }
 
-  if (parsed_item.type == item_string || parsed_item.type == item_number) {
-    if (parsed_item.type == item_string) {
-      test_that(strcmp(parsed_item.value.string, expected_item.value.string) == 0);
-    } else {
-      test_that(parsed_item.value.number == expected_item.value.number);
-    }
+  if (parsed_item.type == item_string) {
+    test_that(strcmp(parsed_item.value.string, expected_item.value.string) == 0);
+  } else if (parsed_item.type == item_number) {
+    test_that(parsed_item.value.number == expected_item.value.number);
+  } else if (parsed_item.type == item_integer) {
+    test_that(parsed_item.value.integer == expected_item.value.integer);
   }
 }
 
 int test_parse_number() {
   StringAndItem test_data[] = {
     // Non-error cases.
-    {"0", {.type = item_number, .value.number = 0.0}},
-    {"1", {.type = item_number, .value.number = 1}},
-    {"12", {.type = item_number, .value.number = 12}},
+    {"0", {.type = item_integer, .value.integer = 0}},
+    {"1", {.type = item_integer, .value.integer = 1}},
+    {"12", {.type = item_integer, .value.integer = 12}},
+    {"-7", {.type = item_integer, .value.integer = -7}},
+    {"9007199254740993", {.type = item_integer, .value.integer = 9007199254740993LL}},
+    {"9223372036854775807", {.type = item_integer, .value.integer = INT64_MAX}},
+    {"-9223372036854775808", {.type = item_integer, .value.integer = INT64_MIN}},
+    {"9223372036854775808", {.type = item_number, .value.number = 9223372036854775808.0}},
+    {"-0", {.type = item_number, .value.number = -0.0}},
+    {"1.0", {.type = item_number, .value.number = 1}},
     {"3.14", {.type = item_number, .value.number = 3.14}},
     {"-0.55", {.type = item_number, .value.number = -0.55}},
     {"1e2", {.type = item_number, .value.number = 1e2}},
@@ -87,6 +104,130 @@ int test_parse_number() {
   return test_success;
 }
 
+static uint64_t rand_state = 88172645463325252ULL;
+
+// A xorshift generator, so the test cases don't depend on the platform's rand.
+static uint64_t rand64() {
+  rand_state ^= rand_state << 13;
+  rand_state ^= rand_state >> 7;
+  rand_state ^= rand_state << 17;
+  return rand_state;
+}
+
+// Checks that json_parse and strtod agree exactly on s; integers are checked
+// against strtoll instead.
+static int parses_like_strtod(char *s) {
+  json_Item item;
+  json_parse(s, &item);
+  if (item.type == item_integer) {
+    if (item.value.integer == strtoll(s, NULL, 10)) return true;
+    test_printf("Mismatch for %s: got %lld\n", s, (long long)item.value.integer);
+    return false;
+  }
+  double expected = strtod(s, NULL);
+  if (item.type == item_number &&
+      memcmp(&item.value.number, &expected, sizeof(double)) == 0) {
+    return true;
+  }
+  test_printf("Mismatch for %s: got %.17g; strtod gave %.17g\n",
+              s, item.value.number, expected);
+  json_release_item(&item);
+  return false;
+}
+
+int test_parse_number_vs_strtod() {
+  char s[64];
+  int num_mismatches = 0;
+
+  // Doubles from random bit patterns, printed with 1 to 17 digits.
+  for (int i = 0; i < 1000000; ++i) {
+    uint64_t bits = rand64();
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    if (d != d || d - d != 0) continue;  // Skip nan and inf.
+    snprintf(s, sizeof(s), "%.*g", (i % 17) + 1, d);
+    num_mismatches += !parses_like_strtod(s);
+  }
+
+  // Random digit strings with a random decimal point and exponent, including
+  // more than 19 digits and values that underflow or overflow.
+  for (int i = 0; i < 1000000; ++i) {
+    uint64_t r = rand64();
+    int num_digits = 1 + r % 25;
+    int point = (r >> 8) % (num_digits + 1);
+    int exp = (int)((r >> 16) % 801) - 400;
+    char *t = s;
+    if ((r >> 32) & 1) *t++ = '-';
+    for (int j = 0; j < num_digits; ++j) {
+      if (j == point && j > 0) *t++ = '.';
+      *t++ = (j == 0 && num_digits > 1) ? '1' + rand64() % 9 : '0' + rand64() % 10;
+    }
+    snprintf(t, s + sizeof(s) - t, "e%d", exp);
+    num_mismatches += !parses_like_strtod(s);
+  }
+
+  // Integers between 2^53 and 2^64, where halfway cases must round to even.
+  // The e0 suffix makes them doubles even when they fit in an int64_t.
+  for (int i = 0; i < 200000; ++i) {
+    uint64_t n = (rand64() >> (rand64() % 11)) | (1ULL << 53);
+    if (i % 2) n = (n & ~0x7FFULL) | 0x400;  // Exactly halfway, often.
+    snprintf(s, sizeof(s), "%llu%s", (unsigned long long)n, (i % 4 < 2 ? "e0" : ""));
+    num_mismatches += !parses_like_strtod(s);
+  }
+
+  // Known-hard cases.
+  char *hard_cases[] = {
+    "3.14", "0.1", "0.3", "1e23", "8.98846567431158e307", "2.2250738585072011e-308",
+    "2.2250738585072014e-308", "4.9e-324", "2.4703282292062327e-324",
+    "2.4703282292062328e-324", "1.7976931348623157e308", "1.7976931348623159e308",
+    "9007199254740993", "7.2057594037927933e16", "7.3177701707893310e15",
+    "0.000000000000000000000000000000000000000000001", "123456789012345678901234567890",
+    "-0", "0e400", "1e-400", "1e400", "100000000000000000000000000000000000000000001e-44"
+  };
+  for (int i = 0; i < array_size(hard_cases); ++i) {
+    num_mismatches += !parses_like_strtod(hard_cases[i]);
+  }
+
+  test_that(num_mismatches == 0);
+  return test_success;
+}
+
+int test_integer_items() {
+  json_Item item;
+  json_parse("[12, 2.5, 9007199254740993]", &item);
+  test_that(json_item_has_format(item, "[#,#,#]"));
+  test_that(item_at(item, 0).type == item_integer);
+  test_that(item_num(item_at(item, 0)) == 12.0);
+  test_that(item_int(item_at(item, 1)) == 2);
+  test_that(int_at(item, 2) == 9007199254740993LL);
+  test_that(num_at(item, 1) == 2.5);
+
+  char *str = json_stringify(item);
+  test_str_eq(str, "[12,2.5,9007199254740993]");
+  free(str);
+  json_release_item(&item);
+
+  str = json_stringify(int_item(INT64_MIN));
+  test_str_eq(str, "-9223372036854775808");
+  free(str);
+
+  // Numbers out of the int64_t range are clamped.
+  test_that(item_int(num_item(-2.75)) == -2);
+  test_that(item_int(num_item(1e300)) == INT64_MAX);
+  test_that(item_int(num_item(-HUGE_VAL)) == INT64_MIN);
+  test_that(item_int(num_item(NAN)) == 0);
+
+  // A whole number double is written without a fraction, so it parses back
+  // as an integer item with the same value.
+  str = json_stringify(num_item(1.0));
+  test_str_eq(str, "1");
+  json_parse(str, &item);
+  test_that(item.type == item_integer && item_num(item) == 1.0);
+  free(str);
+
+  return test_success;
+}
+
 int test_parse_string() {
   StringAndItem test_data[] = {
     // Non-error cases.
@@ -104,6 +245,34 @@ int test_parse_string() {
   return test_success;
 }
 
+int test_parse_long_strings() {
+  // Clean runs of every length up to a few vector widths, followed by an
+  // escape, a raw control character, or the end of the input.
+  char json[256], expected[256];
+  char *tails[] = { "\\n\"", "\\u00e9z\"", "\t\"", "\"", "" };
+  char *decoded_tails[] = { "\n", "\xC3\xA9z", "\t", "", NULL };
+  for (int len = 0; len < 100; ++len) {
+    for (int t = 0; t < array_size(tails); ++t) {
+      json[0] = '"';
+      for (int i = 0; i < len; ++i) json[1 + i] = expected[i] = 'a' + i % 26;
+      strcpy(json + 1 + len, tails[t]);
+      test_printf("About to parse:\n%s\n", json);
+
+      json_Item item;
+      json_parse(json, &item);
+      if (decoded_tails[t] == NULL) {
+        test_that(item.type == item_error);
+      } else {
+        strcpy(expected + len, decoded_tails[t]);
+        test_that(item.type == item_string);
+        test_str_eq(item.value.string, expected);
+      }
+      json_release_item(&item);
+    }
+  }
+  return test_success;
+}
+
 int test_parse_literals() {
   StringAndItem test_data[] = {
     // Non-error cases.
@@ -285,7 +454,8 @@ int test_stringify() {
 
   // Test from items resulting from parsing.
   char *test_data[] = {"1", "null", "true", "false", "[1,2,3]", "{\"a\":3}",
-      "[1,{}]", "[\"a\",42,0.5,{\"b\":[]}]"};
+      "[1,{}]", "[\"a\",42,0.5,{\"b\":[]}]", "-9223372036854775808",
+      "[9007199254740993,-10,0]"};
   for (int i = 0; i < array_size(test_data); ++i) {
     json_Item parsed_item;
     json_parse(test_data[i], &parsed_item);
@@ -325,6 +495,59 @@ int test_unicode_escapes() {
   test_that(parsed_item.type == item_string);
   test_str_eq(parsed_item.value.string, u_str);
 
+  // Unpaired surrogates decode as U+FFFD in every decoder.
+  char *escaped[][2] = {
+    { "\"\\uDC00\"",        "\xEF\xBF\xBD" },
+    { "\"a\\uD800\"",       "a\xEF\xBF\xBD" },
+    { "\"\\uD800\\u0041\"",  "\xEF\xBF\xBD" "A" },
+    { "\"\\uD800b\"",       "\xEF\xBF\xBD" "b" },
+    { "\"\\uD800\\uD83D\\uDE00\"", "\xEF\xBF\xBD\xF0\x9F\x98\x80" }
+  };
+  for (int i = 0; i < array_size(escaped); ++i) {
+    char *str = escaped[i][0], *expected = escaped[i][1];
+    size_t len = strlen(str);
+    json_Item item;
+    char *copy = strdup(str);
+    for (int mode = 0; mode < 2; ++mode) {
+      json_ParseOptions options = { .in_situ = mode };
+      json_parse_with_options(copy, &item, options);
+      test_str_eq(item.value.string, expected);
+      json_release_item(&item);
+    }
+    free(copy);
+
+    Array chars = array__new(16, sizeof(char));
+    test_that(json_decode_string(str, str + len, 0, chars, &item) ==
+              str + len - 1);
+    array__new_val(chars, char) = '\0';
+    test_str_eq((char *)chars->items, expected);
+    array__delete(chars);
+
+    char dest[32];
+    size_t dest_len;
+    test_that(json_decode_string_to(str, str + len, dest, &dest_len) ==
+              str + len - 1);
+    test_that(dest_len == strlen(expected));
+    test_that(memcmp(dest, expected, dest_len) == 0);
+
+    // The validator accepts what the parser does, and the raw output parses
+    // back to the same string, as a value and as a key.
+    json_Error error;
+    test_that(json_validate(str, len, &error));
+    char obj[64];
+    snprintf(obj, sizeof(obj), "{%s: [%s]}", str, str);
+    json_parse(obj, &item);
+    char *raw = json_stringify_with_flags(item, json_raw_utf8);
+    json_Item reparsed;
+    test_that(json_parse(raw, &reparsed) != NULL);
+    char *raw_again = json_stringify_with_flags(reparsed, json_raw_utf8);
+    test_str_eq(raw_again, raw);
+    free(raw);
+    free(raw_again);
+    json_release_item(&item);
+    json_release_item(&reparsed);
+  }
+
   return test_success;
 }
 
@@ -343,12 +566,1935 @@ int test_parse_tail() {
   return test_success;
 }
 
+// Checks that json_parse and an indexed parse agree on str.
+static void check_indexed_parse(char *str) {
+  test_printf("About to parse with and without an index:\n%s\n", str);
+  json_ParseOptions options = { .use_index = 1 };
+  json_Item plain_item, indexed_item;
+  char *plain_tail = json_parse(str, &plain_item);
+  char *indexed_tail = json_parse_with_options(str, &indexed_item, options);
+
+  test_that(plain_tail == indexed_tail);
+  test_that(plain_item.type == indexed_item.type);
+  if (plain_item.type == item_error) {
+    // The messages include the error index, so they must match exactly.
+    test_str_eq(plain_item.value.string, indexed_item.value.string);
+  } else {
+    char *plain_str = json_stringify(plain_item);
+    char *indexed_str = json_stringify(indexed_item);
+    test_str_eq(plain_str, indexed_str);
+    free(plain_str);
+    free(indexed_str);
+  }
+  json_release_item(&plain_item);
+  json_release_item(&indexed_item);
+}
+
+int test_parse_with_index() {
+  char *test_data[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"",
+    "[\"x\\\"y\", \"{[,:]}\" , \"\\\\\", 7]", "true false", "1x",
+    "[1x]", "[1 x]", "[\"a\"x]", "[\"a\" x]", "[1 2]", "{\"a\" 1}",
+    "[1,  ", "  ", "[\"unclosed    ]", "{\"k\": [ 1.5e3 , -2 ]    }   tail",
+    // Short \u escapes end before a closing quote.
+    "[\"\\uD80\"03\" , 1]", "[\"\\uD80\"  03\"  ]", "[\"\\u1\"  , \" 1 ]",
+    "[\"\\u12\" , 3 ]"
+  };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    check_indexed_parse(test_data[i]);
+  }
+
+  // Strings and whitespace runs that straddle 64-byte block boundaries.
+  char buf[512];
+  for (int pad = 0; pad < 140; ++pad) {
+    snprintf(buf, sizeof(buf), "[%*s\"%*s\\\"\\\\\", %*s{\"k\":%*s1}]",
+             pad, "", pad % 70, "", (pad * 7) % 65, "", pad % 3, "");
+    check_indexed_parse(buf);
+  }
+
+  return test_success;
+}
+
+// Copies len bytes of s so they end right before an inaccessible page; any
+// read past the copy crashes the test. Release it with free_guarded.
+static char *guarded_copy(const char *s, size_t len, size_t *map_len) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  *map_len = (len / page + 2) * page;
+  char *map = mmap(NULL, *map_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  mprotect(map + *map_len - page, page, PROT_NONE);
+  char *copy = map + *map_len - page - len;
+  memcpy(copy, s, len);
+  return copy;
+}
+
+static void free_guarded(char *copy, size_t len, size_t map_len) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  munmap(copy + len + page - map_len, map_len);
+}
+
+// Checks that json_parse_n on the first len bytes of str, with no null after
+// them, acts just like json_parse on a null-terminated copy of those bytes.
+static void check_parse_n(char *str, size_t len, json_ParseOptions options) {
+  char *terminated = strndup(str, len);
+  size_t map_len;
+  char *unterminated = guarded_copy(str, len, &map_len);
+
+  json_Item expected_item, item;
+  char *expected_tail = json_parse(terminated, &expected_item);
+  const char *tail = json_parse_n_with_options(unterminated, len, &item,
+                                               options);
+
+  test_that((expected_tail == NULL) == (tail == NULL));
+  if (tail) test_that(tail - unterminated == expected_tail - terminated);
+  test_that(item.type == expected_item.type);
+  if (item.type == item_error) {
+    test_str_eq(item.value.string, expected_item.value.string);
+  } else {
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+  }
+  json_release_item(&expected_item);
+  json_release_item(&item);
+  free_guarded(unterminated, len, map_len);
+  free(terminated);
+}
+
+int test_parse_n() {
+  char *test_data[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"",
+    "[-12.5e-3, 0, 1E+2, 123456789012345678901234567890]", "truex",
+    "\"\\u00e9\\ud83d\\ude00\\n\"", "{\"k\": [ 1.5e3 , -2 ]    }   tail",
+    "[\"a string long enough to be scanned with vector instructions\", "
+    "\"and another with an escape \\\" near its end\"]"
+  };
+  json_ParseOptions plain = { 0 }, indexed = { .use_index = 1 };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    test_printf("About to parse every prefix of:\n%s\n", test_data[i]);
+    // Every prefix ends at a different point within a token.
+    for (size_t len = 0; len <= strlen(test_data[i]); ++len) {
+      check_parse_n(test_data[i], len, plain);
+      check_parse_n(test_data[i], len, indexed);
+    }
+  }
+
+  // The length, not a null, ends the input.
+  json_Item item;
+  char buf[] = "[1, 2]  \0 garbage";
+  const char *tail = json_parse_n(buf, sizeof(buf) - 1, &item);
+  test_that(tail == buf + 8);
+  test_that(item.type == item_array && item.value.array->count == 2);
+  json_release_item(&item);
+
+  tail = json_parse_n("\"abc\"", 3, &item);
+  test_that(tail == NULL && item.type == item_error);
+  json_release_item(&item);
+
+  // A long number of all zeros is read only up to its end.
+  char *zeros[] = { "0.00000000000000000000", "0.000000000000000000000000e9" };
+  for (int i = 0; i < array_size(zeros); ++i) {
+    size_t len = strlen(zeros[i]);
+    char *heap_buf = malloc(len);
+    memcpy(heap_buf, zeros[i], len);
+    tail = json_parse_n(heap_buf, len, &item);
+    test_that(tail == heap_buf + len);
+    test_that(item.type == item_number && item.value.number == 0.0);
+    free(heap_buf);
+    check_parse_n(zeros[i], len, plain);
+  }
+
+  return test_success;
+}
+
+// Checks that an in-situ parse of str gives the same result as a normal one.
+static void check_in_situ_parse(char *str) {
+  test_printf("About to parse in situ:\n%s\n", str);
+  char *buf = strdup(str);
+  json_ParseOptions options = { .in_situ = 1 };
+  json_Item expected_item, item;
+  char *expected_tail = json_parse(str, &expected_item);
+  char *tail = json_parse_with_options(buf, &item, options);
+
+  test_that((expected_tail == NULL) == (tail == NULL));
+  if (tail) test_that(tail - buf == expected_tail - str);
+  test_that(item.type == expected_item.type);
+  if (item.type == item_error) {
+    test_str_eq(item.value.string, expected_item.value.string);
+  } else {
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+  }
+  json_release_item(&expected_item);
+  json_release_item(&item);
+  free(buf);
+}
+
+int test_parse_in_situ() {
+  char *test_data[] = {
+    "\"abc\"", "\"\"", "\"a\\\"b\\\\c\\/d\\n\"", "\"\\u00e9\\u4e2d\\ud83d\\ude00!\"",
+    "[\"x\", [\"y\\ty\", {}], \"\\\"\"]  tail",
+    "{\"a\": \"1\", \"b\\u0062\": {\"c\": [\"\\\\\", 2]}}",
+    "[\"unclosed", "{\"k\" 1}", "{\"k\": \"v\", 3: 4}", "[\"a\", \"b\\", "\"\\u12"
+  };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    check_in_situ_parse(test_data[i]);
+  }
+
+  // Strings and keys point into the input and are released without a free.
+  char buf[] = "{\"key\": [\"plain\", \"esc\\taped\"]}";
+  json_ParseOptions options = { .in_situ = 1 };
+  json_Item item;
+  json_parse_with_options(buf, &item, options);
+  test_that(item.type == item_object);
+  map__key_value *pair = map__get(item.value.object, "key");
+  test_that(pair != NULL);
+  test_that((char *)pair->key > buf && (char *)pair->key < buf + sizeof(buf));
+  json_Item arr = *(json_Item *)pair->value;
+  for (int i = 0; i < 2; ++i) {
+    json_Item str_item = item_at(arr, i);
+    test_that(str_item.is_borrowed);
+    test_that(str_item.value.string > buf &&
+              str_item.value.string < buf + sizeof(buf));
+  }
+  test_str_eq(item_at(arr, 1).value.string, "esc\taped");
+  json_release_item(&item);
+
+  // json_parse_n accepts the option too.
+  char buf_n[] = "[\"a\\nb\"]xyz";
+  const char *tail = json_parse_n_with_options(buf_n, 8, &item, options);
+  test_that(tail == buf_n + 8);
+  test_that(item.type == item_array);
+  test_str_eq(item_at(item, 0).value.string, "a\nb");
+  test_that(item_at(item, 0).value.string == buf_n + 2);
+  json_release_item(&item);
+
+  // A string still open at the end of the input isn't written past the end.
+  char *unclosed[] = { "{\r\n\"  }\r\n  ", "[\"ab", "\"a\\", "\"\\uD800",
+                       "{\"k\": \"v\\n" };
+  for (int i = 0; i < array_size(unclosed); ++i) {
+    size_t len = strlen(unclosed[i]), map_len;
+    char *copy = guarded_copy(unclosed[i], len, &map_len);
+    test_that(json_parse_n_with_options(copy, len, &item, options) == NULL);
+    char expected[64];
+    snprintf(expected, sizeof(expected),
+             "Error: string not closed at index %zu", len);
+    test_str_eq(item.value.string, expected);
+    json_release_item(&item);
+    free_guarded(copy, len, map_len);
+  }
+
+  return test_success;
+}
+
+// Checks that a document parse of str gives the same result as a normal one.
+static void check_document_parse(char *str, json_ParseOptions options) {
+  test_printf("About to parse into a document:\n%s\n", str);
+  char *buf = strdup(str);
+  json_Item expected_item;
+  json_Document doc;
+  char *expected_tail = json_parse(str, &expected_item);
+  const char *tail = json_parse_document(buf, strlen(buf), &doc, options);
+
+  test_that((expected_tail == NULL) == (tail == NULL));
+  if (tail) test_that(tail - buf == expected_tail - str);
+  test_that(doc->root.type == expected_item.type);
+  if (doc->root.type == item_error) {
+    test_str_eq(doc->root.value.string, expected_item.value.string);
+  } else {
+    char *expected_str = json_stringify(expected_item);
+    char *doc_str = json_stringify(doc->root);
+    test_str_eq(doc_str, expected_str);
+    free(expected_str);
+    free(doc_str);
+  }
+  json_release_item(&expected_item);
+  json_document_delete(doc);
+  free(buf);
+}
+
+int test_parse_document() {
+  int arr_allocs = cjson_net_arr_allocs, obj_allocs = cjson_net_obj_allocs;
+  char *test_data[] = {
+    "\"abc\"", "-12.5", "[1, \"two\", [3.0, null], {}, true]  tail",
+    "{\"a\": \"1\", \"b\\u0062\": {\"c\": [\"\\\\\\ud83d\\ude00\", 2]}}",
+    "[\"unclosed", "{\"k\" 1}", "{\"k\": \"v\", 3: 4}", "[1, 2", "[tru]"
+  };
+  json_ParseOptions plain = { 0 }, in_situ = { .in_situ = 1 };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    check_document_parse(test_data[i], plain);
+    check_document_parse(test_data[i], in_situ);
+  }
+
+  // A document large enough to need many chunks, with maps that grow their
+  // buckets and strings that outgrow their first allocation.
+  Array pieces = array__new(8, sizeof(char));
+  char piece[1024];
+  for (int i = 0; i < 20000; ++i) {
+    int n = snprintf(piece, sizeof(piece), "%s{\"id\":%d,\"s\":\"%0*d\\n\"",
+                     (i ? "," : "["), i, i % 200, i);
+    for (int j = 0; j < i % 40; ++j) {
+      n += snprintf(piece + n, sizeof(piece) - n, ",\"k%d\":%d", j, j);
+    }
+    n += snprintf(piece + n, sizeof(piece) - n, "}");
+    ArrayStruct holder = { .count = n, .item_size = 1, .items = piece };
+    array__append_array(pieces, &holder);
+  }
+  array__new_val(pieces, char) = ']';
+  array__new_val(pieces, char) = '\0';
+  check_document_parse(pieces->items, plain);
+  array__delete(pieces);
+
+  // The normal parses above were all released, and documents don't make any
+  // counted allocations.
+  test_that(cjson_net_arr_allocs == arr_allocs);
+  test_that(cjson_net_obj_allocs == obj_allocs);
+
+  return test_success;
+}
+
+// Returns a malloc'd string of depth nested arrays or objects around a 1.
+static char *nested_json(int depth, int use_objects) {
+  char *open = use_objects ? "{\"k\":" : "[";
+  char close = use_objects ? '}' : ']';
+  size_t open_len = strlen(open);
+  char *str = malloc(depth * (open_len + 1) + 2);
+  char *s = str;
+  for (int i = 0; i < depth; ++i, s += open_len) memcpy(s, open, open_len);
+  *s++ = '1';
+  memset(s, close, depth);
+  s[depth] = '\0';
+  return str;
+}
+
+int test_deep_nesting() {
+  json_Item item;
+  json_ParseOptions options = { 0 };
+
+  // The default limit stops adversarial nesting without using the call stack.
+  for (int use_objects = 0; use_objects < 2; ++use_objects) {
+    char *str = nested_json(1000000, use_objects);
+    json_parse(str, &item);
+    test_that(item.type == item_error);
+    test_that(strstr(item.value.string, "nesting too deep") != NULL);
+    json_release_item(&item);
+    free(str);
+  }
+
+  // Exactly the limit is fine; one more isn't.
+  options.max_depth = 3;
+  json_parse_with_options("[[{\"a\":1}], []]", &item, options);
+  test_that(item.type == item_array);
+  json_release_item(&item);
+  json_parse_with_options("[[{\"a\":[]}], []]", &item, options);
+  test_that(item.type == item_error);
+  test_str_eq(item.value.string, "Error: nesting too deep at index 7");
+  json_release_item(&item);
+
+  // Deep items can be parsed, stringified, and released when allowed.
+  options.max_depth = 300000;
+  for (int use_objects = 0; use_objects < 2; ++use_objects) {
+    char *str = nested_json(200000, use_objects);
+    json_parse_with_options(str, &item, options);
+    test_that(item.type == (use_objects ? item_object : item_array));
+    char *out = json_stringify(item);
+    test_str_eq(out, str);
+    free(out);
+    json_release_item(&item);
+
+    json_Document doc;
+    json_parse_document(str, strlen(str), &doc, options);
+    test_that(doc->root.type == item.type);
+    json_document_delete(doc);
+    free(str);
+  }
+
+  // Pretty printing indents by nesting depth.
+  char *str = nested_json(3, false);
+  json_parse(str, &item);
+  char *out = json_pretty_stringify(item);
+  test_str_eq(out, "[\n  [\n    [\n      1\n    ]\n  ]\n]");
+  free(out);
+  json_release_item(&item);
+  free(str);
+
+  return test_success;
+}
+
+// An allocator that wraps malloc and counts outstanding allocations.
+static int num_outstanding = 0;
+
+static void *counting_alloc(size_t size, void *context) {
+  num_outstanding++;
+  return malloc(size);
+}
+
+static void *counting_resize(void *ptr, size_t old_size, size_t new_size,
+                             void *context) {
+  if (ptr == NULL) num_outstanding++;
+  return realloc(ptr, new_size);
+}
+
+static void counting_dealloc(void *ptr, void *context) {
+  if (ptr) num_outstanding--;
+  free(ptr);
+}
+
+int test_custom_allocator() {
+  AllocatorStruct allocator = { .alloc   = counting_alloc,
+                                .resize  = counting_resize,
+                                .dealloc = counting_dealloc };
+
+  Array array = array__new_with_allocator(1, sizeof(int), &allocator);
+  for (int i = 0; i < 1000; ++i) array__new_val(array, int) = i;
+  test_that(array__item_val(array, 999, int) == 999);
+  array__delete(array);
+  test_that(num_outstanding == 0);
+
+  // Enough keys to double the buckets a few times, and some unset keys.
+  Map map = map__new_with_allocator(json_str_hash, json_str_eq, &allocator);
+  char keys[1000][8];
+  for (int i = 0; i < 1000; ++i) {
+    snprintf(keys[i], sizeof(keys[i]), "%d", i);
+    map__set(map, keys[i], keys[i]);
+  }
+  for (int i = 0; i < 1000; i += 3) map__unset(map, keys[i]);
+  test_that(map->count == 666);
+  test_that(map__get(map, "500") != NULL);
+  test_str_eq((char *)map__get(map, "500")->value, "500");
+  test_that(map__get(map, "501") == NULL);
+  map__delete(map);
+  test_that(num_outstanding == 0);
+
+  return test_success;
+}
+
+// A byte-at-a-time version of json_structural_index.
+static uint32_t *reference_index(char *s, size_t len, size_t *n) {
+  uint32_t *index = malloc((len + 1) * sizeof(uint32_t));
+  int in_string = false, escaped = false, prev_scalar = false;
+  *n = 0;
+  for (size_t i = 0; i < len; ++i) {
+    char c = s[i];
+    int is_op = (c && strchr("{}[]:,", c));
+    int is_space = (c && strchr(" \t\r\n", c));
+    if (in_string) {
+      if (escaped) {
+        escaped = false;
+      } else if (c == '\\') {
+        escaped = true;
+      } else if (c == '"') {
+        in_string = false;
+      }
+      prev_scalar = false;
+      continue;
+    }
+    // Like the real index, this treats backslashes as escapes even outside of
+    // strings; the parser stops at such backslashes anyway.
+    int is_quote = (c == '"' && !escaped);
+    escaped = (c == '\\' && !escaped);
+    if (is_op || (!is_space && !prev_scalar)) index[(*n)++] = (uint32_t)i;
+    if (is_quote) in_string = true;
+    prev_scalar = !is_op && !is_space && !is_quote;
+  }
+  index[*n] = (uint32_t)len;
+  return index;
+}
+
+int test_structural_index() {
+  // Random text drawn from an alphabet that's heavy on the tricky characters.
+  char alphabet[] = "\"\"\\\\ \n{}[]:,ab1";
+  char s[1000];
+  srand(2);
+  for (int trial = 0; trial < 2000; ++trial) {
+    size_t len = rand() % sizeof(s);
+    for (size_t i = 0; i < len; ++i) {
+      s[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    size_t n;
+    uint32_t *expected = reference_index(s, len, &n);
+    uint32_t *actual = json_structural_index(s, len);
+    test_that(memcmp(expected, actual, (n + 1) * sizeof(uint32_t)) == 0);
+    free(expected);
+    free(actual);
+  }
+  return test_success;
+}
+
+// Feeds str[0, len) to a push parser chunk_size bytes at a time and checks
+// that it gives the same result as json_parse_n, except that anything after
+// the value is an error.
+static void check_push_parse(char *str, size_t len, size_t chunk_size) {
+  json_Item expected_item, item;
+  const char *tail = json_parse_n(str, len, &expected_item);
+  if (tail && tail < str + len) {
+    json_release_item(&expected_item);
+    expected_item.type = item_error;
+    asprintf(&expected_item.value.string,
+             "Error: expected end of input at index %ld", (long)(tail - str));
+  }
+
+  json_ParseOptions options = { 0 };
+  json_PushParser parser = json_push_parser_new(options);
+  int ok = true;
+  for (size_t i = 0; i < len; i += chunk_size) {
+    size_t n = (len - i < chunk_size ? len - i : chunk_size);
+    // Each chunk is a separate copy so that nothing is read past its end.
+    char *chunk = malloc(n);
+    memcpy(chunk, str + i, n);
+    int fed = json_push_parser_feed(parser, chunk, n);
+    test_that(ok || !fed);  // Once an error is found, it stays found.
+    ok = fed;
+    free(chunk);
+  }
+  json_push_parser_finish(parser, &item);
+
+  test_that(item.type == expected_item.type);
+  if (item.type == item_error) {
+    test_str_eq(item.value.string, expected_item.value.string);
+  } else {
+    test_that(ok);
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+  }
+  json_release_item(&expected_item);
+  json_release_item(&item);
+}
+
+int test_push_parser() {
+  char *test_data[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"",
+    "[-12.5e-3, 0, 1E+2, 123456789012345678901234567890]", "truex",
+    "\"\\u00e9\\ud83d\\ude00\\n\"", "{\"k\": [ 1.5e3 , -2 ]    }   tail",
+    "[\"a string long enough to be scanned with vector instructions\", "
+    "\"and another with an escape \\\" near its end\"]",
+    "[1-2]", "[1.x]", "[1e]", "[01]", "[\"\\u\"x\"]", "{\"a\" 1}", "{,}",
+    "[1,]", "{\"a\":1,}", "[tru]", "nul", "[[], {}, [[{}]]]", "12 ", "-",
+    // Short \u escapes end before a closing quote or a backslash.
+    "[\"a\\u12\",\",\\\"b\"]", "\"\\u12\",", "[\"\\uD80\"03\" , 1]",
+    "[\"\\uD80\"  03\"  ]", "[\"\\u1\"  , \" 1 ]", "[\"\\u12\" , 3 ]",
+    "[\"\\u1\\n\"]"
+  };
+  int arr_allocs = cjson_net_arr_allocs, obj_allocs = cjson_net_obj_allocs;
+  for (int i = 0; i < array_size(test_data); ++i) {
+    test_printf("About to push-parse every prefix of:\n%s\n", test_data[i]);
+    size_t str_len = strlen(test_data[i]);
+    for (size_t len = 0; len <= str_len; ++len) {
+      size_t chunk_sizes[] = { 1, 2, 3, 5, 16, len ? len : 1 };
+      for (int j = 0; j < array_size(chunk_sizes); ++j) {
+        check_push_parse(test_data[i], len, chunk_sizes[j]);
+      }
+    }
+  }
+  // Nothing is leaked, including on errors.
+  test_that(cjson_net_arr_allocs == arr_allocs);
+  test_that(cjson_net_obj_allocs == obj_allocs);
+
+  // Split a long string at every point; some splits land within the
+  // surrogate pair's escapes.
+  char *str = "[\"A long string, with escapes \\t and \\ud83d\\ude00 and "
+              "more \\\"quoted\\\" text to be scanned by vector code.\", 7]";
+  size_t len = strlen(str);
+  for (size_t split = 0; split <= len; ++split) {
+    json_ParseOptions options = { 0 };
+    json_PushParser parser = json_push_parser_new(options);
+    test_that(json_push_parser_feed(parser, str, split));
+    test_that(json_push_parser_feed(parser, str + split, len - split));
+    json_Item item;
+    json_push_parser_finish(parser, &item);
+    test_that(item.type == item_array && item.value.array->count == 2);
+    json_Item *s = (json_Item *)array__item_ptr(item.value.array, 0);
+    test_that(s->type == item_string);
+    test_that(strstr(s->value.string, "\xF0\x9F\x98\x80") != NULL);
+    json_release_item(&item);
+  }
+
+  // The depth limit applies as it does for json_parse.
+  json_ParseOptions options = { .max_depth = 3 };
+  json_PushParser parser = json_push_parser_new(options);
+  test_that(json_push_parser_feed(parser, "[[{\"a\":", 7));
+  test_that(!json_push_parser_feed(parser, "[]}], []]", 9));
+  json_Item item;
+  json_push_parser_finish(parser, &item);
+  test_that(item.type == item_error);
+  test_str_eq(item.value.string, "Error: nesting too deep at index 7");
+  json_release_item(&item);
+
+  return test_success;
+}
+
+// Checks that items holds, in order, the items that json_parse gives for the
+// strings in expected, where strings starting with "Error" are error messages.
+static void check_batch_items(Array items, char **expected, int num_expected) {
+  test_that(items->count == num_expected);
+  for (int i = 0; i < items->count && i < num_expected; ++i) {
+    json_Item *item = (json_Item *)array__item_ptr(items, i);
+    if (strncmp(expected[i], "Error", 5) == 0) {
+      test_that(item->type == item_error);
+      test_str_eq(item->value.string, expected[i]);
+    } else {
+      char *str = json_stringify(*item);
+      test_str_eq(str, expected[i]);
+      free(str);
+    }
+  }
+}
+
+int test_parse_batch() {
+  json_ParseOptions options = { 0 };
+
+  // Lines may be blank or hold several values, and an error ends its line.
+  char *lines = "[1]\n\n{\"a\":2} 3\r\n  \"s\" x 4\n{\"b\": }\n5";
+  char *expected[] = {
+    "[1]", "{\"a\":2}", "3", "\"s\"", "Error: unexpected character at index 22",
+    "Error: unexpected character at index 32", "5"
+  };
+  Array items = json_parse_batch(lines, strlen(lines), options, 2);
+  check_batch_items(items, expected, array_size(expected));
+  array__delete(items);
+
+  items = json_parse_batch("", 0, options, 0);
+  test_that(items->count == 0);
+  array__delete(items);
+
+  // The input is never written to, even with in_situ set; this literal is
+  // read-only memory.
+  json_ParseOptions in_situ = { .in_situ = true };
+  char *escaped[] = { "\"a\\nb\"", "{\"k\\t\":\"\\\"x\\\"\"}" };
+  char *escaped_lines = "\"a\\nb\"\n{\"k\\t\":\"\\\"x\\\"\"}";
+  items = json_parse_batch(escaped_lines, strlen(escaped_lines), in_situ, 2);
+  check_batch_items(items, escaped, array_size(escaped));
+  array__delete(items);
+
+  // Enough lines to make many batches give the same items in the same order
+  // with any number of threads.
+  int num_lines = 40000;
+  size_t cap = num_lines * 64;
+  char *buf = malloc(cap), *s = buf;
+  char **expected_items = malloc(num_lines * sizeof(char *));
+  for (int i = 0; i < num_lines; ++i) {
+    char *line = s;
+    if (i % 1000 == 999) {
+      s += sprintf(s, "{\"id\":%d,\"oops\"}\n", i);
+      asprintf(&expected_items[i], "Error: expected ':' at index %ld",
+               (long)(s - buf - 2));
+    } else {
+      s += sprintf(s, "{\"id\":%d,\"tags\":[\"t%d\",null,%s]}\n", i, i % 7,
+                   i % 2 ? "true" : "false");
+      expected_items[i] = strndup(line, s - line - 1);
+    }
+  }
+  int thread_counts[] = { 1, 2, 3, 8, 0 };
+  int arr_allocs = cjson_net_arr_allocs, obj_allocs = cjson_net_obj_allocs;
+  for (int i = 0; i < array_size(thread_counts); ++i) {
+    test_printf("About to parse %d lines with %d threads\n", num_lines,
+                thread_counts[i]);
+    items = json_parse_batch(buf, s - buf, options, thread_counts[i]);
+    check_batch_items(items, expected_items, num_lines);
+    array__delete(items);
+  }
+  test_that(cjson_net_arr_allocs == arr_allocs);
+  test_that(cjson_net_obj_allocs == obj_allocs);
+  for (int i = 0; i < num_lines; ++i) free(expected_items[i]);
+  free(expected_items);
+  free(buf);
+
+  return test_success;
+}
+
+// Checks that the on-demand value for each key in str's top-level object
+// gives the same item as a full parse does.
+static void check_ondemand_fields(char *str) {
+  test_printf("About to read fields on demand from:\n%s\n", str);
+  json_Item obj;
+  json_parse(str, &obj);
+  test_that(obj.type == item_object);
+  json_Value doc = json_ondemand(str, strlen(str));
+  map__for(pair, obj.value.object) {
+    json_Item item;
+    json_Value value = json_ondemand_get(doc, pair->key);
+    test_that(json_ondemand_item(value, &item) != NULL);
+    char *expected_str = json_stringify(*(json_Item *)pair->value);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+    json_release_item(&item);
+  }
+  json_release_item(&obj);
+}
+
+int test_ondemand() {
+  char *str = "{\"name\": \"x\", \"skip\": {\"deep\": [1, {\"a\": \"]}\"}, "
+              "\"\\\"}\"]}, \"user\": {\"id\": 12345678901234, \"score\": "
+              "9.5, \"ok\": true, \"tags\": [\"a\", \"b\\u00e9\"]}, "
+              "\"k\\u0065y\": null }";
+  json_Value doc = json_ondemand(str, strlen(str));
+  test_that(doc.type == item_object);
+
+  json_Value user = json_ondemand_get(doc, "user");
+  test_that(user.type == item_object);
+  int64_t n;
+  test_that(json_ondemand_integer(json_ondemand_get(user, "id"), &n));
+  test_that(n == 12345678901234LL);
+  double d;
+  test_that(json_ondemand_number(json_ondemand_get(user, "score"), &d));
+  test_that(d == 9.5);
+  test_that(!json_ondemand_integer(json_ondemand_get(user, "score"), &n));
+  int b = false;
+  test_that(json_ondemand_bool(json_ondemand_get(user, "ok"), &b) && b);
+  json_Value tags = json_ondemand_get(user, "tags");
+  char *tag = json_ondemand_string(json_ondemand_at(tags, 1));
+  test_str_eq(tag, "b\xC3\xA9");
+  free(tag);
+  test_that(json_ondemand_get(doc, "key").type == item_null);
+
+  // Errors pass through chained lookups and become error items.
+  json_Value missing = json_ondemand_get(json_ondemand_get(doc, "nope"), "id");
+  test_that(missing.type == item_error);
+  test_str_eq(missing.error, "key not found");
+  test_str_eq(json_ondemand_at(tags, 2).error, "index out of range");
+  test_str_eq(json_ondemand_at(user, 0).error, "not an array");
+  test_str_eq(json_ondemand_get(tags, "a").error, "not an object");
+  json_Item item;
+  test_that(json_ondemand_item(missing, &item) == NULL);
+  test_str_eq(item.value.string, "Error: key not found at index 0");
+  json_release_item(&item);
+
+  // Only the path to a value is checked; skipped values are just matched up.
+  char *bad = "{\"a\": [1, }, \"b\" 2}";
+  doc = json_ondemand(bad, strlen(bad));
+  test_that(json_ondemand_get(doc, "c").type == item_error);
+  test_that(json_ondemand_item(json_ondemand_get(doc, "b"), &item) == NULL);
+  test_str_eq(item.value.string, "Error: expected ':' at index 17");
+  json_release_item(&item);
+  bad = "{\"a\": [1, 2, \"b\": 3";
+  doc = json_ondemand(bad, strlen(bad));
+  test_str_eq(json_ondemand_get(doc, "b").error, "value not closed");
+
+  // An escaped key that doesn't decode matches nothing, not even "".
+  bad = "{\"\\n\xFF\": 1, \"\": 2}";
+  doc = json_ondemand(bad, strlen(bad));
+  test_that(json_ondemand_integer(json_ondemand_get(doc, ""), &n) && n == 2);
+  test_that(json_ondemand_integer(json_ondemand_pointer(doc, "/"), &n) &&
+            n == 2);
+
+  check_ondemand_fields(str);
+  check_ondemand_fields("{\"a\":1,\"b\":[true,false,null],\"c\":{\"d\":\"e\"},"
+                        "\"f\":-0.5e3,\"g\":\"\\ud83d\\ude00\",\"h\":[]}");
+  check_ondemand_fields("  { \"x\" : [ [ ] , { } ] , \"y\" : \"\\\\\" }  ");
+
+  return test_success;
+}
+
+// Checks that a tape parse of str gives the same result as a normal one.
+static void check_tape_parse(char *str) {
+  test_printf("About to parse onto a tape:\n%s\n", str);
+  json_ParseOptions options = { 0 };
+  json_Item expected_item, item;
+  json_Tape tape;
+  const char *expected_tail = json_parse(str, &expected_item);
+  const char *tail = json_parse_tape(str, strlen(str), &tape, options);
+
+  test_that((expected_tail == NULL) == (tail == NULL));
+  if (tail) {
+    test_that(tail == expected_tail);
+    test_that(json_tape_next(tape, 0) == tape->num_words);
+    json_tape_item(tape, 0, &item);
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+    json_release_item(&item);
+  } else {
+    test_str_eq(tape->error, expected_item.value.string);
+  }
+  json_release_item(&expected_item);
+  json_tape_delete(tape);
+}
+
+int test_parse_tape() {
+  char *test_data[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"", "7",
+    "[-12.5e-3, 0, 1E+2, 123456789012345678901234567890]", "truex",
+    "\"\\u00e9\\ud83d\\ude00\\n\"", "{\"k\": [ 1.5e3 , -2 ]    }   tail",
+    "[[], {}, [[{}]], {\"a\": {\"b\": []}}]", "[1.x]", "[1e]", "{\"a\" 1}",
+    "{,}", "[1,]", "{\"a\":1,}", "[tru]", "\"abc", "[\"\\u\"x\"]", "",
+    "{\"a\": [1, 2", "[9223372036854775807, -9223372036854775808, 1e400]"
+  };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    check_tape_parse(test_data[i]);
+  }
+
+  // Navigation follows the skip offsets.
+  char *str = "{\"name\": \"x\\ty\", \"skip\": [[1, 2], {\"a\": [3]}], "
+              "\"user\": {\"id\": 12, \"score\": -0.5, \"tags\": [\"a\", \"b\"]}}";
+  json_ParseOptions options = { 0 };
+  json_Tape tape;
+  test_that(json_parse_tape(str, strlen(str), &tape, options) != NULL);
+  test_that(json_tape_type(tape, 0) == item_object);
+  test_that(json_tape_count(tape, 0) == 3);
+  size_t len;
+  test_str_eq(json_tape_string(tape, json_tape_get(tape, 0, "name"), &len),
+              "x\ty");
+  test_that(len == 3);
+  size_t user = json_tape_get(tape, 0, "user");
+  test_that(json_tape_type(tape, user) == item_object);
+  test_that(json_tape_integer(tape, json_tape_get(tape, user, "id")) == 12);
+  test_that(json_tape_number(tape, json_tape_get(tape, user, "id")) == 12.0);
+  test_that(json_tape_number(tape, json_tape_get(tape, user, "score")) == -0.5);
+  size_t tags = json_tape_get(tape, user, "tags");
+  test_that(json_tape_count(tape, tags) == 2);
+  test_str_eq(json_tape_string(tape, json_tape_at(tape, tags, 1), NULL), "b");
+  test_that(json_tape_at(tape, tags, 2) == 0);
+  test_that(json_tape_get(tape, user, "nope") == 0);
+
+  // Keys and values alternate within objects.
+  char *keys[] = { "name", "skip", "user" };
+  int num_keys = 0;
+  for (size_t pos = json_tape_first(tape, 0); pos;
+       pos = json_tape_sibling(tape, pos)) {
+    test_str_eq(json_tape_string(tape, pos, NULL), keys[num_keys++]);
+  }
+  test_that(num_keys == 3);
+  size_t skip = json_tape_get(tape, 0, "skip");
+  test_that(json_tape_next(tape, skip) == user - 1);
+  json_tape_delete(tape);
+
+  // Counts too large for the opening word are found by walking.
+  int n = 0x1000001;
+  char *big = malloc(2 * n + 2);
+  big[0] = '[';
+  for (int i = 0; i < n; ++i) memcpy(big + 1 + 2 * i, "0,", 2);
+  big[2 * n] = ']';
+  big[2 * n + 1] = '\0';
+  test_that(json_parse_tape(big, 2 * n + 1, &tape, options) != NULL);
+  test_that(json_tape_count(tape, 0) == n);
+  json_tape_delete(tape);
+  free(big);
+
+  return test_success;
+}
+
+int test_intern_keys() {
+  test_that(json_intern("abc") == json_intern("abc"));
+  test_that(json_intern_n("abcd", 3) == json_intern("abc"));
+  test_that(json_intern("abd") != json_intern("abc"));
+  test_str_eq(json_intern("abc"), "abc");
+
+  char *test_data[] = {
+    "{\"a\": 1, \"b\": {\"a\": [2, {\"c\": null}]}}", "{\"a\": 1, \"a\": 2}",
+    "[{\"k\\u0065y\": 1}, {\"key\": 2}]", "{\"ab", "{\"a\\\"b\": 1, \"x\" 2}",
+    "{\"a string long enough to be scanned with vector instructions\": 3}"
+  };
+  json_ParseOptions options = { .intern_keys = 1 };
+  int arr_allocs = cjson_net_arr_allocs, obj_allocs = cjson_net_obj_allocs;
+  for (int i = 0; i < array_size(test_data); ++i) {
+    test_printf("About to parse with interned keys:\n%s\n", test_data[i]);
+    json_Item expected_item, item;
+    json_parse(test_data[i], &expected_item);
+    json_parse_with_options(test_data[i], &item, options);
+    test_that(item.type == expected_item.type);
+    if (item.type == item_error) {
+      test_str_eq(item.value.string, expected_item.value.string);
+    } else {
+      char *expected_str = json_stringify(expected_item);
+      char *item_str = json_stringify(item);
+      test_str_eq(item_str, expected_str);
+      free(expected_str);
+      free(item_str);
+    }
+    json_release_item(&expected_item);
+    json_release_item(&item);
+  }
+  test_that(cjson_net_arr_allocs == arr_allocs);
+  test_that(cjson_net_obj_allocs == obj_allocs);
+
+  // Keys are shared between documents, and looking them up works with either
+  // interned or plain strings.
+  json_Item item1, item2;
+  json_parse_with_options("{\"user\": {\"id\": 7}}", &item1, options);
+  json_parse_with_options("[{\"k\\u0065y\": 0, \"user\": 8}]", &item2,
+                          options);
+  map__key_value *pair1 = map__get(item1.value.object, "user");
+  json_Item obj2 = item_at(item2, 0);
+  map__key_value *pair2 = map__get(obj2.value.object,
+                                   (void *)json_intern("user"));
+  test_that(pair1 && pair2 && pair1->key == pair2->key);
+  test_that(pair1->key == json_intern("user"));
+  test_that(map__get(obj2.value.object, (void *)json_intern("key")) != NULL);
+  test_that(map__get(obj2.value.object, "key") != NULL);
+  test_that(map__get(obj2.value.object, "nope") == NULL);
+  test_that(item_int(item_of(item_of(item1, "user"), "id")) == 7);
+  json_release_item(&item1);
+  json_release_item(&item2);
+
+  // The pool is shared safely between threads, and with documents.
+  int num_lines = 20000;
+  char *buf = malloc(num_lines * 48), *s = buf;
+  for (int i = 0; i < num_lines; ++i) {
+    s += sprintf(s, "{\"id\": %d, \"key%d\": true}\n", i, i % 500);
+  }
+  Array items = json_parse_batch(buf, s - buf, options, 4);
+  test_that(items->count == num_lines);
+  array__for(json_Item *, item, items, i) {
+    char key[16];
+    snprintf(key, 16, "key%d", i % 500);
+    test_that(map__get(item->value.object, (void *)json_intern(key)) != NULL);
+    map__for(pair, item->value.object) {
+      test_that(pair->key == json_intern(pair->key));
+    }
+  }
+  array__delete(items);
+  json_Document doc;
+  json_parse_document(buf, s - buf, &doc, options);
+  test_that(map__get(doc->root.value.object, "id")->key == json_intern("id"));
+  json_document_delete(doc);
+  free(buf);
+
+  return test_success;
+}
+
+// An event handler context that writes the events back out as compact json,
+// with keys in input order.
+typedef struct {
+  char   buf[4096];
+  size_t len;
+  int    num_events;
+  int    stop_at;  // Handler functions return false at this event, if nonzero.
+} EventWriter;
+
+static int write_event(EventWriter *w, const char *fmt, ...) {
+  char last = (w->len ? w->buf[w->len - 1] : '[');
+  int is_close = (fmt[0] == ']' || fmt[0] == '}');
+  if (!is_close && last != '[' && last != '{' && last != ':') {
+    w->buf[w->len++] = ',';
+  }
+  va_list args;
+  va_start(args, fmt);
+  w->len += vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, args);
+  va_end(args);
+  return ++w->num_events != w->stop_at;
+}
+
+static int write_str(EventWriter *w, const char *str, size_t len, int is_key) {
+  write_event(w, "\"");
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = str[i];
+    if (c == '"' || c == '\\') {
+      w->len += sprintf(w->buf + w->len, "\\%c", c);
+    } else if (c < 0x20) {
+      w->len += sprintf(w->buf + w->len, "\\u%04x", c);
+    } else {
+      w->buf[w->len++] = c;
+    }
+  }
+  w->len += sprintf(w->buf + w->len, "\"%s", is_key ? ":" : "");
+  w->buf[w->len] = '\0';
+  w->num_events--;  // write_event counted the opening quote.
+  return ++w->num_events != w->stop_at;
+}
+
+static int on_start_object(void *w) { return write_event(w, "{"); }
+static int on_end_object(void *w)   { return write_event(w, "}"); }
+static int on_start_array(void *w)  { return write_event(w, "["); }
+static int on_end_array(void *w)    { return write_event(w, "]"); }
+
+static int on_key(void *w, const char *str, size_t len) {
+  return write_str(w, str, len, true);
+}
+
+static int on_string(void *w, const char *str, size_t len) {
+  return write_str(w, str, len, false);
+}
+
+static int on_number(void *w, double number) {
+  return write_event(w, "%.17g", number);
+}
+
+static int on_integer(void *w, int64_t integer) {
+  return write_event(w, "%lld", (long long)integer);
+}
+
+static int on_literal(void *w, json_ItemType type) {
+  char *names[] = { [item_true] = "true", [item_false] = "false",
+                    [item_null] = "null" };
+  return write_event(w, "%s", names[type]);
+}
+
+static json_EventHandler writer_handler = {
+  .start_object = on_start_object, .end_object = on_end_object,
+  .start_array  = on_start_array,  .end_array  = on_end_array,
+  .key = on_key, .string = on_string, .number = on_number,
+  .integer = on_integer, .literal = on_literal
+};
+
+// Checks that the events from str describe the same value that json_parse
+// gives, with the same tail or error.
+static void check_parse_events(char *str) {
+  test_printf("About to parse into events:\n%s\n", str);
+  json_ParseOptions options = { 0 };
+  json_Item expected_item, item, error;
+  EventWriter w = { .len = 0 };
+  const char *expected_tail = json_parse(str, &expected_item);
+  const char *tail = json_parse_events(str, strlen(str), &writer_handler, &w,
+                                       options, &error);
+
+  test_that((expected_tail == NULL) == (tail == NULL));
+  if (tail) {
+    test_that(tail == expected_tail);
+    test_printf("Events written as:\n%s\n", w.buf);
+    test_that(json_parse(w.buf, &item) != NULL);
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+    json_release_item(&item);
+  } else {
+    test_str_eq(error.value.string, expected_item.value.string);
+    json_release_item(&error);
+  }
+  json_release_item(&expected_item);
+}
+
+static int sum_number(void *sum, double number) {
+  *(double *)sum += number;
+  return true;
+}
+
+int test_parse_events() {
+  char *test_data[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"", "7",
+    "[-12.5e-3, 0, 1E+2, 123456789012345678901234567890]", "truex",
+    "\"\\u00e9\\ud83d\\ude00\\n\\u0000\"", "{\"k\": [ 1.5e3 , -2 ]    }   tail",
+    "[[], {}, [[{}]], {\"a\": {\"b\": []}}]", "[1.x]", "[1e]", "{\"a\" 1}",
+    "{,}", "[1,]", "{\"a\":1,}", "[tru]", "\"abc", "[\"\\u\"x\"]", "",
+    "{\"a\": [1, 2", "[9223372036854775807, -9223372036854775808]",
+    "{\"k\\\"ey\": \"v\\u0041l\", \"x\": {\"y\": \"z\"}}", "[\"a\nb\"]"
+  };
+  for (int i = 0; i < array_size(test_data); ++i) {
+    check_parse_events(test_data[i]);
+  }
+
+  // Only the handler's functions are called, and integers go to number when
+  // there's no integer function.
+  char *str = "{\"a\": [1, 2.5, \"3\"], \"b\": {\"c\": -4}, \"d\": true}";
+  json_ParseOptions options = { 0 };
+  json_EventHandler sum_handler = { .number = sum_number };
+  double sum = 0;
+  test_that(json_parse_events(str, strlen(str), &sum_handler, &sum, options,
+                              NULL) != NULL);
+  test_that(sum == -0.5);
+
+  // Handlers can stop the parse at any event.
+  json_Item error;
+  EventWriter w = { .stop_at = 5 };
+  test_that(json_parse_events(str, strlen(str), &writer_handler, &w, options,
+                              &error) == NULL);
+  test_that(w.num_events == 5);
+  test_str_eq(w.buf, "{\"a\":[1,2.5");
+  test_str_eq(error.value.string, "Error: stopped by handler at index 10");
+  json_release_item(&error);
+
+  // Depth is limited as it is for json_parse.
+  options.max_depth = 2;
+  test_that(json_parse_events("[[[]]]", 6, &sum_handler, &sum, options,
+                              &error) == NULL);
+  test_str_eq(error.value.string, "Error: nesting too deep at index 2");
+  json_release_item(&error);
+
+  // Deeper limits than json_max_depth work too, for events and tapes.
+  options.max_depth = 300000;
+  for (int use_objects = 0; use_objects < 2; ++use_objects) {
+    char *str = nested_json(200000, use_objects);
+    size_t len = strlen(str);
+    test_that(json_parse_events(str, len, &sum_handler, &sum, options,
+                                &error) == str + len);
+    json_Tape tape;
+    test_that(json_parse_tape(str, len, &tape, options) == str + len);
+    test_that(tape->error == NULL);
+    test_that(json_tape_type(tape, 0) ==
+              (use_objects ? item_object : item_array));
+    json_tape_delete(tape);
+    free(str);
+  }
+
+  return test_success;
+}
+
+// Checks that json_extract finds the value that stringifies as expected, or
+// gives the expected error.
+static void check_extract(char *json, char *pointer, char *expected) {
+  test_printf("About to extract %s from:\n%s\n", pointer, json);
+  json_Item item;
+  const char *tail = json_extract(json, strlen(json), pointer, &item);
+  if (tail) {
+    char *str = json_stringify(item);
+    test_str_eq(str, expected);
+    free(str);
+  } else {
+    test_str_eq(item.value.string, expected);
+  }
+  json_release_item(&item);
+}
+
+int test_extract() {
+  // The examples from RFC 6901.
+  char *rfc = "{\"foo\": [\"bar\", \"baz\"], \"\": 0, \"a/b\": 1, \"c%d\": 2, "
+              "\"e^f\": 3, \"g|h\": 4, \"i\\\\j\": 5, \"k\\\"l\": 6, \" \": 7, "
+              "\"m~n\": 8}";
+  check_extract(rfc, "/foo", "[\"bar\",\"baz\"]");
+  check_extract(rfc, "/foo/0", "\"bar\"");
+  check_extract(rfc, "/", "0");
+  check_extract(rfc, "/a~1b", "1");
+  check_extract(rfc, "/c%d", "2");
+  check_extract(rfc, "/e^f", "3");
+  check_extract(rfc, "/g|h", "4");
+  check_extract(rfc, "/i\\j", "5");
+  check_extract(rfc, "/k\"l", "6");
+  check_extract(rfc, "/ ", "7");
+  check_extract(rfc, "/m~0n", "8");
+
+  char *str = "{\"data\": {\"skip\": [\"/items\", {\"items\": 0}], "
+              "\"it\\u0065ms\": [{}, [], {\"price\": 9.5, \"tags\": [1]}, "
+              "{\"price\": 12, \"~/\": true}]}}";
+  check_extract(" [1, 2] ", "", "[1,2]");
+  check_extract(str, "/data/skip", "[\"/items\",{\"items\":0}]");
+  check_extract(str, "/data/items/3/price", "12");
+  check_extract(str, "/data/items/2/tags/0", "1");
+  check_extract(str, "/data/items/3/~0~1", "true");
+  check_extract(str, "/data/items/4", "Error: index out of range at index 58");
+  check_extract(str, "/data/items/-", "Error: index out of range at index 58");
+  check_extract(str, "/data/items/03", "Error: invalid index at index 58");
+  check_extract(str, "/data/items/1x", "Error: invalid index at index 58");
+  check_extract(str, "/data/price", "Error: key not found at index 9");
+  check_extract(str, "/data/items/3/price/x",
+                "Error: not an object or array at index 106");
+  check_extract(str, "data", "Error: invalid pointer at index 0");
+
+  // Long escaped keys are matched too.
+  char long_key[600], json[700];
+  memset(long_key, 'k', sizeof(long_key));
+  long_key[0] = '~';
+  memcpy(long_key + 300, "\\u006b", 6);
+  long_key[599] = '\0';
+  snprintf(json, sizeof(json), "{\"%s\": 1}", long_key);
+  long_key[300] = 'k';
+  memmove(long_key + 301, long_key + 306, 294);
+  long_key[0] = '/';
+  char pointer[600];
+  snprintf(pointer, sizeof(pointer), "/~0%s", long_key + 1);
+  check_extract(json, pointer, "1");
+
+  // Only the target is parsed.
+  char *bad = "[{\"a\": [}, \"b\": [1, 2]}, {\"c\": tru}]";
+  check_extract(bad, "/0/b/1", "2");
+  check_extract(bad, "/1/c", "Error: expected 'true' at index 31");
+
+  // Errors in the target match those of a full parse.
+  char *targets[] = { "tru", "nul", "fals", "x" };
+  for (int i = 0; i < array_size(targets); ++i) {
+    json_Item item;
+    test_that(json_parse_n(targets[i], strlen(targets[i]), &item) == NULL);
+    check_extract(targets[i], "", item.value.string);
+    json_release_item(&item);
+  }
+
+  return test_success;
+}
+
+// Checks json_validate on str, placed right before an inaccessible page, against
+// the expected error code and position.
+static void check_validate(char *str, json_ErrorCode code, size_t offset,
+                           size_t line, size_t column) {
+  test_printf("About to validate:\n%s\n", str);
+  size_t len = strlen(str), map_len;
+  char *copy = guarded_copy(str, len, &map_len);
+  json_Error error;
+  test_that(json_validate(copy, len, &error) == (code == json_error_none));
+  test_that(error.code == code);
+  if (code == json_error_none) {
+    // Valid input parses without error or tail.
+    json_Item item;
+    const char *tail = json_parse(str, &item);
+    test_that(tail && *tail == '\0');
+    json_release_item(&item);
+  } else {
+    test_printf("Error: %s at offset %zu\n", error.message, error.offset);
+    test_that(error.offset == offset);
+    test_that(error.line == line);
+    test_that(error.column == column);
+  }
+  test_that(json_validate(copy, len, NULL) == (code == json_error_none));
+  free_guarded(copy, len, map_len);
+}
+
+int test_validate() {
+  char *valid[] = {
+    "[1, 2, 3]", "  {\"a\" :\t[true ,false, null ]\n}  ", "\"\\\\\"", "7",
+    "[-12.5e-3, 0, 1E+2, 123456789012345678901234567890]", "{}", "[[], {}]",
+    "\"\\u00e9\\ud83d\\ude00\\n\\/\\b\\f\\r\\t\\\"\"", "{\"k\": {\"\": [{}]}}",
+    "\"caf\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \xF4\x8F\xBF\xBF\"",
+    "[\"a string long enough to be scanned with vector instructions\", "
+    "\"and another with an escape \\\" near its end\"]"
+  };
+  for (int i = 0; i < array_size(valid); ++i) {
+    check_validate(valid[i], json_error_none, 0, 0, 0);
+  }
+
+  check_validate("", json_error_syntax, 0, 1, 1);
+  check_validate("[1,]", json_error_syntax, 3, 1, 4);
+  check_validate("{\n  \"a\": 1\n  \"b\": 2\n}", json_error_syntax, 13, 3, 3);
+  check_validate("{\"a\" 1}", json_error_syntax, 5, 1, 6);
+  check_validate("{,}", json_error_syntax, 1, 1, 2);
+  check_validate("[tru]", json_error_syntax, 1, 1, 2);
+  check_validate("[1 2]", json_error_syntax, 3, 1, 4);
+  check_validate("[1.x]", json_error_number, 3, 1, 4);
+  check_validate("[-]", json_error_number, 2, 1, 3);
+  check_validate("\"abc", json_error_string, 4, 1, 5);
+  check_validate("[\"a\\qb\"]", json_error_string, 3, 1, 4);
+  check_validate("[\"\\u12g4\"]", json_error_string, 2, 1, 3);
+  check_validate("[\"a\nb\"]", json_error_string, 3, 1, 4);
+  check_validate("[1] x", json_error_trailing, 4, 1, 5);
+  check_validate("{\"a\": [1, 2", json_error_syntax, 11, 1, 12);
+
+  // Bad UTF-8: a lone continuation byte, overlong forms, an encoded surrogate,
+  // a code point past U+10FFFF, an invalid lead byte, and a cut-off character.
+  char *bad_utf8[] = {
+    "\"ab\x80\"", "\"ab\xC0\xAF\"", "\"ab\xE0\x80\xAF\"", "\"ab\xED\xA0\x80\"",
+    "\"ab\xF0\x80\x80\xAF\"", "\"ab\xF4\x90\x80\x80\"",
+    "\"ab\xF5\x80\x80\x80\"",
+    "\"ab\xE2\x82\"", "\"ab\xC3\""
+  };
+  for (int i = 0; i < array_size(bad_utf8); ++i) {
+    check_validate(bad_utf8[i], json_error_utf8, 3, 1, 4);
+  }
+  check_validate("[\"0123456789\xE2\x82\xAC\", \"\xFF\"]", json_error_utf8,
+                 19, 1, 20);
+
+  // Depth is limited to json_max_depth.
+  char deep[2 * json_max_depth + 3];
+  for (int depth = json_max_depth; depth <= json_max_depth + 1; ++depth) {
+    memset(deep, '[', depth);
+    memset(deep + depth, ']', depth);
+    deep[2 * depth] = '\0';
+    if (depth == json_max_depth) {
+      check_validate(deep, json_error_none, 0, 0, 0);
+    } else {
+      check_validate(deep, json_error_depth, json_max_depth, 1,
+                     json_max_depth + 1);
+    }
+  }
+
+  return test_success;
+}
+
+// Checks that json_parse_array on buf[0, len) gives just what a
+// single-threaded parse does.
+static void check_parse_array(char *buf, size_t len, int num_threads) {
+  test_printf("About to parse a %zu-byte array with %d threads\n", len,
+              num_threads);
+  json_ParseOptions options = { 0 };
+  json_Item expected_item, item;
+  const char *expected_tail = json_parse_n_with_options(buf, len,
+                                                        &expected_item,
+                                                        options);
+  const char *tail = json_parse_array(buf, len, &item, options, num_threads);
+  test_that(tail == expected_tail);
+  test_that(item.type == expected_item.type);
+  if (item.type == item_error) {
+    test_str_eq(item.value.string, expected_item.value.string);
+  } else {
+    char *expected_str = json_stringify(expected_item);
+    char *item_str = json_stringify(item);
+    test_str_eq(item_str, expected_str);
+    free(expected_str);
+    free(item_str);
+  }
+  json_release_item(&expected_item);
+  json_release_item(&item);
+}
+
+// Returns a new array of n elements of the given kind. Separators like those
+// between elements also appear within them, so that some guessed element
+// starts are wrong.
+static char *big_array(int kind, int n) {
+  char *buf = malloc((size_t)n * 96 + 16), *s = buf;
+  s += sprintf(s, kind == 1 ? "[\n" : "[");
+  for (int i = 0; i < n; ++i) {
+    char *sep = (i == n - 1 ? "" : (kind == 1 ? ",\n" : ","));
+    switch (kind) {
+      case 0:
+      case 1:
+        // Every so often, a record holds a copy of the separator.
+        s += sprintf(s, "%s{\"id\":%d,\"s\":\"x},{y\",\"in\":[{\"%s\":%d},"
+                        "{%s}]}%s", kind == 1 ? "  " : "", i,
+                     i % 300 ? "a" : "id", i % 9, i % 300 ? "" : "\"id\":0",
+                     sep);
+        break;
+      case 2:
+        s += sprintf(s, "%d.%d, -%d%s", i, i % 10, i % 77, sep);
+        break;
+      case 3:
+        s += sprintf(s, "\"a, b %d\", \"c\\\", \\\"d\"%s", i, sep);
+        break;
+    }
+  }
+  sprintf(s, kind == 1 ? "\n]\n" : "]");
+  return buf;
+}
+
+int test_parse_array() {
+  int arr_allocs = cjson_net_arr_allocs, obj_allocs = cjson_net_obj_allocs;
+  for (int kind = 0; kind < 4; ++kind) {
+    char *buf = big_array(kind, 20000);
+    size_t len = strlen(buf);
+    check_parse_array(buf, len, 1);
+    check_parse_array(buf, len, 4);
+    check_parse_array(buf, len, 0);
+
+    // Errors give the same message and index as a single-threaded parse.
+    check_parse_array(buf, len - 2, 4);  // Cut off.
+    strcat(buf, " tail");
+    check_parse_array(buf, len + 5, 4);
+    buf[len] = '\0';
+    char *mid = strchr(buf + len / 2, ',');
+    *mid = ' ';  // Remove a separator, which may be within an element.
+    check_parse_array(buf, len, 4);
+    *mid = ',';
+    mid = strchr(buf + 2 * len / 3, kind < 2 ? '}' : ',');
+    *mid = ']';
+    check_parse_array(buf, len, 4);
+    free(buf);
+  }
+  check_parse_array("[]", 2, 4);
+  check_parse_array(" 7 ", 3, 4);
+  test_that(cjson_net_arr_allocs == arr_allocs);
+  test_that(cjson_net_obj_allocs == obj_allocs);
+
+  return test_success;
+}
+
+// Checks that every parser rejects str, which has invalid UTF-8 at index,
+// with the same error.
+static void check_bad_utf8(char *str, long index) {
+  test_printf("About to parse bad UTF-8 at index %ld\n", index);
+  char expected[64];
+  snprintf(expected, 64, "Error: invalid UTF-8 at index %ld", index);
+  size_t len = strlen(str);
+  json_Item item;
+  for (int mode = 0; mode < 4; ++mode) {
+    json_ParseOptions options = { .use_index   = (mode == 1),
+                                  .in_situ     = (mode == 2),
+                                  .intern_keys = (mode == 3) };
+    char *copy = strdup(str);
+    test_that(json_parse_n_with_options(copy, len, &item, options) == NULL);
+    test_str_eq(item.value.string, expected);
+    json_release_item(&item);
+    free(copy);
+  }
+  json_ParseOptions options = { 0 };
+  EventWriter w = { .len = 0 };
+  test_that(json_parse_events(str, len, &writer_handler, &w, options,
+                              &item) == NULL);
+  test_str_eq(item.value.string, expected);
+  json_release_item(&item);
+  json_Error error;
+  test_that(!json_validate(str, len, &error));
+  test_that(error.code == json_error_utf8 && error.offset == index);
+}
+
+int test_utf8() {
+  // Bad sequences land at every position within and across vector blocks,
+  // in values and in keys, and after escapes.
+  char *bad_utf8[] = {
+    "\x80", "\xC0\xAF", "\xE0\x80\xAF", "\xED\xA0\x80", "\xF0\x80\x80\xAF",
+    "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xE2\x82", "\xC3"
+  };
+  char *formats[] = { "[\"%s%s\"]", "{\"%s%sx\": 1}", "[\"\\n%s%s\"]" };
+  char buf[256], prefix[80];
+  for (int i = 0; i < array_size(bad_utf8); ++i) {
+    for (int n = 0; n < 70; n += (n < 36 ? 1 : 11)) {
+      // Some prefixes end with a valid multibyte character.
+      memset(prefix, 'a', n);
+      if (n >= 3 && n % 3 == 0) memcpy(prefix + n - 3, "\xE2\x82\xAC", 3);
+      prefix[n] = '\0';
+      for (int f = 0; f < array_size(formats); ++f) {
+        snprintf(buf, 256, formats[f], prefix, bad_utf8[i]);
+        check_bad_utf8(buf, 2 + n + 2 * (f == 2));
+      }
+    }
+  }
+
+  // Long valid strings in several scripts parse and survive a round trip
+  // through json_stringify, which escapes non-ASCII characters.
+  char *words[] = {
+    "plain ascii, ", "caf\xC3\xA9 ", "\xE2\x82\xAC\xE2\x82\xAC ",
+    "\xF0\x9F\x98\x80 ", "\xD0\xBF\xD1\x80\xD0\xB8\xD0\xB2\xD0\xB5\xD1\x82 ",
+    "\xE4\xBD\xA0\xE5\xA5\xBD ", "\xF4\x8F\xBF\xBF\xEF\xBF\xBF\\n\\u00e9"
+  };
+  char *str = malloc(40000), *s = str;
+  s += sprintf(s, "\"");
+  for (int i = 0; i < 1000; ++i) s += sprintf(s, "%s", words[i * 7 % 11 % 7]);
+  sprintf(s, "\"");
+  json_Item item, round_trip;
+  test_that(json_parse(str, &item) != NULL);
+  test_that(item.type == item_string);
+  char *stringified = json_stringify(item);
+  for (char *t = stringified; *t; ++t) test_that((unsigned char)*t < 0x80);
+  test_that(json_parse(stringified, &round_trip) != NULL);
+  test_str_eq(round_trip.value.string, item.value.string);
+  json_release_item(&item);
+  json_release_item(&round_trip);
+  free(stringified);
+  free(str);
+
+  // Code points whose low byte looks like an escaped char, and those that need
+  // surrogate pairs.
+  char *chars[] = { "\xC4\x8A", "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF",
+                    "\xEF\xBF\xBF" };
+  char *escaped[] = { "\"\\u010A\"", "\"\\uD83D\\uDE00\"",
+                      "\"\\uDBFF\\uDFFF\"", "\"\\uFFFF\"" };
+  for (int i = 0; i < array_size(chars); ++i) {
+    item.type = item_string;
+    item.value.string = chars[i];
+    stringified = json_stringify(item);
+    test_str_eq(stringified, escaped[i]);
+    test_that(json_parse(stringified, &round_trip) != NULL);
+    test_str_eq(round_trip.value.string, chars[i]);
+    json_release_item(&round_trip);
+    free(stringified);
+  }
+
+  return test_success;
+}
+
+int test_stringify_into() {
+  char *inputs[] = {
+    "[1,2.5,\"a\\nb\",{\"k\":[true,false,null]},-7]", "\"caf\\u00E9\"", "{}",
+    "42"
+  };
+  char buf[256];
+  size_t len;
+  for (int i = 0; i < array_size(inputs); ++i) {
+    json_Item item;
+    json_parse(inputs[i], &item);
+    char *expected = json_stringify(item);
+    size_t expected_len = strlen(expected);
+
+    // Buffers that are too small report the length needed.
+    size_t caps[] = { 0, 1, expected_len };
+    for (int j = 0; j < array_size(caps); ++j) {
+      len = 0;
+      test_that(!json_stringify_into(item, buf, caps[j], &len, 0));
+      test_that(len == expected_len);
+    }
+
+    // A buffer of exactly *len + 1 chars is enough. The same buffer is reused
+    // for every item.
+    test_that(json_stringify_into(item, buf, len + 1, &len, 0));
+    test_that(len == expected_len);
+    test_str_eq(buf, expected);
+    test_that(json_stringify_into(item, buf, sizeof(buf), &len, 0));
+    test_str_eq(buf, expected);
+
+    free(expected);
+    json_release_item(&item);
+  }
+
+  return test_success;
+}
+
+// A sink that appends to a malloc'd string, and fails after max_writes calls
+// if that's positive.
+typedef struct {
+  char * str;
+  size_t len;
+  int    num_writes;
+  int    max_writes;
+} StringSink;
+
+static int write_to_string(void *context, const char *chars, size_t len) {
+  StringSink *sink = context;
+  if (sink->max_writes && sink->num_writes == sink->max_writes) return false;
+  sink->num_writes++;
+  sink->str = realloc(sink->str, sink->len + len + 1);
+  memcpy(sink->str + sink->len, chars, len);
+  sink->len += len;
+  sink->str[sink->len] = '\0';
+  return true;
+}
+
+// Reads the contents of file from the start into a new string.
+static char *read_file(FILE *file) {
+  long size = ftell(file);
+  char *str = malloc(size + 1);
+  rewind(file);
+  str[fread(str, 1, size, file)] = '\0';
+  return str;
+}
+
+int test_stringify_to() {
+  // The output is many times the sink's buffer size, and has a string that's
+  // longer than the buffer.
+  char *long_str = malloc(10001);
+  memset(long_str, 'x', 10000);
+  long_str[10000] = '\0';
+  json_Item item = new_arr_item();
+  for (int i = 0; i < 5000; ++i) {
+    added_item(item) = (i == 2500 ? wrap_str_item(long_str) : int_item(i));
+  }
+  added_item(item) = copy_str_item("\xE2\x82\xAC\n");
+  char *expected = json_stringify(item);
+
+  StringSink string_sink = { .str = NULL, .len = 0 };
+  json_Sink sink = { .write = write_to_string, .context = &string_sink };
+  test_that(json_stringify_to(item, sink, 0));
+  test_str_eq(string_sink.str, expected);
+  test_that(string_sink.num_writes > 1);
+
+  // After a failed write, nothing more is written.
+  string_sink = (StringSink){ .str = NULL, .len = 0, .max_writes = 1 };
+  test_that(!json_stringify_to(item, sink, 0));
+  test_that(string_sink.num_writes == 1);
+  test_that(strncmp(string_sink.str, expected, string_sink.len) == 0);
+  free(string_sink.str);
+
+  // Small output is written all at once at the end.
+  json_Item small_item;
+  json_parse("[1,{\"a\":null}]", &small_item);
+  string_sink = (StringSink){ .str = NULL, .len = 0 };
+  test_that(json_stringify_to(small_item, sink, 0));
+  test_str_eq(string_sink.str, "[1,{\"a\":null}]");
+  test_that(string_sink.num_writes == 1);
+  free(string_sink.str);
+  json_release_item(&small_item);
+
+  // Files and file descriptors.
+  FILE *file = tmpfile();
+  test_that(json_stringify_to(item, json_file_sink(file), 0));
+  char *str = read_file(file);
+  test_str_eq(str, expected);
+  free(str);
+  fclose(file);
+
+  file = tmpfile();
+  test_that(json_stringify_to(item, json_fd_sink(fileno(file)), 0));
+  fseek(file, 0, SEEK_END);
+  str = read_file(file);
+  test_str_eq(str, expected);
+  free(str);
+  fclose(file);
+
+  test_that(!json_stringify_to(item, json_fd_sink(-1), 0));
+
+  json_release_item(&item);  // This frees long_str.
+  free(expected);
+
+  return test_success;
+}
+
+int test_stringify_numbers() {
+  // Each has the shortest digits that round-trip, laid out as JavaScript does.
+  double numbers[] = {
+    0.1, 0.3, 123456789, 1.5, -2.25, 1e21, 1e20, 1e-7, 1e-6, 123.456, 5e-324,
+    1.7976931348623157e308, 2.2250738585072014e-308, 9007199254740993.0,
+    1e23, -0.0, 0.1 + 0.2, 4.35, 1.0 / 3
+  };
+  char *strs[] = {
+    "0.1", "0.3", "123456789", "1.5", "-2.25", "1e+21",
+    "100000000000000000000", "1e-7", "0.000001", "123.456", "5e-324",
+    "1.7976931348623157e+308", "2.2250738585072014e-308", "9007199254740992",
+    "1e+23", "-0", "0.30000000000000004", "4.35", "0.3333333333333333"
+  };
+  json_Item item = { .type = item_number };
+  for (int i = 0; i < array_size(numbers); ++i) {
+    item.value.number = numbers[i];
+    char *str = json_stringify(item);
+    test_str_eq(str, strs[i]);
+    free(str);
+  }
+
+  // Doubles from random bit patterns read back exactly.
+  int num_mismatches = 0;
+  for (int i = 0; i < 200000; ++i) {
+    uint64_t bits = rand64();
+    memcpy(&item.value.number, &bits, sizeof(double));
+    if (item.value.number - item.value.number != 0) continue;  // Skip nan, inf.
+    char *str = json_stringify(item);
+    json_Item parsed;
+    json_parse(str, &parsed);
+    double d = (parsed.type == item_integer ? (double)parsed.value.integer :
+                                              parsed.value.number);
+    num_mismatches += (memcmp(&d, &item.value.number, sizeof(d)) != 0 &&
+                       !(d == 0 && item.value.number == 0));
+    free(str);
+  }
+  test_that(num_mismatches == 0);
+
+  return test_success;
+}
+
+int test_stringify_flags() {
+  // Raw UTF-8 passes non-ASCII through, and both modes escape quotes,
+  // backslashes, and control characters.
+  char *strs[] = {
+    "caf\xC3\xA9", "\xE4\xBD\xA0\xE5\xA5\xBD \xF0\x9F\x98\x80", "a\"b\\c\n\t",
+    "\x01\x1F\x7F", "a\xC3"
+  };
+  char *escaped[] = {
+    "\"caf\\u00E9\"", "\"\\u4F60\\u597D \\uD83D\\uDE00\"",
+    "\"a\\\"b\\\\c\\n\\t\"", "\"\\u0001\\u001F\x7F\"", NULL
+  };
+  char *raw[] = {
+    "\"caf\xC3\xA9\"", "\"\xE4\xBD\xA0\xE5\xA5\xBD \xF0\x9F\x98\x80\"",
+    "\"a\\\"b\\\\c\\n\\t\"", "\"\\u0001\\u001F\x7F\"", "\"a\\uFFFD\""
+  };
+  json_Item item = { .type = item_string };
+  for (int i = 0; i < array_size(strs); ++i) {
+    item.value.string = strs[i];
+    char *str;
+    if (escaped[i]) {  // Invalid UTF-8 is only checked for raw output.
+      str = json_stringify_with_flags(item, 0);
+      test_str_eq(str, escaped[i]);
+      free(str);
+    }
+    str = json_stringify_with_flags(item, json_raw_utf8);
+    test_str_eq(str, raw[i]);
+    free(str);
+  }
+
+  // Long mixed strings round-trip in either mode, and raw output is smaller.
+  char *words[] = { "plain ascii ", "\xE4\xBD\xA0\xE5\xA5\xBD",
+                    "\xF0\x9F\x98\x80\\n", "caf\xC3\xA9 ", "\\\"\\t" };
+  char *json = malloc(40000), *s = json;
+  s += sprintf(s, "{\"k\": [\"");
+  for (int i = 0; i < 1000; ++i) s += sprintf(s, "%s", words[i * 7 % 5]);
+  sprintf(s, "\", 1.5, true]}");
+  json_parse(json, &item);
+  char *escaped_str = json_stringify(item);
+  char *raw_str = json_stringify_with_flags(item, json_raw_utf8);
+  test_that(strlen(raw_str) < strlen(escaped_str));
+  json_Item round_trip;
+  test_that(json_parse(raw_str, &round_trip) != NULL);
+  char *str = json_stringify(round_trip);
+  test_str_eq(str, escaped_str);
+  free(str);
+  json_release_item(&round_trip);
+
+  // The flags apply to every form of output.
+  str = json_stringify_with_flags(item, json_pretty);
+  char *pretty = json_pretty_stringify(item);
+  test_str_eq(str, pretty);
+  free(str);
+  free(pretty);
+  char buf[40000];
+  size_t len;
+  test_that(json_stringify_into(item, buf, sizeof(buf), &len, json_raw_utf8));
+  test_str_eq(buf, raw_str);
+  StringSink string_sink = { .str = NULL, .len = 0 };
+  json_Sink sink = { .write = write_to_string, .context = &string_sink };
+  test_that(json_stringify_to(item, sink, json_raw_utf8));
+  test_str_eq(string_sink.str, raw_str);
+  free(string_sink.str);
+
+  free(raw_str);
+  free(escaped_str);
+  free(json);
+  json_release_item(&item);
+
+  // Keys are escaped as strings are, just as the writer escapes them.
+  char *key = "q\"b\\c\x01 caf\xC3\xA9";
+  json_parse("{\"q\\\"b\\\\c\\u0001 caf\\u00e9\": [\"\\n\"]}", &item);
+  test_that(map__get(item.value.object, key) != NULL);
+  int key_flags[] = { 0, json_raw_utf8, json_pretty | json_raw_utf8 };
+  for (int i = 0; i < array_size(key_flags); ++i) {
+    str = json_stringify_with_flags(item, key_flags[i]);
+    json_Writer w = json_writer_new(key_flags[i]);
+    json_writer_begin_object(w);
+    json_writer_key(w, key);
+    json_writer_begin_array(w);
+    json_writer_string(w, "\n");
+    json_writer_end_array(w);
+    json_writer_end_object(w);
+    test_str_eq(str, json_writer_output(w, NULL));
+    json_writer_delete(w);
+
+    json_Item reparsed;
+    test_that(json_parse(str, &reparsed) != NULL);
+    test_that(map__get(reparsed.value.object, key) != NULL);
+    json_release_item(&reparsed);
+    free(str);
+  }
+  str = json_stringify(item);
+  test_str_eq(str, "{\"q\\\"b\\\\c\\u0001 caf\\u00E9\":[\"\\n\"]}");
+  free(str);
+  json_release_item(&item);
+
+  return test_success;
+}
+
+int test_stringified_length() {
+  char *inputs[] = {
+    "[1,2.5,\"a\\nb\",{\"k\":[true,false,null]},-7,1e300]", "\"caf\\u00E9\"",
+    "{}", "[]", "42", "{\"a\":{\"b\":[\"\\ud83d\\ude00\",{}]},\"c\":[[]]}"
+  };
+  int flags[] = { 0, json_pretty, json_raw_utf8, json_pretty | json_raw_utf8 };
+  for (int i = 0; i < array_size(inputs); ++i) {
+    json_Item item;
+    json_parse(inputs[i], &item);
+    for (int j = 0; j < array_size(flags); ++j) {
+      char *str = json_stringify_with_flags(item, flags[j]);
+      size_t len = json_stringified_length(item, flags[j]);
+      test_that(len == strlen(str));
+
+      // A buffer of exactly that size plus one is filled in a single call.
+      char *buf = malloc(len + 1);
+      size_t written;
+      test_that(json_stringify_into(item, buf, len + 1, &written, flags[j]));
+      test_that(written == len);
+      test_str_eq(buf, str);
+      free(buf);
+      free(str);
+    }
+    json_release_item(&item);
+  }
+
+  return test_success;
+}
+
+// Checks that json_stringify_parallel gives just what json_stringify_with_flags
+// does for the json in str, with each set of flags.
+static void check_stringify_parallel(char *str, int num_threads) {
+  test_printf("About to stringify %.20s... with %d threads\n", str,
+              num_threads);
+  json_Item item;
+  json_parse(str, &item);
+  int flags[] = { 0, json_pretty, json_raw_utf8 };
+  for (int i = 0; i < array_size(flags); ++i) {
+    char *expected = json_stringify_with_flags(item, flags[i]);
+    char *actual = json_stringify_parallel(item, flags[i], num_threads);
+    test_str_eq(actual, expected);
+    free(expected);
+    free(actual);
+  }
+  json_release_item(&item);
+}
+
+int test_stringify_parallel() {
+  for (int kind = 0; kind < 4; ++kind) {
+    char *buf = big_array(kind, 20000);
+    check_stringify_parallel(buf, 1);
+    check_stringify_parallel(buf, 4);
+    check_stringify_parallel(buf, 0);
+    free(buf);
+  }
+
+  // A big object, whose members are joined in the order they're printed.
+  int n = 20000;
+  char *buf = malloc((size_t)n * 64 + 16), *s = buf;
+  *s++ = '{';
+  for (int i = 0; i < n; ++i) {
+    s += sprintf(s, "%s\"key %d\":{\"v\":[%d,\"caf\\u00e9\",{}]}",
+                 i ? "," : "", i, i);
+  }
+  strcpy(s, "}");
+  check_stringify_parallel(buf, 4);
+  free(buf);
+
+  // Small and scalar items use one thread.
+  check_stringify_parallel("[1,[2],{\"a\":3}]", 4);
+  check_stringify_parallel("[]", 4);
+  check_stringify_parallel("{}", 4);
+  check_stringify_parallel("\"a\"", 4);
+
+  return test_success;
+}
+
+// Writes a record with every kind of value.
+static void write_record(json_Writer w, int id) {
+  json_writer_begin_object(w);
+  json_writer_key(w, "id");
+  json_writer_integer(w, id);
+  json_writer_key(w, "name");
+  json_writer_string(w, "caf\xC3\xA9 \"x\"");
+  json_writer_key(w, "scores");
+  json_writer_begin_array(w);
+  json_writer_number(w, 0.5);
+  json_writer_number(w, 1e21);
+  json_writer_begin_array(w);
+  json_writer_end_array(w);
+  json_writer_end_array(w);
+  json_writer_key(w, "ok");
+  json_writer_bool(w, true);
+  json_writer_key(w, "x\ny");
+  json_writer_begin_object(w);
+  json_writer_key(w, "none");
+  json_writer_null(w);
+  json_writer_end_object(w);
+  json_writer_key(w, "bytes");
+  json_writer_string_n(w, "a\0b", 3);
+  json_writer_end_object(w);
+}
+
+// Misuses of a writer, which debug builds catch.
+static void value_without_key(json_Writer w) {
+  json_writer_begin_object(w);
+  json_writer_integer(w, 1);
+}
+
+static void key_in_array(json_Writer w) {
+  json_writer_begin_array(w);
+  json_writer_key(w, "a");
+}
+
+static void mismatched_end(json_Writer w) {
+  json_writer_begin_array(w);
+  json_writer_end_object(w);
+}
+
+static void two_values(json_Writer w) {
+  json_writer_null(w);
+  json_writer_null(w);
+}
+
+static void key_without_value(json_Writer w) {
+  json_writer_begin_object(w);
+  json_writer_key(w, "a");
+  json_writer_end_object(w);
+}
+
+static void write_one_record(json_Writer w) {
+  write_record(w, 0);
+}
+
+// Returns true if calls abort the process, as the writer's checks do.
+static int aborts(void (*calls)(json_Writer)) {
+  pid_t pid = fork();
+  if (pid == 0) {
+    freopen("/dev/null", "w", stderr);
+    json_Writer w = json_writer_new(0);
+    calls(w);
+    _exit(0);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+int test_writer() {
+  json_Writer w = json_writer_new(0);
+  write_record(w, 7);
+  size_t len;
+  const char *out = json_writer_output(w, &len);
+  char *expected = "{\"id\":7,\"name\":\"caf\\u00E9 \\\"x\\\"\","
+                   "\"scores\":[0.5,1e+21,[]],\"ok\":true,"
+                   "\"x\\ny\":{\"none\":null},\"bytes\":\"a\\u0000b\"}";
+  test_str_eq(out, expected);
+  test_that(len == strlen(expected));
+
+  // A reset writer starts over, and scalars can stand alone.
+  json_writer_reset(w);
+  json_writer_string(w, "solo");
+  test_str_eq(json_writer_output(w, NULL), "\"solo\"");
+  json_writer_delete(w);
+
+  // Pretty output matches json_pretty_stringify.
+  w = json_writer_new(json_pretty | json_raw_utf8);
+  write_record(w, 7);
+  test_str_eq(json_writer_output(w, NULL),
+              "{\n"
+              "  \"id\": 7,\n"
+              "  \"name\": \"caf\xC3\xA9 \\\"x\\\"\",\n"
+              "  \"scores\": [\n"
+              "    0.5,\n"
+              "    1e+21,\n"
+              "    []\n"
+              "  ],\n"
+              "  \"ok\": true,\n"
+              "  \"x\\ny\": {\n"
+              "    \"none\": null\n"
+              "  },\n"
+              "  \"bytes\": \"a\\u0000b\"\n"
+              "}");
+  json_writer_reset(w);
+  json_writer_begin_array(w);
+  for (int i = 0; i < 3; ++i) {
+    json_writer_begin_array(w);
+    json_writer_integer(w, i);
+    json_writer_begin_object(w);
+    json_writer_end_object(w);
+    json_writer_end_array(w);
+  }
+  json_writer_end_array(w);
+  json_Item item;
+  json_parse((char *)json_writer_output(w, NULL), &item);
+  char *pretty = json_pretty_stringify(item);
+  test_str_eq(json_writer_output(w, NULL), pretty);
+  free(pretty);
+  json_release_item(&item);
+  json_writer_delete(w);
+
+  // Output to a sink is the same as in memory, however long it is.
+  json_Writer mem = json_writer_new(0);
+  StringSink string_sink = { .str = NULL, .len = 0 };
+  json_Sink sink = { .write = write_to_string, .context = &string_sink };
+  w = json_writer_new_to_sink(sink, 0);
+  json_writer_begin_array(mem);
+  json_writer_begin_array(w);
+  for (int i = 0; i < 1000; ++i) {
+    write_record(mem, i);
+    write_record(w, i);
+  }
+  json_writer_end_array(mem);
+  json_writer_end_array(w);
+  test_that(json_writer_flush(w));
+  test_that(string_sink.num_writes > 1);
+  test_str_eq(string_sink.str, json_writer_output(mem, NULL));
+  test_that(json_parse(string_sink.str, &item) != NULL);
+  test_that(item.type == item_array && item.value.array->count == 1000);
+  json_release_item(&item);
+  free(string_sink.str);
+  json_writer_delete(w);
+  json_writer_delete(mem);
+
+  // Misuse is caught.
+  test_that(aborts(value_without_key));
+  test_that(aborts(key_in_array));
+  test_that(aborts(mismatched_end));
+  test_that(aborts(two_values));
+  test_that(aborts(key_without_value));
+  test_that(!aborts(write_one_record));
+
+  return test_success;
+}
+
 int main(int argc, char **argv) {
   start_all_tests(argv[0]);
   run_tests(
-    test_parse_number, test_parse_string, test_parse_literals,
+    test_parse_number, test_parse_number_vs_strtod, test_integer_items,
+    test_parse_string, test_parse_long_strings,
+    test_parse_literals,
     test_parse_arrays, test_parse_objects, test_parse_mixed,
-    test_stringify, test_unicode_escapes, test_parse_tail
+    test_stringify, test_unicode_escapes, test_parse_tail,
+    test_parse_with_index, test_structural_index, test_parse_n,
+    test_parse_in_situ, test_parse_document, test_custom_allocator,
+    test_deep_nesting, test_push_parser, test_parse_batch,
+    test_ondemand, test_parse_tape, test_intern_keys,
+    test_parse_events, test_extract, test_validate,
+    test_parse_array, test_utf8, test_stringify_into,
+    test_stringify_to, test_stringify_numbers, test_stringify_flags,
+    test_stringified_length, test_stringify_parallel, test_writer
   );
   return end_all_tests();
 }